@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024 bmax121. All Rights Reserved.
+ */
+
+#include <bootprof.h>
+#include <ktypes.h>
+#include <baselib.h>
+#include <uapi/scdefs.h>
+#include <asm/arch_timer.h>
+
+typedef struct
+{
+    const char *name;
+    int rc;
+    int depth;
+    uint64_t start;
+    uint64_t end;
+} boot_stage_t;
+
+static boot_stage_t boot_stages[KP_BOOT_STAGE_MAX] = { 0 };
+static int boot_stage_num = 0;
+static int boot_stage_depth = 0;
+
+int boot_stage_begin(const char *name)
+{
+    uint64_t now = __arch_counter_get_cntvct();
+    int depth = __atomic_fetch_add(&boot_stage_depth, 1, __ATOMIC_RELAXED);
+    int idx = __atomic_fetch_add(&boot_stage_num, 1, __ATOMIC_RELAXED);
+    if (idx >= KP_BOOT_STAGE_MAX) return -1;
+    boot_stage_t *stage = &boot_stages[idx];
+    stage->name = name;
+    stage->depth = depth;
+    // a claimed stage is only shown once start is published
+    __atomic_store_n(&stage->start, now, __ATOMIC_RELEASE);
+    return idx;
+}
+
+void boot_stage_end(int idx, int rc)
+{
+    uint64_t now = __arch_counter_get_cntvct();
+    __atomic_sub_fetch(&boot_stage_depth, 1, __ATOMIC_RELAXED);
+    if (idx < 0) return;
+    boot_stages[idx].rc = rc;
+    __atomic_store_n(&boot_stages[idx].end, now, __ATOMIC_RELEASE);
+}
+
+void boot_prof_get(struct kp_boot_prof *prof)
+{
+    int num = __atomic_load_n(&boot_stage_num, __ATOMIC_RELAXED);
+    if (num > KP_BOOT_STAGE_MAX) num = KP_BOOT_STAGE_MAX;
+    prof->freq = arch_timer_get_cntfrq();
+    prof->num = 0;
+    for (int i = 0; i < num; i++) {
+        boot_stage_t *stage = &boot_stages[i];
+        uint64_t start = __atomic_load_n(&stage->start, __ATOMIC_ACQUIRE);
+        if (!start) continue;
+        struct kp_boot_stage *out = &prof->stages[prof->num++];
+        out->end = __atomic_load_n(&stage->end, __ATOMIC_ACQUIRE);
+        out->start = start;
+        out->rc = stage->rc;
+        out->depth = stage->depth;
+        lib_strlcpy(out->name, stage->name, sizeof(out->name));
+    }
+}
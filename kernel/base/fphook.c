@@ -241,10 +241,10 @@ void fp_unhook(uintptr_t fp_addr, void *backup)
 }
 KP_EXPORT_SYMBOL(fp_unhook);
 
-hook_err_t fp_hook_wrap(uintptr_t fp_addr, int32_t argno, void *before, void *after, void *udata)
+// fp_chain_* callers hold the hook mem lock
+static hook_err_t fp_chain_wrap(uintptr_t fp_addr, int32_t argno, void *before, void *after, void *udata)
 {
     hook_err_t err = HOOK_NO_ERR;
-    if (is_bad_address((void *)fp_addr)) return -HOOK_BAD_ADDRESS;
     fp_hook_chain_t *chain = hook_get_mem_from_origin(fp_addr);
     if (!chain) {
         chain = (fp_hook_chain_t *)hook_mem_zalloc(fp_addr, FUNCTION_POINTER_CHAIN);
@@ -252,13 +252,15 @@ hook_err_t fp_hook_wrap(uintptr_t fp_addr, int32_t argno, void *before, void *af
         chain->hook.fp_addr = fp_addr;
         chain->hook.replace_addr = (uint64_t)chain->transit;
         err = hook_chain_prepare(chain->transit, argno);
-        if (err) return err;
+        if (err) {
+            hook_mem_free(chain);
+            return err;
+        }
         flush_icache_all();
         fp_hook(chain->hook.fp_addr, (void *)chain->hook.replace_addr, (void **)&chain->hook.origin_fp);
     }
 
     for (int i = 0; i < FP_HOOK_CHAIN_NUM; i++) {
-        // todo: atomic or lock
         if (chain->states[i] == CHAIN_ITEM_STATE_EMPTY) {
             chain->states[i] = CHAIN_ITEM_STATE_BUSY;
             dsb(ish);
@@ -277,11 +279,9 @@ hook_err_t fp_hook_wrap(uintptr_t fp_addr, int32_t argno, void *before, void *af
     logkv("Wrap func pointer add: %llx, %llx, %llx failed\n", chain->hook.fp_addr, before, after);
     return -HOOK_CHAIN_FULL;
 }
-KP_EXPORT_SYMBOL(fp_hook_wrap);
 
-void fp_hook_unwrap(uintptr_t fp_addr, void *before, void *after)
+static void fp_chain_unwrap(uintptr_t fp_addr, void *before, void *after)
 {
-    if (is_bad_address((void *)fp_addr)) return;
     fp_hook_chain_t *chain = (fp_hook_chain_t *)hook_get_mem_from_origin(fp_addr);
     if (!chain) return;
     for (int i = 0; i < FP_HOOK_CHAIN_NUM; i++) {
@@ -307,4 +307,49 @@ void fp_hook_unwrap(uintptr_t fp_addr, void *before, void *after)
     hook_mem_free(chain);
     logkv("Unwrap func pointer: %llx, %llx, %llx\n", fp_addr, before, after);
 }
-KP_EXPORT_SYMBOL(fp_hook_unwrap);
\ No newline at end of file
+
+// see hook_chain_replace
+static hook_err_t fp_chain_replace(uintptr_t fp_addr, void *old_before, void *old_after, void *before, void *after)
+{
+    fp_hook_chain_t *chain = (fp_hook_chain_t *)hook_get_mem_from_origin(fp_addr);
+    if (!chain) return -HOOK_NOT_HOOK;
+    for (int i = 0; i < FP_HOOK_CHAIN_NUM; i++) {
+        if (chain->states[i] != CHAIN_ITEM_STATE_READY) continue;
+        if ((old_before && chain->befores[i] == old_before) || (old_after && chain->afters[i] == old_after)) {
+            __atomic_store_n(&chain->befores[i], before, __ATOMIC_RELEASE);
+            __atomic_store_n(&chain->afters[i], after, __ATOMIC_RELEASE);
+            logkv("Wrap func pointer replace: %llx, %llx, %llx\n", chain->hook.fp_addr, before, after);
+            return HOOK_NO_ERR;
+        }
+    }
+    return -HOOK_NOT_HOOK;
+}
+
+hook_err_t fp_hook_wrap(uintptr_t fp_addr, int32_t argno, void *before, void *after, void *udata)
+{
+    if (is_bad_address((void *)fp_addr)) return -HOOK_BAD_ADDRESS;
+    hook_mem_lock();
+    hook_err_t err = fp_chain_wrap(fp_addr, argno, before, after, udata);
+    hook_mem_unlock();
+    return err;
+}
+KP_EXPORT_SYMBOL(fp_hook_wrap);
+
+void fp_hook_unwrap(uintptr_t fp_addr, void *before, void *after)
+{
+    if (is_bad_address((void *)fp_addr)) return;
+    hook_mem_lock();
+    fp_chain_unwrap(fp_addr, before, after);
+    hook_mem_unlock();
+}
+KP_EXPORT_SYMBOL(fp_hook_unwrap);
+
+hook_err_t fp_hook_wrap_replace(uintptr_t fp_addr, void *old_before, void *old_after, void *before, void *after)
+{
+    if (is_bad_address((void *)fp_addr)) return -HOOK_BAD_ADDRESS;
+    hook_mem_lock();
+    hook_err_t err = fp_chain_replace(fp_addr, old_before, old_after, before, after);
+    hook_mem_unlock();
+    return err;
+}
+KP_EXPORT_SYMBOL(fp_hook_wrap_replace);
\ No newline at end of file
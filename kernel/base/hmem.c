@@ -6,9 +6,12 @@
 #include "hook.h"
 
 #include <stdint.h>
+#include <ktypes.h>
+#include <uapi/scdefs.h>
 
 static uint64_t mem_region_start = 0;
 static uint64_t mem_region_end = 0;
+static int hook_lock = 0;
 
 typedef struct
 {
@@ -34,6 +37,20 @@ int hook_mem_add(uint64_t start, int32_t size)
     return 0;
 }
 
+void hook_mem_lock()
+{
+    while (__atomic_exchange_n(&hook_lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&hook_lock, __ATOMIC_RELAXED)) {
+            asm volatile("yield");
+        }
+    }
+}
+
+void hook_mem_unlock()
+{
+    __atomic_store_n(&hook_lock, 0, __ATOMIC_RELEASE);
+}
+
 void *hook_mem_zalloc(uintptr_t origin_addr, enum hook_type type)
 {
     uint64_t start = mem_region_start;
@@ -64,6 +81,12 @@ void hook_mem_free(void *hook_mem)
     warp->using = 0;
 }
 
+void hook_mem_retire(void *hook_mem)
+{
+    hook_mem_warp_t *warp = local_container_of(hook_mem, hook_mem_warp_t, chain);
+    warp->addr = 0;
+}
+
 void *hook_get_mem_from_origin(uint64_t origin_addr)
 {
     uint64_t start = mem_region_start;
@@ -76,3 +99,53 @@ void *hook_get_mem_from_origin(uint64_t origin_addr)
     }
     return 0;
 }
+
+void hook_mem_stat(struct kp_hook_mem_stat *stat)
+{
+    stat->slot_size = sizeof(hook_mem_warp_t);
+    stat->total = (mem_region_end - mem_region_start) / sizeof(hook_mem_warp_t);
+    stat->used = stat->inline_hooks = stat->inline_chains = stat->fp_chains = 0;
+    for (uint64_t addr = mem_region_start; addr < mem_region_end; addr += sizeof(hook_mem_warp_t)) {
+        hook_mem_warp_t *wrap = (hook_mem_warp_t *)addr;
+        if (!wrap->using) continue;
+        stat->used++;
+        if (wrap->type == INLINE) stat->inline_hooks++;
+        if (wrap->type == INLINE_CHAIN) stat->inline_chains++;
+        if (wrap->type == FUNCTION_POINTER_CHAIN) stat->fp_chains++;
+    }
+}
+
+static int chain_refs(void **befores, void **afters, void **udata, chain_item_state *states, int num, uint64_t start,
+                      uint64_t end)
+{
+    int refs = 0;
+    for (int i = 0; i < num; i++) {
+        if (states[i] == CHAIN_ITEM_STATE_EMPTY) continue;
+        if ((uint64_t)befores[i] >= start && (uint64_t)befores[i] < end) refs++;
+        if ((uint64_t)afters[i] >= start && (uint64_t)afters[i] < end) refs++;
+        if ((uint64_t)udata[i] >= start && (uint64_t)udata[i] < end) refs++;
+    }
+    return refs;
+}
+
+int hook_mem_refs(uint64_t start, uint64_t end)
+{
+    int refs = 0;
+    hook_mem_lock();
+    for (uint64_t addr = mem_region_start; addr < mem_region_end; addr += sizeof(hook_mem_warp_t)) {
+        hook_mem_warp_t *wrap = (hook_mem_warp_t *)addr;
+        if (!wrap->using) continue;
+        if (wrap->type == INLINE) {
+            if (wrap->chain.inl.replace_addr >= start && wrap->chain.inl.replace_addr < end) refs++;
+        } else if (wrap->type == INLINE_CHAIN) {
+            hook_chain_t *chain = &wrap->chain.inl_chain;
+            refs += chain_refs(chain->befores, chain->afters, chain->udata, chain->states, HOOK_CHAIN_NUM, start, end);
+        } else if (wrap->type == FUNCTION_POINTER_CHAIN) {
+            fp_hook_chain_t *chain = &wrap->chain.fp_chain;
+            refs +=
+                chain_refs(chain->befores, chain->afters, chain->udata, chain->states, FP_HOOK_CHAIN_NUM, start, end);
+        }
+    }
+    hook_mem_unlock();
+    return refs;
+}
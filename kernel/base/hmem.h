@@ -11,6 +11,12 @@
 int hook_mem_add(uint64_t start, int32_t size);
 void *hook_mem_zalloc(uintptr_t origin_addr, enum hook_type type);
 void hook_mem_free(void *hook_mem);
+// keep the slot allocated but no longer found by origin, code may still be running in it
+void hook_mem_retire(void *hook_mem);
 void *hook_get_mem_from_origin(uint64_t origin_addr);
 
+// serializes installing and removing hooks, slot allocation and chain item updates, doesn't sleep
+void hook_mem_lock();
+void hook_mem_unlock();
+
 #endif
\ No newline at end of file
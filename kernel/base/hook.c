@@ -633,8 +633,12 @@ hook_err_t hook(void *func, void *replace, void **backup)
         return -HOOK_BAD_ADDRESS;
     }
     uint64_t origin_addr = branch_func_addr((uintptr_t)func);
+    hook_mem_lock();
     hook_t *hook = (hook_t *)hook_mem_zalloc(origin_addr, INLINE);
-    if (!hook) return -HOOK_NO_MEM;
+    if (!hook) {
+        hook_mem_unlock();
+        return -HOOK_NO_MEM;
+    }
     hook->func_addr = (uint64_t)func;
     hook->origin_addr = origin_addr;
     hook->replace_addr = (uint64_t)replace;
@@ -645,10 +649,12 @@ hook_err_t hook(void *func, void *replace, void **backup)
     err = hook_prepare(hook);
     if (err) goto out;
     hook_install(hook);
+    hook_mem_unlock();
     logkv("Hook func: %llx succsseed\n", hook->func_addr);
     return HOOK_NO_ERR;
 out:
     hook_mem_free(hook);
+    hook_mem_unlock();
     logkv("Hook func: %llx failed, err: %d\n", hook->func_addr, err);
     return err;
 }
@@ -657,11 +663,14 @@ KP_EXPORT_SYMBOL(hook);
 void unhook(void *func)
 {
     uint64_t origin = branch_func_addr((uint64_t)func);
+    hook_mem_lock();
     hook_t *hook = hook_get_mem_from_origin(origin);
-    if (!hook) return;
-    hook_uninstall(hook);
-    hook_mem_free(hook);
-    logkv("Unhook func: %llx\n", func);
+    if (hook) {
+        hook_uninstall(hook);
+        hook_mem_free(hook);
+    }
+    hook_mem_unlock();
+    if (hook) logkv("Unhook func: %llx\n", func);
 }
 KP_EXPORT_SYMBOL(unhook);
 
@@ -704,10 +713,10 @@ static hook_err_t hook_chain_prepare(uint32_t *transit, int32_t argno)
     return HOOK_NO_ERR;
 }
 
-hook_err_t hook_chain_add(hook_chain_t *chain, void *before, void *after, void *udata)
+// chain_* callers hold the hook mem lock
+static hook_err_t chain_add(hook_chain_t *chain, void *before, void *after, void *udata)
 {
     for (int i = 0; i < HOOK_CHAIN_NUM; i++) {
-        // todo: atomic or lock
         if (chain->states[i] == CHAIN_ITEM_STATE_EMPTY) {
             chain->states[i] = CHAIN_ITEM_STATE_BUSY;
             dsb(ish);
@@ -726,9 +735,8 @@ hook_err_t hook_chain_add(hook_chain_t *chain, void *before, void *after, void *
     logkv("Wrap chain add: %llx, %llx, %llx failed\n", chain->hook.func_addr, before, after);
     return -HOOK_CHAIN_FULL;
 }
-KP_EXPORT_SYMBOL(hook_chain_add);
 
-void hook_chain_remove(hook_chain_t *chain, void *before, void *after)
+static void chain_remove(hook_chain_t *chain, void *before, void *after)
 {
     for (int i = 0; i < HOOK_CHAIN_NUM; i++) {
         if (chain->states[i] == CHAIN_ITEM_STATE_READY)
@@ -745,17 +753,56 @@ void hook_chain_remove(hook_chain_t *chain, void *before, void *after)
     }
     logkv("Wrap chain remove: %llx, %llx, %llx\n", chain->hook.func_addr, before, after);
 }
+
+// Swap the callbacks of one item in place, the item never leaves the ready state so no call misses it.
+// udata is kept, a call in flight may still pair the old before with the new after.
+static hook_err_t chain_replace(hook_chain_t *chain, void *old_before, void *old_after, void *before, void *after)
+{
+    for (int i = 0; i < HOOK_CHAIN_NUM; i++) {
+        if (chain->states[i] != CHAIN_ITEM_STATE_READY) continue;
+        if ((old_before && chain->befores[i] == old_before) || (old_after && chain->afters[i] == old_after)) {
+            __atomic_store_n(&chain->befores[i], before, __ATOMIC_RELEASE);
+            __atomic_store_n(&chain->afters[i], after, __ATOMIC_RELEASE);
+            logkv("Wrap chain replace: %llx, %llx, %llx\n", chain->hook.func_addr, before, after);
+            return HOOK_NO_ERR;
+        }
+    }
+    return -HOOK_NOT_HOOK;
+}
+
+hook_err_t hook_chain_add(hook_chain_t *chain, void *before, void *after, void *udata)
+{
+    hook_mem_lock();
+    hook_err_t err = chain_add(chain, before, after, udata);
+    hook_mem_unlock();
+    return err;
+}
+KP_EXPORT_SYMBOL(hook_chain_add);
+
+void hook_chain_remove(hook_chain_t *chain, void *before, void *after)
+{
+    hook_mem_lock();
+    chain_remove(chain, before, after);
+    hook_mem_unlock();
+}
 KP_EXPORT_SYMBOL(hook_chain_remove);
 
-// todo: lock
-hook_err_t hook_wrap(void *func, int32_t argno, void *before, void *after, void *udata)
+hook_err_t hook_chain_replace(hook_chain_t *chain, void *old_before, void *old_after, void *before, void *after)
+{
+    hook_mem_lock();
+    hook_err_t err = chain_replace(chain, old_before, old_after, before, after);
+    hook_mem_unlock();
+    return err;
+}
+KP_EXPORT_SYMBOL(hook_chain_replace);
+
+static hook_err_t chain_wrap(void *func, int32_t argno, void *before, void *after, void *udata)
 {
-    if (is_bad_address(func)) return -HOOK_BAD_ADDRESS;
     uint64_t faddr = (uint64_t)func;
     uint64_t origin = branch_func_addr(faddr);
     if (is_bad_address(func)) return -HOOK_BAD_ADDRESS;
     hook_chain_t *chain = (hook_chain_t *)hook_get_mem_from_origin(origin);
-    if (chain) return hook_chain_add(chain, before, after, udata);
+    if (chain) return chain_add(chain, before, after, udata);
     chain = (hook_chain_t *)hook_mem_zalloc(origin, INLINE_CHAIN);
     if (!chain) return -HOOK_NO_MEM;
     chain->chain_items_max = 0;
@@ -770,7 +817,7 @@ hook_err_t hook_wrap(void *func, int32_t argno, void *before, void *after, void
     if (err) goto err;
     err = hook_chain_prepare(chain->transit, argno);
     if (err) goto err;
-    err = hook_chain_add(chain, before, after, udata);
+    err = chain_add(chain, before, after, udata);
     if (err) goto err;
     hook_chain_install(chain);
     logkv("Wrap func: %llx succsseed\n", hook->func_addr);
@@ -780,25 +827,65 @@ err:
     logkv("Wrap func: %llx failed, err: %d\n", hook->func_addr, err);
     return err;
 }
+
+hook_err_t hook_wrap(void *func, int32_t argno, void *before, void *after, void *udata)
+{
+    if (is_bad_address(func)) return -HOOK_BAD_ADDRESS;
+    hook_mem_lock();
+    hook_err_t err = chain_wrap(func, argno, before, after, udata);
+    hook_mem_unlock();
+    return err;
+}
 KP_EXPORT_SYMBOL(hook_wrap);
 
-void hook_unwrap_remove(void *func, void *before, void *after, int remove)
+static void chain_unwrap(void *func, void *before, void *after, int remove, int retire)
 {
     if (is_bad_address(func)) return;
     uint64_t faddr = (uint64_t)func;
     uint64_t origin = branch_func_addr(faddr);
     if (is_bad_address(func)) return;
+    hook_mem_lock();
     hook_chain_t *chain = (hook_chain_t *)hook_get_mem_from_origin(origin);
-    if (!chain) return;
-    hook_chain_remove(chain, before, after);
-    if (!remove) return;
+    if (!chain) goto out;
+    chain_remove(chain, before, after);
+    if (!remove) goto out;
     // todo:
     for (int i = 0; i < HOOK_CHAIN_NUM; i++) {
-        if (chain->states[i] != CHAIN_ITEM_STATE_EMPTY) return;
+        if (chain->states[i] != CHAIN_ITEM_STATE_EMPTY) goto out;
     }
     hook_chain_uninstall(chain);
     // todo: unsafe
-    hook_mem_free(chain);
+    if (retire) {
+        hook_mem_retire(chain);
+    } else {
+        hook_mem_free(chain);
+    }
     logkv("Unwrap func: %llx\n", func);
+out:
+    hook_mem_unlock();
+}
+
+void hook_unwrap_remove(void *func, void *before, void *after, int remove)
+{
+    chain_unwrap(func, before, after, remove, 0);
 }
 KP_EXPORT_SYMBOL(hook_unwrap_remove);
+
+void hook_unwrap_retire(void *func, void *before, void *after)
+{
+    chain_unwrap(func, before, after, 1, 1);
+}
+KP_EXPORT_SYMBOL(hook_unwrap_retire);
+
+hook_err_t hook_wrap_replace(void *func, void *old_before, void *old_after, void *before, void *after)
+{
+    if (is_bad_address(func)) return -HOOK_BAD_ADDRESS;
+    uint64_t origin = branch_func_addr((uint64_t)func);
+    hook_err_t err = -HOOK_NOT_HOOK;
+    hook_mem_lock();
+    hook_chain_t *chain = (hook_chain_t *)hook_get_mem_from_origin(origin);
+    if (chain) err = chain_replace(chain, old_before, old_after, before, after);
+    hook_mem_unlock();
+    return err;
+}
+KP_EXPORT_SYMBOL(hook_wrap_replace);
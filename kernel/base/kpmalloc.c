@@ -0,0 +1,787 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024 bmax121. All Rights Reserved.
+ */
+
+#include <kpmalloc.h>
+#include <common.h>
+#include <pgtable.h>
+#include <cache.h>
+#include <baselib.h>
+#include <kallsyms.h>
+#include <preset.h>
+#include <uapi/scdefs.h>
+#include <uapi/asm-generic/errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define align_floor(x, align) ((uint64_t)(x) & ~((uint64_t)(align)-1))
+#define align_ceil(x, align) (((uint64_t)(x) + (uint64_t)(align)-1) & ~((uint64_t)(align)-1))
+
+// TLSF itself is not thread safe. Small blocks are served from per-cpu magazines of blocks that stay allocated
+// in TLSF, only refilling and draining a magazine, and everything else, takes the heap lock.
+// Magazines are picked by MPIDR affinity, which is not guaranteed dense, so every magazine also has its own lock,
+// uncontended unless two cpus hash to the same slot.
+
+#define MAG_SLOTS 16
+#define MAG_CLASSES 6
+#define MAG_CLASS_MIN_SHIFT 4
+#define MAG_CLASS_MAX (1 << (MAG_CLASS_MIN_SHIFT + MAG_CLASSES - 1))
+#define MAG_SIZE 16
+#define MAG_BATCH (MAG_SIZE / 2)
+
+#define KP_HEAP_POOL_MAX 8
+#define KP_HEAP_GROW_SIZE (1 << 20)
+
+#define EXEC_GRANULE_SHIFT 6
+#define EXEC_GRANULE (1 << EXEC_GRANULE_SHIFT)
+
+typedef struct
+{
+    int count;
+    void *blocks[MAG_SIZE];
+} magazine_t;
+
+typedef struct
+{
+    uint32_t lock;
+    magazine_t mags[MAG_CLASSES];
+} __attribute__((aligned(64))) mag_slot_t;
+
+typedef struct
+{
+    uint64_t start;
+    uint64_t granules;
+    uint64_t used_granules;
+    uint64_t *used;
+    uint64_t *head;
+} exec_pool_t;
+
+typedef struct
+{
+    void *mem;
+    pool_t pool;
+    uint64_t size;
+} rw_pool_t;
+
+tlsf_t kp_rw_mem = 0;
+
+static uint32_t kp_rw_lock = 0;
+static mag_slot_t *mag_slots = 0;
+static uint64_t rw_total = 0;
+static uint64_t rw_used = 0;
+// pools added by kp_heap_grow, the built-in one is never released
+static rw_pool_t rw_pools[KP_HEAP_POOL_MAX] = { 0 };
+static int rw_pool_num = 0;
+
+static uint32_t kp_rox_lock = 0;
+// exec_pools[0] is the built-in ROX region
+static exec_pool_t exec_pools[KP_HEAP_POOL_MAX + 1] = { 0 };
+static int exec_pool_num = 0;
+static int exec_rdonly = 0;
+
+static void *(*kfunc_vmalloc)(unsigned long size) = 0;
+static void (*kfunc_vfree)(const void *addr) = 0;
+static void *(*kfunc_module_alloc)(unsigned long size) = 0;
+static void *(*kfunc_execmem_alloc)(int type, unsigned long size) = 0;
+static void (*kfunc_module_memfree)(void *addr) = 0;
+
+static uint32_t text_poke_lock = 0;
+static uint64_t text_poke_start = 0;
+static uint64_t text_poke_end = 0;
+
+static inline uint64_t irq_save()
+{
+    uint64_t flags;
+    asm volatile("mrs %0, daif\n"
+                 "msr daifset, #2"
+                 : "=r"(flags)
+                 :
+                 : "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint64_t flags)
+{
+    asm volatile("msr daif, %0" : : "r"(flags) : "memory");
+}
+
+static inline void kp_lock(uint32_t *lock)
+{
+    uint32_t tmp, busy;
+    asm volatile("    sevl\n"
+                 "1:  wfe\n"
+                 "2:  ldaxr %w0, %2\n"
+                 "    cbnz %w0, 1b\n"
+                 "    stxr %w1, %w3, %2\n"
+                 "    cbnz %w1, 2b\n"
+                 : "=&r"(busy), "=&r"(tmp), "+Q"(*lock)
+                 : "r"(1)
+                 : "memory");
+}
+
+static inline void kp_unlock(uint32_t *lock)
+{
+    asm volatile("stlr wzr, %0" : "=Q"(*lock) : : "memory");
+}
+
+static inline mag_slot_t *mag_slot_this_cpu()
+{
+    uint64_t mpidr;
+    asm volatile("mrs %0, mpidr_el1" : "=r"(mpidr));
+    uint64_t aff0 = mpidr & 0xff, aff1 = (mpidr >> 8) & 0xff, aff2 = (mpidr >> 16) & 0xff;
+    // dense for both cluster.core and DynamIQ (aff0 == 0, core in aff1) layouts
+    return &mag_slots[(aff0 + (aff1 << 2) + (aff2 << 4)) % MAG_SLOTS];
+}
+
+// class n holds blocks of at least 16 << n bytes
+static inline int mag_class(size_t size)
+{
+    if (size <= (1 << MAG_CLASS_MIN_SHIFT)) return 0;
+    return 64 - __builtin_clzl(size - 1) - MAG_CLASS_MIN_SHIFT;
+}
+
+static inline int mag_class_of_block(size_t block_size)
+{
+    if (block_size < (1 << MAG_CLASS_MIN_SHIFT) || block_size >= (MAG_CLASS_MAX << 1)) return -1;
+    return 63 - __builtin_clzl(block_size) - MAG_CLASS_MIN_SHIFT;
+}
+
+// rw_used counts blocks handed out by TLSF, cached ones included, all under kp_rw_lock
+static void *rw_malloc(size_t bytes)
+{
+    void *ptr = tlsf_malloc(kp_rw_mem, bytes);
+    if (ptr) rw_used += tlsf_block_size(ptr);
+    return ptr;
+}
+
+static void rw_free(void *ptr)
+{
+    if (!ptr) return;
+    rw_used -= tlsf_block_size(ptr);
+    tlsf_free(kp_rw_mem, ptr);
+}
+
+static void mag_refill(magazine_t *mag, int class)
+{
+    size_t size = 1 << (class + MAG_CLASS_MIN_SHIFT);
+    kp_lock(&kp_rw_lock);
+    while (mag->count < MAG_BATCH) {
+        void *ptr = rw_malloc(size);
+        if (!ptr) break;
+        mag->blocks[mag->count++] = ptr;
+    }
+    kp_unlock(&kp_rw_lock);
+}
+
+static void mag_drain(magazine_t *mag, int keep)
+{
+    kp_lock(&kp_rw_lock);
+    while (mag->count > keep) {
+        rw_free(mag->blocks[--mag->count]);
+    }
+    kp_unlock(&kp_rw_lock);
+}
+
+void *kp_malloc(size_t bytes)
+{
+    void *ptr = 0;
+    uint64_t flags = irq_save();
+    if (mag_slots && bytes && bytes <= MAG_CLASS_MAX) {
+        int class = mag_class(bytes);
+        mag_slot_t *slot = mag_slot_this_cpu();
+        kp_lock(&slot->lock);
+        magazine_t *mag = &slot->mags[class];
+        if (!mag->count) mag_refill(mag, class);
+        if (mag->count) ptr = mag->blocks[--mag->count];
+        kp_unlock(&slot->lock);
+    } else {
+        kp_lock(&kp_rw_lock);
+        ptr = rw_malloc(bytes);
+        kp_unlock(&kp_rw_lock);
+    }
+    irq_restore(flags);
+    return ptr;
+}
+
+void *kp_memalign(size_t align, size_t bytes)
+{
+    uint64_t flags = irq_save();
+    kp_lock(&kp_rw_lock);
+    void *ptr = tlsf_memalign(kp_rw_mem, align, bytes);
+    if (ptr) rw_used += tlsf_block_size(ptr);
+    kp_unlock(&kp_rw_lock);
+    irq_restore(flags);
+    return ptr;
+}
+
+void *kp_realloc(void *ptr, size_t size)
+{
+    uint64_t flags = irq_save();
+    kp_lock(&kp_rw_lock);
+    size_t old_size = ptr ? tlsf_block_size(ptr) : 0;
+    void *new = tlsf_realloc(kp_rw_mem, ptr, size);
+    if (new) {
+        rw_used += tlsf_block_size(new) - old_size;
+    } else if (!size) {
+        rw_used -= old_size;
+    }
+    ptr = new;
+    kp_unlock(&kp_rw_lock);
+    irq_restore(flags);
+    return ptr;
+}
+
+void kp_free(void *ptr)
+{
+    if (!ptr) return;
+    uint64_t flags = irq_save();
+    // blocks cached in class n are only ever handed out for requests up to 16 << n
+    int class = mag_slots ? mag_class_of_block(tlsf_block_size(ptr)) : -1;
+    if (class >= 0) {
+        mag_slot_t *slot = mag_slot_this_cpu();
+        kp_lock(&slot->lock);
+        magazine_t *mag = &slot->mags[class];
+        if (mag->count == MAG_SIZE) mag_drain(mag, MAG_BATCH);
+        mag->blocks[mag->count++] = ptr;
+        kp_unlock(&slot->lock);
+    } else {
+        kp_lock(&kp_rw_lock);
+        rw_free(ptr);
+        kp_unlock(&kp_rw_lock);
+    }
+    irq_restore(flags);
+}
+
+// The executable pools are not TLSF heaps: block state lives in two bitmaps in rw memory, one bit per granule in use
+// and one per granule starting a block. The allocator never touches a pool itself, so it can stay mapped read-only,
+// and code is written with kp_text_poke_begin/end.
+
+static inline int exec_bit(uint64_t *map, uint64_t i)
+{
+    return (map[i >> 6] >> (i & 63)) & 1;
+}
+
+static inline void exec_set_bit(uint64_t *map, uint64_t i)
+{
+    map[i >> 6] |= 1ul << (i & 63);
+}
+
+static inline void exec_clear_bit(uint64_t *map, uint64_t i)
+{
+    map[i >> 6] &= ~(1ul << (i & 63));
+}
+
+static uint64_t exec_block_granules(exec_pool_t *pool, uint64_t first)
+{
+    uint64_t i = first + 1;
+    while (i < pool->granules && exec_bit(pool->used, i) && !exec_bit(pool->head, i))
+        i++;
+    return i - first;
+}
+
+static exec_pool_t *exec_pool_of(void *ptr, uint64_t *granule)
+{
+    uint64_t addr = (uint64_t)ptr;
+    if (addr & (EXEC_GRANULE - 1)) return 0;
+    for (int i = 0; i < exec_pool_num; i++) {
+        exec_pool_t *pool = &exec_pools[i];
+        if (!pool->granules) continue;
+        if (addr < pool->start || addr >= pool->start + (pool->granules << EXEC_GRANULE_SHIFT)) continue;
+        uint64_t first = (addr - pool->start) >> EXEC_GRANULE_SHIFT;
+        if (!exec_bit(pool->head, first)) return 0;
+        *granule = first;
+        return pool;
+    }
+    return 0;
+}
+
+static void exec_mark(exec_pool_t *pool, uint64_t first, uint64_t num)
+{
+    exec_set_bit(pool->head, first);
+    for (uint64_t i = first; i < first + num; i++)
+        exec_set_bit(pool->used, i);
+    pool->used_granules += num;
+}
+
+static void exec_unmark(exec_pool_t *pool, uint64_t first, uint64_t num)
+{
+    exec_clear_bit(pool->head, first);
+    for (uint64_t i = first; i < first + num; i++)
+        exec_clear_bit(pool->used, i);
+    pool->used_granules -= num;
+}
+
+// first fit, pool starts are page aligned so aligning the granule index aligns the address
+static void *exec_pool_alloc(exec_pool_t *pool, uint64_t step, uint64_t num)
+{
+    uint64_t i = 0;
+    while (i + num <= pool->granules) {
+        if (!(i & 63) && pool->used[i >> 6] == ~0ul) {
+            i = align_ceil(i + 64, step);
+            continue;
+        }
+        uint64_t n = 0;
+        while (n < num && !exec_bit(pool->used, i + n))
+            n++;
+        if (n == num) {
+            exec_mark(pool, i, num);
+            return (void *)(pool->start + (i << EXEC_GRANULE_SHIFT));
+        }
+        i = align_ceil(i + n + 1, step);
+    }
+    return 0;
+}
+
+static void *exec_alloc(size_t align, size_t bytes)
+{
+    if (!bytes) return 0;
+    uint64_t num = (bytes + EXEC_GRANULE - 1) >> EXEC_GRANULE_SHIFT;
+    uint64_t step = align > EXEC_GRANULE ? align >> EXEC_GRANULE_SHIFT : 1;
+    for (int i = 0; i < exec_pool_num; i++) {
+        if (!exec_pools[i].granules) continue;
+        void *ptr = exec_pool_alloc(&exec_pools[i], step, num);
+        if (ptr) return ptr;
+    }
+    return 0;
+}
+
+void *kp_malloc_exec(size_t bytes)
+{
+    return kp_memalign_exec(EXEC_GRANULE, bytes);
+}
+
+void *kp_memalign_exec(size_t align, size_t bytes)
+{
+    if (align & (align - 1)) return 0;
+    uint64_t flags = irq_save();
+    kp_lock(&kp_rox_lock);
+    void *ptr = exec_alloc(align, bytes);
+    kp_unlock(&kp_rox_lock);
+    irq_restore(flags);
+    return ptr;
+}
+
+void *kp_realloc_exec(void *ptr, size_t size)
+{
+    if (!ptr) return kp_malloc_exec(size);
+    if (!size) {
+        kp_free_exec(ptr);
+        return 0;
+    }
+    uint64_t need = (size + EXEC_GRANULE - 1) >> EXEC_GRANULE_SHIFT;
+    uint64_t first = 0;
+    void *new = 0;
+    uint64_t old_size = 0;
+
+    uint64_t flags = irq_save();
+    kp_lock(&kp_rox_lock);
+    exec_pool_t *pool = exec_pool_of(ptr, &first);
+    if (!pool) goto unlock;
+    uint64_t num = exec_block_granules(pool, first);
+    if (need <= num) {
+        for (uint64_t i = first + need; i < first + num; i++)
+            exec_clear_bit(pool->used, i);
+        pool->used_granules -= num - need;
+        new = ptr;
+        goto unlock;
+    }
+    uint64_t n = num;
+    while (first + n < pool->granules && n < need && !exec_bit(pool->used, first + n))
+        n++;
+    if (n == need) {
+        for (uint64_t i = first + num; i < first + need; i++)
+            exec_set_bit(pool->used, i);
+        pool->used_granules += need - num;
+        new = ptr;
+        goto unlock;
+    }
+    new = exec_alloc(EXEC_GRANULE, size);
+    old_size = num << EXEC_GRANULE_SHIFT;
+unlock:
+    kp_unlock(&kp_rox_lock);
+    irq_restore(flags);
+
+    if (new && new != ptr) {
+        kp_text_poke(new, ptr, old_size);
+        kp_free_exec(ptr);
+    }
+    return new;
+}
+
+void kp_free_exec(void *ptr)
+{
+    if (!ptr) return;
+    uint64_t first = 0;
+    uint64_t flags = irq_save();
+    kp_lock(&kp_rox_lock);
+    exec_pool_t *pool = exec_pool_of(ptr, &first);
+    if (pool) exec_unmark(pool, first, exec_block_granules(pool, first));
+    kp_unlock(&kp_rox_lock);
+    irq_restore(flags);
+}
+
+static void exec_set_prot(uint64_t start, uint64_t end, int writable)
+{
+    if (writable) {
+        pgtable_update_range(start, end, PTE_DBM, PTE_RDONLY);
+    } else {
+        pgtable_update_range(start, end, PTE_RDONLY, PTE_DBM);
+    }
+    flush_tlb_kernel_range(start, end);
+}
+
+// Batches are serialized, and held for as long as the caller writes, so callers must not sleep inside one.
+void kp_text_poke_begin(void *addr, size_t len)
+{
+    kp_lock(&text_poke_lock);
+    text_poke_start = align_floor(addr, page_size);
+    text_poke_end = align_ceil((uint64_t)addr + len, page_size);
+    if (exec_rdonly) exec_set_prot(text_poke_start, text_poke_end, 1);
+}
+
+void kp_text_poke_end()
+{
+    if (exec_rdonly) exec_set_prot(text_poke_start, text_poke_end, 0);
+    flush_icache_all();
+    kp_unlock(&text_poke_lock);
+}
+
+void kp_text_poke(void *dst, const void *src, size_t len)
+{
+    kp_text_poke_begin(dst, len);
+    lib_memcpy(dst, src, len);
+    kp_text_poke_end();
+}
+
+void kp_exec_set_writable(void *addr, size_t len, int writable)
+{
+    if (!exec_rdonly) return;
+    kp_lock(&text_poke_lock);
+    exec_set_prot(align_floor(addr, page_size), align_ceil((uint64_t)addr + len, page_size), writable);
+    kp_unlock(&text_poke_lock);
+}
+
+static int exec_pool_setup(exec_pool_t *pool, uint64_t start, uint64_t size)
+{
+    uint64_t granules = size >> EXEC_GRANULE_SHIFT;
+    uint64_t map_size = align_ceil(granules, 64) / 8;
+    uint64_t *used = kp_malloc(map_size);
+    uint64_t *head = kp_malloc(map_size);
+    if (!used || !head) {
+        kp_free(used);
+        kp_free(head);
+        return -1;
+    }
+    lib_memset(used, 0, map_size);
+    lib_memset(head, 0, map_size);
+    pool->start = start;
+    pool->granules = granules;
+    pool->used_granules = 0;
+    pool->used = used;
+    pool->head = head;
+    return 0;
+}
+
+// pages from module_alloc are mapped like vmalloc, rw and PXN
+static void exec_pool_set_exec(uint64_t start, uint64_t end, int exec)
+{
+    if (!exec) {
+        pgtable_update_range(start, end, PTE_PXN | PTE_DBM, PTE_RDONLY);
+    } else if (exec_rdonly) {
+        pgtable_update_range(start, end, PTE_RDONLY, PTE_PXN | PTE_DBM);
+    } else {
+        pgtable_update_range(start, end, 0, PTE_PXN);
+    }
+    flush_tlb_kernel_range(start, end);
+}
+
+static void *exec_pages_alloc(uint64_t size)
+{
+    if (kfunc_module_alloc) return kfunc_module_alloc(size);
+    if (kfunc_execmem_alloc) return kfunc_execmem_alloc(0, size);
+    return 0;
+}
+
+static void exec_pages_free(void *mem)
+{
+    if (kfunc_module_memfree) {
+        kfunc_module_memfree(mem);
+    } else {
+        kfunc_vfree(mem);
+    }
+}
+
+static int kp_heap_grow_exec(size_t bytes)
+{
+    uint64_t size = align_ceil(bytes, page_size);
+    if (size < KP_HEAP_GROW_SIZE) size = KP_HEAP_GROW_SIZE;
+
+    void *mem = exec_pages_alloc(size);
+    if (!mem) return -ENOMEM;
+    exec_pool_t new;
+    if (exec_pool_setup(&new, (uint64_t)mem, size)) {
+        exec_pages_free(mem);
+        return -ENOMEM;
+    }
+    kp_lock(&text_poke_lock);
+    exec_pool_set_exec((uint64_t)mem, (uint64_t)mem + size, 1);
+    kp_unlock(&text_poke_lock);
+
+    uint64_t flags = irq_save();
+    kp_lock(&kp_rox_lock);
+    int slot = 1;
+    while (slot < exec_pool_num && exec_pools[slot].granules)
+        slot++;
+    int added = slot <= KP_HEAP_POOL_MAX;
+    if (added) {
+        uint64_t granules = new.granules;
+        new.granules = 0;
+        exec_pools[slot] = new;
+        __atomic_store_n(&exec_pools[slot].granules, granules, __ATOMIC_RELEASE);
+        if (slot == exec_pool_num) __atomic_store_n(&exec_pool_num, slot + 1, __ATOMIC_RELEASE);
+    }
+    kp_unlock(&kp_rox_lock);
+    irq_restore(flags);
+
+    if (!added) {
+        kp_lock(&text_poke_lock);
+        exec_pool_set_exec((uint64_t)mem, (uint64_t)mem + size, 0);
+        kp_unlock(&text_poke_lock);
+        kp_free(new.used);
+        kp_free(new.head);
+        exec_pages_free(mem);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+static int kp_heap_grow_rw(size_t bytes)
+{
+    uint64_t size = align_ceil(bytes + tlsf_pool_overhead() + tlsf_alloc_overhead(), page_size);
+    if (size < KP_HEAP_GROW_SIZE) size = KP_HEAP_GROW_SIZE;
+    if (rw_pool_num >= KP_HEAP_POOL_MAX) return -ENOMEM;
+
+    // vmalloc memory is already rw and PXN
+    void *mem = kfunc_vmalloc(size);
+    if (!mem) return -ENOMEM;
+
+    pool_t pool = 0;
+    uint64_t flags = irq_save();
+    kp_lock(&kp_rw_lock);
+    if (rw_pool_num < KP_HEAP_POOL_MAX) pool = tlsf_add_pool(kp_rw_mem, mem, size);
+    if (pool) {
+        rw_pools[rw_pool_num].mem = mem;
+        rw_pools[rw_pool_num].pool = pool;
+        rw_pools[rw_pool_num].size = size;
+        rw_pool_num++;
+        rw_total += size;
+    }
+    kp_unlock(&kp_rw_lock);
+    irq_restore(flags);
+
+    if (!pool) {
+        kfunc_vfree(mem);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+int kp_heap_grow(int exec, size_t bytes)
+{
+    if (!kfunc_vfree) return -ENOMEM;
+    // exec pools only come from the module area, in branch range of the kernel text, never from plain vmalloc
+    if (exec) return kfunc_module_alloc || kfunc_execmem_alloc ? kp_heap_grow_exec(bytes) : -ENOMEM;
+    return kfunc_vmalloc ? kp_heap_grow_rw(bytes) : -ENOMEM;
+}
+
+size_t kp_heap_free(int exec)
+{
+    size_t free = 0;
+    uint64_t flags = irq_save();
+    if (exec) {
+        kp_lock(&kp_rox_lock);
+        for (int i = 0; i < exec_pool_num; i++)
+            free += (exec_pools[i].granules - exec_pools[i].used_granules) << EXEC_GRANULE_SHIFT;
+        kp_unlock(&kp_rox_lock);
+    } else {
+        kp_lock(&kp_rw_lock);
+        free = rw_total - rw_used;
+        kp_unlock(&kp_rw_lock);
+    }
+    irq_restore(flags);
+    return free;
+}
+
+int kp_exec_contains(uint64_t addr)
+{
+    int num = __atomic_load_n(&exec_pool_num, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < num; i++) {
+        uint64_t granules = __atomic_load_n(&exec_pools[i].granules, __ATOMIC_ACQUIRE);
+        uint64_t start = exec_pools[i].start;
+        if (addr >= start && addr < start + (granules << EXEC_GRANULE_SHIFT)) return 1;
+    }
+    return 0;
+}
+
+static void rw_pool_walker(void *ptr, size_t size, int used, void *user)
+{
+    if (used) *(int *)user = 1;
+}
+
+void kp_heap_trim()
+{
+    void *free_mem[KP_HEAP_POOL_MAX];
+    exec_pool_t free_pools[KP_HEAP_POOL_MAX];
+    int free_num = 0;
+
+    // cached blocks would pin their pools
+    for (int i = 0; mag_slots && i < MAG_SLOTS; i++) {
+        uint64_t flags = irq_save();
+        kp_lock(&mag_slots[i].lock);
+        for (int c = 0; c < MAG_CLASSES; c++)
+            mag_drain(&mag_slots[i].mags[c], 0);
+        kp_unlock(&mag_slots[i].lock);
+        irq_restore(flags);
+    }
+
+    uint64_t flags = irq_save();
+    kp_lock(&kp_rw_lock);
+    for (int i = 0; i < rw_pool_num;) {
+        int used = 0;
+        tlsf_walk_pool(rw_pools[i].pool, rw_pool_walker, &used);
+        if (used) {
+            i++;
+            continue;
+        }
+        tlsf_remove_pool(kp_rw_mem, rw_pools[i].pool);
+        rw_total -= rw_pools[i].size;
+        free_mem[free_num++] = rw_pools[i].mem;
+        rw_pools[i] = rw_pools[--rw_pool_num];
+    }
+    kp_unlock(&kp_rw_lock);
+    irq_restore(flags);
+
+    for (int i = 0; i < free_num; i++)
+        kfunc_vfree(free_mem[i]);
+    free_num = 0;
+
+    flags = irq_save();
+    kp_lock(&kp_rox_lock);
+    for (int i = 1; i < exec_pool_num; i++) {
+        if (!exec_pools[i].granules || exec_pools[i].used_granules) continue;
+        free_pools[free_num++] = exec_pools[i];
+        // slots are not compacted, kp_exec_contains reads them without the lock
+        __atomic_store_n(&exec_pools[i].granules, 0, __ATOMIC_RELEASE);
+    }
+    kp_unlock(&kp_rox_lock);
+    irq_restore(flags);
+
+    for (int i = 0; i < free_num; i++) {
+        exec_pool_t *pool = &free_pools[i];
+        uint64_t end = pool->start + (pool->granules << EXEC_GRANULE_SHIFT);
+        kp_lock(&text_poke_lock);
+        exec_pool_set_exec(pool->start, end, 0);
+        kp_unlock(&text_poke_lock);
+        kp_free(pool->used);
+        kp_free(pool->head);
+        exec_pages_free((void *)pool->start);
+    }
+}
+
+static inline void heap_stat_free_block(struct kp_heap_stat *stat, uint64_t size)
+{
+    int bucket = 63 - __builtin_clzl(size | 1) - 4;
+    if (bucket < 0) bucket = 0;
+    if (bucket >= KP_HEAP_HIST_NUM) bucket = KP_HEAP_HIST_NUM - 1;
+    stat->free_hist[bucket]++;
+    stat->free_blocks++;
+    stat->free += size;
+    if (size > stat->largest_free) stat->largest_free = size;
+}
+
+static void heap_stat_walker(void *ptr, size_t size, int used, void *user)
+{
+    struct kp_heap_stat *stat = (struct kp_heap_stat *)user;
+    if (used) {
+        stat->used_blocks++;
+        stat->used += size;
+    } else {
+        heap_stat_free_block(stat, size);
+    }
+}
+
+// free runs of the bitmap count as free blocks
+static void exec_pool_stat(exec_pool_t *pool, struct kp_heap_stat *stat)
+{
+    uint64_t run = 0;
+    for (uint64_t i = 0; i <= pool->granules; i++) {
+        if (i < pool->granules && !exec_bit(pool->used, i)) {
+            run++;
+            continue;
+        }
+        if (run) heap_stat_free_block(stat, run << EXEC_GRANULE_SHIFT);
+        run = 0;
+        if (i < pool->granules && exec_bit(pool->head, i)) stat->used_blocks++;
+    }
+    stat->total += pool->granules << EXEC_GRANULE_SHIFT;
+    stat->used += pool->used_granules << EXEC_GRANULE_SHIFT;
+    stat->pools++;
+}
+
+void kp_heap_stat(int exec, struct kp_heap_stat *stat)
+{
+    lib_memset(stat, 0, sizeof(*stat));
+    uint64_t flags = irq_save();
+    if (exec) {
+        kp_lock(&kp_rox_lock);
+        for (int i = 0; i < exec_pool_num; i++) {
+            if (exec_pools[i].granules) exec_pool_stat(&exec_pools[i], stat);
+        }
+        kp_unlock(&kp_rox_lock);
+        irq_restore(flags);
+        return;
+    }
+
+    // racy, but the counts are only informational and taking every slot lock isn't worth it
+    for (int i = 0; mag_slots && i < MAG_SLOTS; i++) {
+        for (int c = 0; c < MAG_CLASSES; c++) {
+            stat->cached += (uint64_t)mag_slots[i].mags[c].count << (c + MAG_CLASS_MIN_SHIFT);
+        }
+    }
+    kp_lock(&kp_rw_lock);
+    tlsf_walk_pool(tlsf_get_pool(kp_rw_mem), heap_stat_walker, stat);
+    for (int i = 0; i < rw_pool_num; i++)
+        tlsf_walk_pool(rw_pools[i].pool, heap_stat_walker, stat);
+    stat->pools = rw_pool_num + 1;
+    stat->total = rw_total;
+    kp_unlock(&kp_rw_lock);
+    irq_restore(flags);
+}
+
+int kp_malloc_init(int rdonly_exec)
+{
+    rw_total = MEMORY_RW_SIZE - tlsf_size() - tlsf_pool_overhead();
+    exec_rdonly = rdonly_exec;
+
+    mag_slot_t *slots = tlsf_memalign(kp_rw_mem, 64, sizeof(mag_slot_t) * MAG_SLOTS);
+    if (!slots) return -1;
+    rw_used += tlsf_block_size(slots);
+    lib_memset(slots, 0, sizeof(mag_slot_t) * MAG_SLOTS);
+    mag_slots = slots;
+
+    if (exec_pool_setup(&exec_pools[0], _kp_rox_start, _kp_rox_end - _kp_rox_start)) return -1;
+    exec_pool_num = 1;
+
+    kfunc_vmalloc = (typeof(kfunc_vmalloc))kallsyms_lookup_name("vmalloc");
+    kfunc_vfree = (typeof(kfunc_vfree))kallsyms_lookup_name("vfree");
+    kfunc_module_alloc = (typeof(kfunc_module_alloc))kallsyms_lookup_name("module_alloc");
+    if (!kfunc_module_alloc) {
+        kfunc_execmem_alloc = (typeof(kfunc_execmem_alloc))kallsyms_lookup_name("execmem_alloc");
+    }
+    kfunc_module_memfree = (typeof(kfunc_module_memfree))kallsyms_lookup_name("module_memfree");
+    if (!kfunc_module_memfree) {
+        kfunc_module_memfree = (typeof(kfunc_module_memfree))kallsyms_lookup_name("execmem_free");
+    }
+    return 0;
+}
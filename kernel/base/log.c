@@ -1,12 +1,462 @@
 /* SPDX-License-Identifier: GPL-2.0-or-later */
-/* 
+/*
  * Copyright (C) 2023 bmax121. All Rights Reserved.
  */
 
-#include <stdint.h>
+#include <log.h>
+#include <stdarg.h>
+#include <common.h>
+#include <pgtable.h>
+#include <kallsyms.h>
+#include <kpmalloc.h>
+#include <symbol.h>
+#include <baselib.h>
+#include <barrier.h>
+#include <compiler.h>
+#include <asm/arch_timer.h>
 
-#define BOOT_LOG_SIZE 1024
+// Logs are kept as binary records, (timestamp, format, raw arguments), and only formatted when read.
+// Boot records are appended to chunks that are never overwritten, the first one is static so logging works
+// before the heap exists. Runtime records go to per-cpu rings that overwrite their oldest entries.
+// Writers take an index with one atomic add, claim the record by moving its sequence to odd with a cmpxchg and
+// publish it by storing the even sequence last, nothing takes a lock. A ring record whose previous writer hasn't
+// published yet is skipped rather than shared. Records that can't be stored are counted and reported on read.
 
-static char boot_log[BOOT_LOG_SIZE] = { 0 };
-static int boot_log_len = 0;
-static int boot_log_fin = 0;
+#define KLOG_BOOT_CHUNK_RECS 48
+#define KLOG_BOOT_CHUNK_MAX 32
+#define KLOG_RING_SLOTS 8
+#define KLOG_RING_RECS 64
+#define KLOG_PRE_FMT_LEN 256
+
+typedef struct
+{
+    uint64_t head;
+    klog_rec_t recs[KLOG_RING_RECS];
+} klog_ring_t;
+
+static klog_rec_t boot_chunk0[KLOG_BOOT_CHUNK_RECS] = { 0 };
+static klog_rec_t *boot_chunks[KLOG_BOOT_CHUNK_MAX] = { boot_chunk0 };
+static uint64_t boot_num = 0;
+static uint64_t boot_dropped = 0;
+
+static klog_ring_t *klog_rings = 0;
+static uint64_t ring_dropped = 0;
+
+// klog_forget waits for reads in progress, they may be formatting with a format it is about to clear
+static int klog_readers = 0;
+
+static int (*klog_vsnprintf)(char *buf, size_t size, const char *fmt, va_list args) = 0;
+static int (*klog_snprintf)(char *buf, size_t size, const char *fmt, ...) = 0;
+static uint32_t klog_freq = 0;
+
+static inline int klog_cpu()
+{
+    uint64_t mpidr;
+    asm volatile("mrs %0, mpidr_el1" : "=r"(mpidr));
+    return ((mpidr & 0xff) + (((mpidr >> 8) & 0xff) << 2) + (((mpidr >> 16) & 0xff) << 4)) % KLOG_RING_SLOTS;
+}
+
+// strings that outlive every record, anything else passed to %s is copied
+static inline int klog_static_str(uint64_t addr)
+{
+    if (addr >= (uint64_t)_kp_start && addr < (uint64_t)_kp_end) return 1;
+    return addr >= kernel_va && addr < kernel_va + kernel_size;
+}
+
+// kpm formats are valid until klog_forget clears them on unload
+static inline int klog_valid_fmt(uint64_t addr)
+{
+    return klog_static_str(addr) || kp_exec_contains(addr);
+}
+
+static inline int klog_isalnum(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// %p followed by an extension that reads through the pointer, the object may be gone by the time it is read,
+// raw values and symbol lookups only use the address
+static inline int klog_ptr_deref(const char *ext)
+{
+    return klog_isalnum(*ext) && !lib_strchr("xKSsBFf", *ext);
+}
+
+// format one %p<ext> conversion now, from its '%' at spec through the extension after conv, stars holds the
+// nstars '*' values of the spec, returns the offset of the text in str
+static uint64_t klog_pre_format(klog_rec_t *rec, const char *spec, const char *conv, uint64_t *stars, int nstars,
+                                uint64_t arg, int *str_off)
+{
+    char sub[24];
+    int len = 0;
+    for (const char *p = spec; len < sizeof(sub) - 1 && (p <= conv || klog_isalnum(*p)); p++)
+        sub[len++] = *p;
+    sub[len] = '\0';
+    int room = sizeof(rec->str) - *str_off;
+    if (room <= 0) return sizeof(rec->str) - 1;
+    rec->str[*str_off] = '\0';
+    if (klog_snprintf) {
+        if (nstars == 0) klog_snprintf(rec->str + *str_off, room, sub, arg);
+        if (nstars == 1) klog_snprintf(rec->str + *str_off, room, sub, (int)stars[0], arg);
+        if (nstars == 2) klog_snprintf(rec->str + *str_off, room, sub, (int)stars[0], (int)stars[1], arg);
+    }
+    uint64_t off = *str_off;
+    *str_off += lib_strlen(rec->str + *str_off) + 1;
+    return off;
+}
+
+static void klog_fill(klog_rec_t *rec, int level, const char *fmt, va_list va)
+{
+    rec->ts = __arch_counter_get_cntvct();
+    rec->fmt = fmt;
+    rec->level = level;
+    rec->cpu = klog_cpu();
+    rec->str_mask = 0;
+    rec->pre_mask = 0;
+    int nargs = 0;
+    int str_off = 0;
+    for (const char *p = fmt; *p && nargs < KLOG_ARGS_MAX; p++) {
+        if (*p != '%') continue;
+        const char *spec = p++;
+        if (*p == '%') continue;
+        int spec_args = nargs;
+        while (*p && lib_strchr("-+ #0123456789.*hlLzjt", *p)) {
+            if (*p == '*' && nargs < KLOG_ARGS_MAX) rec->args[nargs++] = va_arg(va, int);
+            p++;
+        }
+        if (!*p || nargs >= KLOG_ARGS_MAX) break;
+        uint64_t arg = va_arg(va, uint64_t);
+        if (*p == 'p' && klog_ptr_deref(p + 1)) {
+            // the '*' values are used up here, the read prints the text with a plain %s
+            arg = klog_pre_format(rec, spec, p, &rec->args[spec_args], nargs - spec_args, arg, &str_off);
+            nargs = spec_args;
+            rec->str_mask |= 1 << nargs;
+            rec->pre_mask |= 1 << nargs;
+        } else if (*p == 's' && arg && !klog_static_str(arg)) {
+            int room = sizeof(rec->str) - str_off;
+            if (room > 0) {
+                lib_strlcpy(rec->str + str_off, (const char *)arg, room);
+                arg = str_off;
+                str_off += lib_strlen(rec->str + str_off) + 1;
+            } else {
+                arg = sizeof(rec->str) - 1;
+            }
+            rec->str_mask |= 1 << nargs;
+        }
+        rec->args[nargs++] = arg;
+    }
+    rec->nargs = nargs;
+}
+
+static inline void klog_publish(klog_rec_t *rec, uint64_t idx)
+{
+    smp_store_release(&rec->seq, idx * 2 + 2);
+}
+
+static klog_rec_t *boot_rec(uint64_t idx, int alloc)
+{
+    uint64_t chunk = idx / KLOG_BOOT_CHUNK_RECS;
+    if (chunk >= KLOG_BOOT_CHUNK_MAX) return 0;
+    klog_rec_t *recs = __atomic_load_n(&boot_chunks[chunk], __ATOMIC_ACQUIRE);
+    if (!recs && alloc && kp_rw_mem) {
+        klog_rec_t *new = kp_malloc(sizeof(klog_rec_t) * KLOG_BOOT_CHUNK_RECS);
+        if (!new) return 0;
+        lib_memset(new, 0, sizeof(klog_rec_t) * KLOG_BOOT_CHUNK_RECS);
+        klog_rec_t *expected = 0;
+        if (__atomic_compare_exchange_n(&boot_chunks[chunk], &expected, new, 0, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            recs = new;
+        } else {
+            kp_free(new);
+            recs = expected;
+        }
+    }
+    return recs ? &recs[idx % KLOG_BOOT_CHUNK_RECS] : 0;
+}
+
+static void klog_boot_record(int level, const char *fmt, va_list va)
+{
+    uint64_t idx = __atomic_fetch_add(&boot_num, 1, __ATOMIC_RELAXED);
+    klog_rec_t *rec = boot_rec(idx, 1);
+    if (!rec) {
+        __atomic_add_fetch(&boot_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    klog_fill(rec, level, fmt, va);
+    klog_publish(rec, idx);
+}
+
+// claim the ring record for idx, only over a published record of an earlier lap
+static int klog_ring_claim(klog_rec_t *rec, uint64_t idx)
+{
+    uint64_t seq = __atomic_load_n(&rec->seq, __ATOMIC_RELAXED);
+    do {
+        if ((seq & 1) || seq >= idx * 2 + 1) return 0;
+    } while (!__atomic_compare_exchange_n(&rec->seq, &seq, idx * 2 + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    smp_wmb();
+    return 1;
+}
+
+static void klog_record(int level, const char *fmt, va_list va)
+{
+    klog_ring_t *rings = __atomic_load_n(&klog_rings, __ATOMIC_ACQUIRE);
+    if (unlikely(!rings)) {
+        klog_boot_record(level, fmt, va);
+        return;
+    }
+    klog_ring_t *ring = &rings[klog_cpu()];
+    uint64_t idx = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    klog_rec_t *rec = &ring->recs[idx % KLOG_RING_RECS];
+    if (!klog_ring_claim(rec, idx)) {
+        __atomic_add_fetch(&ring_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    klog_fill(rec, level, fmt, va);
+    klog_publish(rec, idx);
+}
+
+void kp_log(int level, const char *fmt, ...)
+{
+    va_list va;
+    va_start(va, fmt);
+    klog_record(level, fmt, va);
+    va_end(va);
+}
+KP_EXPORT_SYMBOL(kp_log);
+
+void kp_log_print(int level, const char *fmt, ...)
+{
+    static const char levels[] = "VDIWE";
+    va_list va, va2;
+    va_start(va, fmt);
+    va_copy(va2, va);
+    klog_record(level, fmt, va);
+    if (klog_vsnprintf && printk) {
+        char buf[256];
+        klog_vsnprintf(buf, sizeof(buf), fmt, va2);
+        printk("[-] KP %c %s", level < sizeof(levels) - 1 ? levels[level] : '?', buf);
+    }
+    va_end(va2);
+    va_end(va);
+}
+KP_EXPORT_SYMBOL(kp_log_print);
+
+void log_boot(const char *fmt, ...)
+{
+    va_list va;
+    va_start(va, fmt);
+    klog_boot_record(KLOG_LEVEL_I, fmt, va);
+    va_end(va);
+
+    if (!klog_vsnprintf) return;
+    char buf[256];
+    va_start(va, fmt);
+    klog_vsnprintf(buf, sizeof(buf), fmt, va);
+    va_end(va);
+    printk("KP %s", buf);
+}
+
+// copy out a published record, 0 if it is not published as idx or was rewritten while copying
+static int klog_copy(klog_rec_t *rec, uint64_t idx, klog_rec_t *out)
+{
+    uint64_t seq = smp_load_acquire(&rec->seq);
+    if (seq != idx * 2 + 2) return 0;
+    lib_memcpy(out, rec, sizeof(*out));
+    smp_rmb();
+    return __atomic_load_n(&rec->seq, __ATOMIC_RELAXED) == seq;
+}
+
+// the record's format with every preformatted %p<ext> turned into %s, parsed the same way as klog_fill
+static void klog_pre_fmt(klog_rec_t *rec, char *out, int size)
+{
+    int o = 0, nargs = 0;
+    const char *p = rec->fmt;
+    while (*p && o < size - 3) {
+        if (*p != '%') {
+            out[o++] = *p++;
+            continue;
+        }
+        const char *spec = p++;
+        if (*p == '%') {
+            out[o++] = '%';
+            out[o++] = *p++;
+            continue;
+        }
+        int spec_args = nargs;
+        while (*p && lib_strchr("-+ #0123456789.*hlLzjt", *p)) {
+            if (*p == '*') nargs++;
+            p++;
+        }
+        if (*p == 'p' && spec_args < KLOG_ARGS_MAX && (rec->pre_mask & (1 << spec_args))) {
+            nargs = spec_args;
+            out[o++] = '%';
+            out[o++] = 's';
+            for (p++; klog_isalnum(*p); p++)
+                ;
+        } else {
+            if (*p) p++;
+            while (spec < p && o < size - 1)
+                out[o++] = *spec++;
+        }
+        nargs++;
+    }
+    out[o] = '\0';
+}
+
+static int klog_format(klog_rec_t *rec, char *buf, int size)
+{
+    static const char levels[] = "VDIWE";
+    uint64_t args[KLOG_ARGS_MAX] = { 0 };
+    uint64_t us = klog_freq ? (rec->ts % klog_freq) * 1000000 / klog_freq : 0;
+    uint64_t sec = klog_freq ? rec->ts / klog_freq : 0;
+    char level = rec->level < sizeof(levels) - 1 ? levels[rec->level] : '?';
+
+    // the kpm it came from has been unloaded
+    if (!rec->fmt || !klog_valid_fmt((uint64_t)rec->fmt)) {
+        return klog_snprintf(buf, size, "[%5llu.%06llu] %c <format of unloaded module>\n", sec, us, level);
+    }
+    for (int i = 0; i < rec->nargs; i++) {
+        args[i] = rec->args[i];
+        if (rec->str_mask & (1 << i)) args[i] = (uint64_t)(rec->str + args[i]);
+    }
+    const char *fmt = rec->fmt;
+    char pre_fmt[KLOG_PRE_FMT_LEN];
+    if (rec->pre_mask) {
+        klog_pre_fmt(rec, pre_fmt, sizeof(pre_fmt));
+        fmt = pre_fmt;
+    }
+    int len = klog_snprintf(buf, size, "[%5llu.%06llu] %c ", sec, us, level);
+    if (len >= size) return size - 1;
+    len += klog_snprintf(buf + len, size - len, fmt, args[0], args[1], args[2], args[3], args[4], args[5],
+                         args[6], args[7]);
+    return len >= size ? size - 1 : len;
+}
+
+// append one line, a line longer than the whole buffer is cut rather than never returned
+static int klog_append(const char *line, int len, char *buf, int *off, int size)
+{
+    if (*off + len >= size) {
+        if (*off) return -1;
+        len = size - 1;
+    }
+    lib_memcpy(buf + *off, line, len);
+    *off += len;
+    buf[*off] = '\0';
+    return 0;
+}
+
+static int klog_emit(klog_rec_t *rec, char *buf, int *off, int size)
+{
+    char line[LOG_LINE_MAX];
+    int len = klog_format(rec, line, sizeof(line));
+    return klog_append(line, len, buf, off, size);
+}
+
+static int klog_emit_dropped(uint64_t *dropped, const char *what, char *buf, int *off, int size)
+{
+    uint64_t num = __atomic_load_n(dropped, __ATOMIC_RELAXED);
+    if (!num) return 0;
+    char line[64];
+    int len = klog_snprintf(line, sizeof(line), "<%llu %s records dropped>\n", num, what);
+    if (len >= sizeof(line)) len = sizeof(line) - 1;
+    return klog_append(line, len, buf, off, size);
+}
+
+static int klog_read_locked(int which, uint64_t *pos, char *buf, int size)
+{
+    int off = 0;
+    klog_rec_t rec;
+    buf[0] = '\0';
+
+    if (which == KLOG_BOOT) {
+        if (!*pos) klog_emit_dropped(&boot_dropped, "boot", buf, &off, size);
+        uint64_t end = __atomic_load_n(&boot_num, __ATOMIC_ACQUIRE);
+        for (; *pos < end; (*pos)++) {
+            klog_rec_t *src = boot_rec(*pos, 0);
+            if (!src || !klog_copy(src, *pos, &rec)) continue;
+            if (klog_emit(&rec, buf, &off, size)) break;
+        }
+        return off;
+    }
+
+    klog_ring_t *rings = __atomic_load_n(&klog_rings, __ATOMIC_ACQUIRE);
+    if (!rings) return 0;
+    klog_emit_dropped(&ring_dropped, "runtime", buf, &off, size);
+    // merge the rings by timestamp, *pos is unused, each read returns what the rings hold now
+    uint64_t next[KLOG_RING_SLOTS], end[KLOG_RING_SLOTS];
+    for (int i = 0; i < KLOG_RING_SLOTS; i++) {
+        end[i] = __atomic_load_n(&rings[i].head, __ATOMIC_ACQUIRE);
+        next[i] = end[i] > KLOG_RING_RECS ? end[i] - KLOG_RING_RECS : 0;
+    }
+    for (;;) {
+        int min = -1;
+        klog_rec_t min_rec;
+        for (int i = 0; i < KLOG_RING_SLOTS; i++) {
+            while (next[i] < end[i] && !klog_copy(&rings[i].recs[next[i] % KLOG_RING_RECS], next[i], &rec))
+                next[i]++;
+            if (next[i] >= end[i]) continue;
+            if (min < 0 || rec.ts < min_rec.ts) {
+                min = i;
+                lib_memcpy(&min_rec, &rec, sizeof(rec));
+            }
+        }
+        if (min < 0) break;
+        if (klog_emit(&min_rec, buf, &off, size)) break;
+        next[min]++;
+    }
+    return off;
+}
+
+int klog_read(int which, uint64_t *pos, char *buf, int size)
+{
+    if (size <= 0) return 0;
+    buf[0] = '\0';
+    if (!klog_snprintf || size == 1) return 0;
+    __atomic_add_fetch(&klog_readers, 1, __ATOMIC_SEQ_CST);
+    int rc = klog_read_locked(which, pos, buf, size);
+    __atomic_sub_fetch(&klog_readers, 1, __ATOMIC_RELEASE);
+    return rc;
+}
+
+static void klog_forget_rec(klog_rec_t *rec, uint64_t start, uint64_t end)
+{
+    const char *fmt = __atomic_load_n(&rec->fmt, __ATOMIC_RELAXED);
+    if ((uint64_t)fmt < start || (uint64_t)fmt >= end) return;
+    // a writer may be reusing the record, only clear the format we saw
+    __atomic_compare_exchange_n(&rec->fmt, &fmt, 0, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+void klog_forget(uint64_t start, uint64_t end)
+{
+    uint64_t num = __atomic_load_n(&boot_num, __ATOMIC_ACQUIRE);
+    for (uint64_t i = 0; i < num; i++) {
+        klog_rec_t *rec = boot_rec(i, 0);
+        if (rec) klog_forget_rec(rec, start, end);
+    }
+    klog_ring_t *rings = __atomic_load_n(&klog_rings, __ATOMIC_ACQUIRE);
+    for (int i = 0; rings && i < KLOG_RING_SLOTS; i++) {
+        for (int j = 0; j < KLOG_RING_RECS; j++) {
+            klog_forget_rec(&rings[i].recs[j], start, end);
+        }
+    }
+    // a read that copied a record before it was cleared may still be formatting with its format
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&klog_readers, __ATOMIC_ACQUIRE)) {
+        asm volatile("yield");
+    }
+}
+
+int klog_ring_init()
+{
+    klog_ring_t *rings = kp_malloc(sizeof(klog_ring_t) * KLOG_RING_SLOTS);
+    if (!rings) return -1;
+    lib_memset(rings, 0, sizeof(klog_ring_t) * KLOG_RING_SLOTS);
+    __atomic_store_n(&klog_rings, rings, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void klog_init()
+{
+    klog_vsnprintf = (typeof(klog_vsnprintf))kallsyms_lookup_name("vsnprintf");
+    klog_snprintf = (typeof(klog_snprintf))kallsyms_lookup_name("snprintf");
+    klog_freq = arch_timer_get_cntfrq();
+}
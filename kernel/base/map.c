@@ -110,7 +110,9 @@ static map_data_t *mem_proc()
 }
 
 // todo: 52-bits pa
-static uint64_t __noinline get_or_create_pte(map_data_t *data, uint64_t va, uint64_t pa, uint64_t attr_indx)
+// map_lv 3 maps a page, a lower level maps a block there, which only goes into an empty slot, 0 if it is not
+static uint64_t __noinline get_or_create_pte(map_data_t *data, uint64_t va, uint64_t pa, uint64_t attr_indx,
+                                             uint64_t map_lv)
 {
     memblock_phys_alloc_try_nid_f memblock_phys_alloc_try_nid =
         (memblock_phys_alloc_try_nid_f)data->map_symbol.memblock_phys_alloc_relo;
@@ -142,6 +144,12 @@ static uint64_t __noinline get_or_create_pte(map_data_t *data, uint64_t va, uint
 
         uint64_t pxd_desc = *((uint64_t *)pxd_entry_va);
 
+        if (lv == map_lv && lv != 3) {
+            if (pxd_desc & 0b1) return 0;
+            *((uint64_t *)pxd_entry_va) = pa | (attr_prot & ~0b10ul);
+            return pxd_entry_va;
+        }
+
         if ((pxd_desc & 0b11) == 0b11) { // table
             pxd_pa = pxd_desc & (((1ul << (48 - page_shift)) - 1) << page_shift);
         } else if ((pxd_desc & 0b11) == 0b01) { // block
@@ -190,13 +198,19 @@ void __noinline _paging_init()
     uint64_t old_start_pa = data->start_offset + data->kernel_pa;
     uint64_t reserve_size = data->start_img_size + data->extra_size;
     uint64_t align_extra_size = (data->extra_size + page_size - 1) & ~(page_size - 1);
-    uint64_t all_size = data->start_size + align_extra_size + data->alloc_size;
+
+    // image, extra, rox, hook, rw, same layout as prot_myself
+    uint64_t block_size = KP_POOL_BLOCK_SIZE(data->page_shift);
+    uint64_t rox_off = data->start_size + align_extra_size;
+    uint64_t hook_off = (rox_off + MEMORY_ROX_SIZE + block_size - 1) & ~(block_size - 1);
+    uint64_t rw_off = hook_off + ((HOOK_ALLOC_SIZE + block_size - 1) & ~(block_size - 1));
+    uint64_t all_size = rw_off + MEMORY_RW_SIZE;
 
     // reserve old start
     ((memblock_reserve_f)data->map_symbol.memblock_reserve_relo)(old_start_pa, reserve_size);
     // alloc
     uint64_t start_pa =
-        ((memblock_phys_alloc_try_nid_f)data->map_symbol.memblock_phys_alloc_relo)(all_size, page_size, 0);
+        ((memblock_phys_alloc_try_nid_f)data->map_symbol.memblock_phys_alloc_relo)(all_size, block_size, 0);
     // mark all size nomap
     if (data->map_symbol.memblock_mark_nomap_relo)
         ((memblock_mark_nomap_f)(data->map_symbol.memblock_mark_nomap_relo))(start_pa, all_size);
@@ -209,7 +223,7 @@ void __noinline _paging_init()
     // can't write data below
 
     // AttrIndx[2:0] encoding
-    uint64_t ktext_pte = get_or_create_pte(data, data->paging_init_relo, 0, 0);
+    uint64_t ktext_pte = get_or_create_pte(data, data->paging_init_relo, 0, 0, 3);
     uint64_t attrs = *(uint64_t *)ktext_pte;
     uint64_t attr_indx = attrs & 0b11100;
 
@@ -226,9 +240,23 @@ void __noinline _paging_init()
     // uint64_t vm_gurad_enough = page_size << 3;
     uint64_t start_va = start_pa + data->kimage_voffset;
 
-    for (uint64_t off = 0; off < all_size; off += page_size) {
-        uint64_t entry = get_or_create_pte(data, start_va + off, start_pa + off, attr_indx);
+    // hook and rw pools keep one set of attributes each, a block never spans both
+    uint64_t block_lv = 3 - (__builtin_ctzl(block_size) - data->page_shift) / (data->page_shift - 3);
+    for (uint64_t off = 0; off < all_size;) {
+        uint64_t step = page_size;
+        uint64_t entry = 0;
+        if (block_size > page_size && off >= hook_off && off + block_size <= all_size &&
+            (off + block_size <= rw_off || off >= rw_off) && !((start_va + off) & (block_size - 1)) &&
+            !((start_pa + off) & (block_size - 1))) {
+            entry = get_or_create_pte(data, start_va + off, start_pa + off, attr_indx, block_lv);
+            step = block_size;
+        }
+        if (!entry) {
+            entry = get_or_create_pte(data, start_va + off, start_pa + off, attr_indx, 3);
+            step = page_size;
+        }
         *(uint64_t *)entry = (*(uint64_t *)entry | 0x8000000000000) & 0xFFDFFFFFFFFFFF7F;
+        off += step;
     }
     flush_tlb_all();
 
@@ -76,6 +76,27 @@ struct patch_symbol *get_preset_patch_sym()
     return patch_symbol;
 }
 
+int get_preset_additional(const char *key, char *value, int len)
+{
+    // [len key=value] records packed without terminator, a zero len ends the list
+    const char *pos = start_preset.additional;
+    const char *end = pos + ADDITIONAL_LEN;
+    int key_len = lib_strlen(key);
+    while (pos < end && *pos) {
+        int kv_len = *(uint8_t *)pos++;
+        if (pos + kv_len > end) break;
+        if (kv_len > key_len && pos[key_len] == '=' && !lib_strncmp(pos, key, key_len)) {
+            int value_len = kv_len - key_len - 1;
+            if (value_len >= len) value_len = len - 1;
+            lib_memcpy(value, pos + key_len + 1, value_len);
+            value[value_len] = '\0';
+            return value_len;
+        }
+        pos += kv_len;
+    }
+    return -1;
+}
+
 int on_each_extra_item(int (*callback)(const patch_extra_item_t *extra, const char *arg, const void *con, void *udata),
                        void *udata)
 {
@@ -6,6 +6,9 @@
 #include "setup.h"
 #include "../version"
 
+extern char _kp_ksym_names_offset[];
+extern char _kp_ksym_names_size[];
+
 setup_header_t header __section(.setup.header) = { .magic = KP_MAGIC,
                                                    .kp_version.major = MAJOR,
                                                    .kp_version.minor = MINOR,
@@ -18,7 +21,9 @@ setup_header_t header __section(.setup.header) = { .magic = KP_MAGIC,
                                                                    | CONFIG_DEBUG
 #endif
                                                    ,
-                                                   .compile_time = __TIME__ " " __DATE__ };
+                                                   .compile_time = __TIME__ " " __DATE__,
+                                                   .ksym_names_offset = (int64_t)_kp_ksym_names_offset,
+                                                   .ksym_names_size = (int64_t)_kp_ksym_names_size };
 
 setup_preset_t setup_preset __section(.setup.preset) = { 0 };
 
@@ -14,11 +14,13 @@
 #include <patch/patch.h>
 #include <barrier.h>
 #include <stdarg.h>
+#include <bootprof.h>
 
 #include "../banner"
 #include "start.h"
 #include "hook.h"
 #include "tlsf.h"
+#include "kpmalloc.h"
 #include "hmem.h"
 
 #define bits(n, high, low) (((n) << (63u - (high))) >> (63u - (high) + (low)))
@@ -41,8 +43,6 @@ KP_EXPORT_SYMBOL(lookup_symbol_attrs);
 void (*printk)(const char *fmt, ...) = 0;
 KP_EXPORT_SYMBOL(printk);
 
-int (*vsprintf)(char *buf, const char *fmt, va_list args) = 0;
-
 static struct vm_struct
 {
     struct vm_struct *next;
@@ -93,13 +93,6 @@ uint64_t pgd_va;
 
 uint64_t kernel_stext_va = 0;
 
-tlsf_t kp_rw_mem = 0;
-tlsf_t kp_rox_mem = 0;
-
-#define BOOT_LOG_SIZE 0x2000
-static char boot_log[BOOT_LOG_SIZE] = { 0 };
-static int boot_log_offset = 0;
-
 static inline bool hw_dirty()
 {
     uint64_t tcr_el1;
@@ -107,22 +100,8 @@ static inline bool hw_dirty()
     return tcr_el1 & 0x10000000000;
 }
 
-const char *get_boot_log()
-{
-    return boot_log;
-}
-
-void log_boot(const char *fmt, ...)
-{
-    va_list va;
-    va_start(va, fmt);
-    int ret = vsprintf(boot_log + boot_log_offset, fmt, va);
-    va_end(va);
-    printk("KP %s", boot_log + boot_log_offset);
-    boot_log_offset += ret;
-}
-
-uint64_t *pgtable_entry(uint64_t pgd, uint64_t va)
+// entry mapping va and its level, 3 for a page, lower for a block or where the walk hit an invalid entry
+static uint64_t *pgtable_walk(uint64_t pgd, uint64_t va, int64_t *level)
 {
     uint64_t pxd_bits = page_shift - 3;
     uint64_t pxd_ptrs = 1u << pxd_bits;
@@ -137,6 +116,7 @@ uint64_t *pgtable_entry(uint64_t pgd, uint64_t va)
     // ================
     __flush_dcache_area((void *)pxd_va, page_size);
 
+    *level = 3;
     for (int64_t lv = 4 - page_level; lv < 4; lv++) {
         uint64_t pxd_shift = (page_shift - 3) * (4 - lv) + 3;
         uint64_t pxd_index = (va >> pxd_shift) & (pxd_ptrs - 1);
@@ -151,6 +131,7 @@ uint64_t *pgtable_entry(uint64_t pgd, uint64_t va)
             pxd_pa = pxd_desc & (((1ul << (48 - block_bits)) - 1) << block_bits);
             block_lv = lv;
         } else { // invalid
+            *level = lv;
             return 0;
         }
         //
@@ -159,6 +140,7 @@ uint64_t *pgtable_entry(uint64_t pgd, uint64_t va)
             break;
         }
     }
+    if (block_lv) *level = block_lv;
 #if 0
     uint64_t left_bit = page_shift + (block_lv ? (3 - block_lv) * pxd_bits : 0);
     uint64_t tpa = pxd_pa + (va & ((1u << left_bit) - 1));
@@ -170,115 +152,115 @@ uint64_t *pgtable_entry(uint64_t pgd, uint64_t va)
 #endif
     return (uint64_t *)pxd_entry_va;
 }
+
+uint64_t *pgtable_entry(uint64_t pgd, uint64_t va)
+{
+    int64_t level;
+    return pgtable_walk(pgd, va, &level);
+}
 KP_EXPORT_SYMBOL(pgtable_entry);
 
+void pgtable_update_range(uint64_t start, uint64_t end, uint64_t set, uint64_t clear)
+{
+    uint64_t pxd_bits = page_shift - 3;
+    uint64_t va = align_floor(start, page_size);
+    while (va < end) {
+        int64_t level;
+        uint64_t *entry = pgtable_walk(pgd_va, va, &level);
+        uint64_t entry_size = 1ul << ((3 - level) * pxd_bits + page_shift);
+        if (!entry) {
+            va = align_floor(va, entry_size) + entry_size;
+            continue;
+        }
+        // a block is updated as a whole, like a walk per page would have
+        if (level < 3) {
+            *entry = (*entry | set) & ~clear;
+            va = align_floor(va, entry_size) + entry_size;
+            continue;
+        }
+        // the rest of this last level table
+        uint64_t table_end = align_floor(va, page_size << pxd_bits) + (page_size << pxd_bits);
+        if (table_end > end || !table_end) table_end = end;
+        for (; va < table_end; va += page_size, entry++) {
+            *entry = (*entry | set) & ~clear;
+        }
+    }
+}
+KP_EXPORT_SYMBOL(pgtable_update_range);
+
 static void prot_myself()
 {
     uint64_t *kpte = pgtable_entry_kernel(kernel_stext_va);
     log_boot("Kernel stext prot: %llx\n", *kpte);
 
+    // image, extra, rox, hook, rw, the same layout _paging_init mapped
+    uint64_t block_size = KP_POOL_BLOCK_SIZE(page_shift);
+    uint64_t rox_off = (uint64_t)_kp_end - (uint64_t)_kp_start + align_ceil(start_preset.extra_size, page_size);
+    uint64_t hook_off = align_ceil(rox_off + MEMORY_ROX_SIZE, block_size);
+    uint64_t rw_off = hook_off + align_ceil(HOOK_ALLOC_SIZE, block_size);
+
     _kp_region_start = (uint64_t)_kp_text_start;
-    _kp_region_end = (uint64_t)_kp_end + HOOK_ALLOC_SIZE + MEMORY_ROX_SIZE + MEMORY_RW_SIZE;
+    _kp_region_end = (uint64_t)_kp_start + rw_off + MEMORY_RW_SIZE;
     log_boot("Region: %llx, %llx\n", _kp_region_start, _kp_region_end);
 
     uint64_t *kppte = pgtable_entry_kernel(_kp_region_start);
     log_boot("KernelPatch start prot: %llx\n", *kppte);
 
+    // Attributes of every range are updated first with one walk per last level table, then the tlb is flushed
+    // once for the whole region, nothing in the region is written before that.
+    uint64_t exec_set = PTE_SHARED, exec_clear = PTE_PXN;
+    uint64_t rw_set = PTE_DBM | PTE_SHARED, rw_clear = PTE_RDONLY;
+    if (has_vmalloc_area()) {
+        exec_set |= PTE_RDONLY;
+        exec_clear |= PTE_DBM;
+        rw_set |= PTE_PXN;
+    }
+
     // text, rodata
     uint64_t text_start = (uint64_t)_kp_text_start;
     uint64_t text_end = (uint64_t)_kp_text_end;
     uint64_t align_text_end = align_ceil(text_end, page_size);
     log_boot("Text: %llx, %llx\n", text_start, text_end);
-
-    for (uint64_t i = text_start; i < align_text_end; i += page_size) {
-        uint64_t *pte = pgtable_entry_kernel(i);
-        *pte |= PTE_SHARED;
-        *pte = *pte & ~PTE_PXN;
-        if (has_vmalloc_area()) {
-            *pte |= PTE_RDONLY;
-            *pte &= ~PTE_DBM;
-        }
-    }
-    flush_tlb_kernel_range(text_start, align_text_end);
+    pgtable_update_range(text_start, align_text_end, exec_set, exec_clear);
 
     // data, bss
     uint64_t data_start = (uint64_t)_kp_data_start;
     uint64_t data_end = (uint64_t)_kp_data_end;
     uint64_t align_data_end = align_ceil(data_end, page_size);
     log_boot("Data: %llx, %llx\n", data_start, data_end);
-
-    for (uint64_t i = data_start; i < align_data_end; i += page_size) {
-        uint64_t *pte = pgtable_entry_kernel(i);
-        *pte = (*pte | PTE_DBM | PTE_SHARED) & ~PTE_RDONLY;
-        if (has_vmalloc_area()) {
-            *pte |= PTE_PXN;
-        }
-    }
-    flush_tlb_kernel_range(data_start, align_data_end);
+    pgtable_update_range(data_start, align_data_end, rw_set, rw_clear);
 
     // extra data
     _kp_extra_start = (uint64_t)_kp_end;
     _kp_extra_end = _kp_extra_start + start_preset.extra_size;
     uint64_t align_extra_end = align_ceil(_kp_extra_end, page_size);
     log_boot("Extra: %llx, %llx\n", _kp_extra_start, _kp_extra_end);
+    pgtable_update_range(_kp_extra_start, align_extra_end, rw_set, rw_clear);
 
-    for (uint64_t i = _kp_extra_start; i < align_extra_end; i += page_size) {
-        uint64_t *pte = pgtable_entry_kernel(i);
-        *pte = (*pte | PTE_DBM | PTE_SHARED) & ~PTE_RDONLY;
-        if (has_vmalloc_area()) {
-            *pte |= PTE_PXN;
-        }
-    }
-    flush_tlb_kernel_range(_kp_extra_start, align_extra_end);
+    // rox memory, up to where the block aligned pools start
+    _kp_rox_start = (uint64_t)align_extra_end;
+    _kp_rox_end = (uint64_t)_kp_start + hook_off;
+    log_boot("ROX: %llx, %llx\n", _kp_rox_start, _kp_rox_end);
+    pgtable_update_range(_kp_rox_start, _kp_rox_end, exec_set, exec_clear);
 
     // rwx for hook
-    _kp_hook_start = (uint64_t)align_extra_end;
-    _kp_hook_end = _kp_hook_start + HOOK_ALLOC_SIZE;
+    _kp_hook_start = _kp_rox_end;
+    _kp_hook_end = (uint64_t)_kp_start + rw_off;
     log_boot("Hook: %llx, %llx\n", _kp_hook_start, _kp_hook_end);
-
-    for (uint64_t i = _kp_hook_start; i < _kp_hook_end; i += page_size) {
-        uint64_t *pte = pgtable_entry_kernel(i);
-        *pte = (*pte & ~PTE_PXN & ~PTE_RDONLY) | PTE_DBM | PTE_SHARED;
-    }
-    flush_tlb_kernel_range(_kp_hook_start, _kp_hook_end);
-    hook_mem_add(_kp_hook_start, HOOK_ALLOC_SIZE);
+    pgtable_update_range(_kp_hook_start, _kp_hook_end, PTE_DBM | PTE_SHARED, PTE_PXN | PTE_RDONLY);
 
     // rw memory
     _kp_rw_start = _kp_hook_end;
     _kp_rw_end = _kp_rw_start + MEMORY_RW_SIZE;
     log_boot("RW: %llx, %llx\n", _kp_rw_start, _kp_rw_end);
+    pgtable_update_range(_kp_rw_start, _kp_rw_end, rw_set, rw_clear);
 
-    for (uint64_t i = _kp_rw_start; i < _kp_rw_end; i += page_size) {
-        uint64_t *pte = pgtable_entry_kernel(i);
-        *pte = (*pte | PTE_DBM | PTE_SHARED) & ~PTE_RDONLY;
-        if (has_vmalloc_area()) {
-            *pte |= PTE_PXN;
-        }
-    }
-    flush_tlb_kernel_range(_kp_rw_start, _kp_rw_end);
-    kp_rw_mem = tlsf_create_with_pool((void *)_kp_rw_start, MEMORY_RW_SIZE);
-
-    // rox memory
-    kp_rox_mem = tlsf_malloc(kp_rw_mem, tlsf_size());
-    tlsf_create(kp_rox_mem);
+    flush_tlb_kernel_range(text_start, _kp_region_end);
 
-    _kp_rox_start = _kp_rw_end;
-    _kp_rox_end = _kp_rox_start + MEMORY_ROX_SIZE;
-    log_boot("ROX: %llx, %llx\n", _kp_rox_start, _kp_rox_end);
-
-    tlsf_add_pool(kp_rox_mem, (void *)_kp_rox_start, MEMORY_ROX_SIZE);
-
-    for (uint64_t i = _kp_rox_start; i < _kp_rox_end; i += page_size) {
-        uint64_t *pte = pgtable_entry_kernel(i);
-        *pte |= PTE_SHARED;
-        *pte = *pte & ~PTE_PXN;
-        // todo: tlsf malloc block_split will write to alloced memory
-        // if (has_vmalloc_area()) {
-        // *pte |= PTE_RDONLY;
-        // *pte &= ~PTE_DBM;
-        // }
-    }
-    flush_tlb_kernel_range(_kp_rox_start, _kp_rox_end);
+    hook_mem_add(_kp_hook_start, _kp_hook_end - _kp_hook_start);
+    kp_rw_mem = tlsf_create_with_pool((void *)_kp_rw_start, MEMORY_RW_SIZE);
+    // exec allocator keeps its metadata in rw memory, only text pokes write rox
+    kp_malloc_init(has_vmalloc_area());
 
     // add to vmalloc area
     void (*vm_area_add_early)(struct vm_struct *vm) =
@@ -389,7 +371,7 @@ static void start_init(uint64_t kimage_voff, uint64_t linear_voff)
     printk = (typeof(printk))kallsyms_lookup_name("printk");
     if (!printk) printk = (typeof(printk))kallsyms_lookup_name("_printk");
 
-    vsprintf = (typeof(vsprintf))kallsyms_lookup_name("vsprintf");
+    klog_init();
 
     log_boot(KERNEL_PATCH_BANNER);
 
@@ -441,11 +423,20 @@ static int nice_zone()
 
 int __attribute__((section(".start.text"))) __noinline start(uint64_t kimage_voff, uint64_t linear_voff)
 {
+    int boot = boot_stage_begin("start()");
+    int stage = boot_stage_begin("start_init()");
     start_init(kimage_voff, linear_voff);
+    boot_stage_end(stage, 0);
+    stage = boot_stage_begin("prot_myself()");
     prot_myself();
+    boot_stage_end(stage, 0);
+    stage = boot_stage_begin("restore_map()");
     restore_map();
+    boot_stage_end(stage, 0);
     log_regs();
     predata_init();
-    symbol_init();
-    return nice_zone();
+    boot_stage(symbol_init());
+    int rc = boot_stage(nice_zone());
+    boot_stage_end(boot, rc);
+    return rc;
 }
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024 bmax121. All Rights Reserved.
+ */
+
+#ifndef _KP_BOOTPROF_H_
+#define _KP_BOOTPROF_H_
+
+#include <stdint.h>
+
+// Init stages timed with cntvct, kept for SUPERCALL_BOOT_PROF. Stages may nest, stages past the table size
+// are not recorded. Stages may begin on several threads once deferred init runs, depth is then only a hint.
+
+int boot_stage_begin(const char *name);
+void boot_stage_end(int idx, int rc);
+
+// time one call, evaluates to its return value
+#define boot_stage(call)                                \
+    ({                                                  \
+        int __stage_idx = boot_stage_begin(#call);      \
+        int __stage_rc = (int)(call);                   \
+        boot_stage_end(__stage_idx, __stage_rc);        \
+        __stage_rc;                                     \
+    })
+
+struct kp_boot_prof;
+void boot_prof_get(struct kp_boot_prof *prof);
+
+#endif
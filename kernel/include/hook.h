@@ -248,8 +248,12 @@ void unhook(void *func);
 // todo: hook priority
 hook_err_t hook_chain_add(hook_chain_t *chain, void *before, void *after, void *udata);
 void hook_chain_remove(hook_chain_t *chain, void *before, void *after);
+hook_err_t hook_chain_replace(hook_chain_t *chain, void *old_before, void *old_after, void *before, void *after);
 hook_err_t hook_wrap(void *func, int32_t argno, void *before, void *after, void *udata);
 void hook_unwrap_remove(void *func, void *before, void *after, int remove);
+hook_err_t hook_wrap_replace(void *func, void *old_before, void *old_after, void *before, void *after);
+// like hook_unwrap, but the chain memory is never reused, for hooks that may have calls inside the transit
+void hook_unwrap_retire(void *func, void *before, void *after);
 
 static inline void hook_unwrap(void *func, void *before, void *after)
 {
@@ -267,6 +271,13 @@ void fp_hook(uintptr_t fp_addr, void *replace, void **backup);
 void fp_unhook(uintptr_t fp_addr, void *backup);
 hook_err_t fp_hook_wrap(uintptr_t fp_addr, int32_t argno, void *before, void *after, void *udata);
 void fp_hook_unwrap(uintptr_t fp_addr, void *before, void *after);
+hook_err_t fp_hook_wrap_replace(uintptr_t fp_addr, void *old_before, void *old_after, void *before, void *after);
+
+struct kp_hook_mem_stat;
+void hook_mem_stat(struct kp_hook_mem_stat *stat);
+
+// number of hooks whose callback, replace or udata points into [start, end)
+int hook_mem_refs(uint64_t start, uint64_t end);
 
 static inline void hook_chain_install(hook_chain_t *chain)
 {
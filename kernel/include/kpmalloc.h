@@ -4,46 +4,37 @@
 #include <tlsf.h>
 
 extern tlsf_t kp_rw_mem;
-extern tlsf_t kp_rox_mem;
-
-static inline void *kp_malloc_exec(size_t bytes)
-{
-    return tlsf_malloc(kp_rox_mem, bytes);
-}
-
-static inline void *kp_memalign_exec(size_t align, size_t bytes)
-{
-    return tlsf_memalign(kp_rox_mem, align, bytes);
-}
-
-static inline void *kp_realloc_exec(void *ptr, size_t size)
-{
-    return tlsf_realloc(kp_rox_mem, ptr, size);
-}
-
-static inline void kp_free_exec(void *ptr)
-{
-    tlsf_free(kp_rox_mem, ptr);
-}
-
-static inline void *kp_malloc(size_t bytes)
-{
-    return tlsf_malloc(kp_rw_mem, bytes);
-}
-
-static inline void *kp_memalign(size_t align, size_t bytes)
-{
-    return tlsf_memalign(kp_rw_mem, align, bytes);
-}
-
-static inline void *kp_realloc(void *ptr, size_t size)
-{
-    return tlsf_realloc(kp_rw_mem, ptr, size);
-}
-
-static inline void kp_free(void *ptr)
-{
-    tlsf_free(kp_rw_mem, ptr);
-}
-
-#endif
\ No newline at end of file
+
+// All of these may be called concurrently, blocks up to 512 bytes come from per-cpu caches.
+// Executable memory may be mapped read-only, write it with kp_text_poke or between kp_text_poke_begin/end.
+
+void *kp_malloc_exec(size_t bytes);
+void *kp_memalign_exec(size_t align, size_t bytes);
+void *kp_realloc_exec(void *ptr, size_t size);
+void kp_free_exec(void *ptr);
+
+void *kp_malloc(size_t bytes);
+void *kp_memalign(size_t align, size_t bytes);
+void *kp_realloc(void *ptr, size_t size);
+void kp_free(void *ptr);
+
+void kp_text_poke_begin(void *addr, size_t len);
+void kp_text_poke_end();
+void kp_text_poke(void *dst, const void *src, size_t len);
+void kp_exec_set_writable(void *addr, size_t len, int writable);
+
+// Heaps start with the pools reserved in the kpimg region, these may sleep and must not be called under a lock.
+// kp_heap_grow returns 0 or -ENOMEM, the exec heap only grows from module_alloc or execmem_alloc.
+int kp_heap_grow(int exec, size_t bytes);
+size_t kp_heap_free(int exec);
+void kp_heap_trim();
+
+struct kp_heap_stat;
+void kp_heap_stat(int exec, struct kp_heap_stat *stat);
+
+// lockless, for checks from exception context
+int kp_exec_contains(uint64_t addr);
+
+int kp_malloc_init(int rdonly_exec);
+
+#endif
@@ -6,6 +6,8 @@
 #ifndef _KP_KPMODULE_H_
 #define _KP_KPMODULE_H_
 
+#include <symbol.h>
+
 #define KPM_INFO(name, info, limit)                                 \
     _Static_assert(sizeof(info) <= limit, "Info string too long");  \
     static const char __kpm_info_##name[] __attribute__((__used__)) \
@@ -29,6 +31,14 @@ typedef long (*mod_ctl0call_t)(const char *ctl_args, char *__user out_msg, int o
 typedef long (*mod_ctl1call_t)(void *a1, void *a2, void *a3);
 typedef long (*mod_exitcall_t)(void *reserved);
 
+// hot upgrade: the running module hands its state out, the new one takes it over and swaps its hooks in with
+// hook_wrap_replace/fp_hook_wrap_replace, the old exit isn't called.
+// handover must leave the old module working, it keeps running if the upgrade fails.
+// The old image is never freed, callbacks may still be running in it, every upgrade costs its size for good.
+// Hook udata is kept across the swap.
+typedef long (*mod_handovercall_t)(void **state, void *reserved);
+typedef long (*mod_upgradecall_t)(const char *args, void *state, void *reserved);
+
 #define KPM_INIT(fn) \
     static mod_initcall_t __kpm_initcall_##fn __attribute__((__used__)) __attribute__((__section__(".kpm.init"))) = fn
 
@@ -41,4 +51,17 @@ typedef long (*mod_exitcall_t)(void *reserved);
 #define KPM_EXIT(fn) \
     static mod_exitcall_t __kpm_exitcall_##fn __attribute__((__used__)) __attribute__((__section__(".kpm.exit"))) = fn
 
+#define KPM_HANDOVER(fn)                                                        \
+    static mod_handovercall_t __kpm_handovercall_##fn __attribute__((__used__)) \
+    __attribute__((__section__(".kpm.handover"))) = fn
+
+#define KPM_UPGRADE(fn)                                                       \
+    static mod_upgradecall_t __kpm_upgradecall_##fn __attribute__((__used__)) \
+    __attribute__((__section__(".kpm.upgrade"))) = fn
+
+// make sym importable by kpms loaded afterwards
+#define KPM_EXPORT_SYMBOL(sym)                                      \
+    static kp_symbol_t __kpm_symbol_##sym __attribute__((__used__)) \
+    __attribute__((__section__(".kpm.symbol"))) = { .name = #sym, .addr = (unsigned long)&sym, .hash = 0 }
+
 #endif
\ No newline at end of file
@@ -13,25 +13,77 @@
 
 extern void (*printk)(const char *fmt, ...);
 
-#define logkv(fmt, ...) printk("[+] KP V " fmt, ##__VA_ARGS__)
+#define KLOG_LEVEL_V 0
+#define KLOG_LEVEL_D 1
+#define KLOG_LEVEL_I 2
+#define KLOG_LEVEL_W 3
+#define KLOG_LEVEL_E 4
+
+#define KLOG_BOOT 0
+#define KLOG_RUNTIME 1
+
+#define KLOG_ARGS_MAX 8
+#define KLOG_STR_LEN 64
+
+// One log call, formatted only when read. fmt must outlive the record, %s arguments that don't point into
+// the kernel or kernelpatch images are copied into str and their arg is an offset into it.
+// %p extensions that dereference their argument, %pI4, %pD and alike, are formatted into str when recorded,
+// pre_mask marks them and the read prints them as %s.
+typedef struct
+{
+    uint64_t seq;
+    uint64_t ts;
+    const char *fmt;
+    uint8_t level;
+    uint8_t cpu;
+    uint8_t nargs;
+    uint8_t str_mask;
+    uint8_t pre_mask;
+    uint8_t _pad[3];
+    uint64_t args[KLOG_ARGS_MAX];
+    char str[KLOG_STR_LEN];
+} klog_rec_t;
+
+void kp_log(int level, const char *fmt, ...);
+
+#define logkv(fmt, ...) kp_log(KLOG_LEVEL_V, fmt, ##__VA_ARGS__)
 // #define logkv(fmt, ...)
 
-// #define logkfv(fmt, ...) printk("[+] KP V %s: " fmt, __func__, ##__VA_ARGS__)
+// #define logkfv(fmt, ...) kp_log(KLOG_LEVEL_V, "%s: " fmt, __func__, ##__VA_ARGS__)
 #define logkfv(fmt, ...)
 
-#define logkd(fmt, ...) printk("[+] KP D " fmt, ##__VA_ARGS__)
-#define logkfd(fmt, ...) printk("[+] KP D %s: " fmt, __func__, ##__VA_ARGS__)
+#define logkd(fmt, ...) kp_log(KLOG_LEVEL_D, fmt, ##__VA_ARGS__)
+#define logkfd(fmt, ...) kp_log(KLOG_LEVEL_D, "%s: " fmt, __func__, ##__VA_ARGS__)
 
-#define logki(fmt, ...) printk("[+] KP I " fmt, ##__VA_ARGS__)
-#define logkfi(fmt, ...) printk("[+] KP I %s: " fmt, __func__, ##__VA_ARGS__)
+#define logki(fmt, ...) kp_log(KLOG_LEVEL_I, fmt, ##__VA_ARGS__)
+#define logkfi(fmt, ...) kp_log(KLOG_LEVEL_I, "%s: " fmt, __func__, ##__VA_ARGS__)
 
-#define logkw(fmt, ...) printk("[-] KP W " fmt, ##__VA_ARGS__)
-#define logkfw(fmt, ...) printk("[-] KP W %s: " fmt, __func__, ##__VA_ARGS__)
+// warnings and errors still go to the kernel log as well, arguments are evaluated once
+void kp_log_print(int level, const char *fmt, ...);
 
-#define logke(fmt, ...) printk("[-] KP E " fmt, ##__VA_ARGS__)
-#define logkfe(fmt, ...) printk("[-] KP E %s: " fmt, __func__, ##__VA_ARGS__)
+#define logkw(fmt, ...) kp_log_print(KLOG_LEVEL_W, fmt, ##__VA_ARGS__)
+#define logkfw(fmt, ...) kp_log_print(KLOG_LEVEL_W, "%s: " fmt, __func__, ##__VA_ARGS__)
+
+#define logke(fmt, ...) kp_log_print(KLOG_LEVEL_E, fmt, ##__VA_ARGS__)
+#define logkfe(fmt, ...) kp_log_print(KLOG_LEVEL_E, "%s: " fmt, __func__, ##__VA_ARGS__)
 
 void log_boot(const char *fmt, ...);
-const char *get_boot_log();
+
+/**
+ * klog_read - format records into buf, one line each
+ * @which: KLOG_BOOT or KLOG_RUNTIME
+ * @pos: boot record to start from, advanced past what was written, unused for KLOG_RUNTIME
+ * @buf: output, always NUL-terminated
+ * @size: size of buf
+ * Return: length written, runtime records are merged across cpus by timestamp. Reads starting at boot record 0 and
+ * runtime reads begin with a line counting the records that could not be stored, if any.
+ */
+int klog_read(int which, uint64_t *pos, char *buf, int size);
+
+// drop formats inside [start, end), called before a kpm's memory is freed
+void klog_forget(uint64_t start, uint64_t end);
+
+int klog_ring_init();
+void klog_init();
 
 #endif
\ No newline at end of file
@@ -137,8 +137,15 @@ static inline uint64_t kp_kimg_to_phys(uint64_t addr)
     return addr - kimage_voffset;
 }
 
+// past this many pages one full invalidation is cheaper than invalidating page by page
+#define TLBI_RANGE_MAX_PAGES 512
+
 static inline void flush_tlb_kernel_range(uint64_t start, uint64_t end)
 {
+    if ((end - start) >> page_shift > TLBI_RANGE_MAX_PAGES) {
+        flush_tlb_all();
+        return;
+    }
     start = tlbi_vaddr(start, 0);
     end = tlbi_vaddr(end, 0);
     dsb(ishst);
@@ -164,6 +171,10 @@ static inline int is_kimg_range(uint64_t addr)
 
 uint64_t *pgtable_entry(uint64_t pgd, uint64_t va);
 
+// Set and clear bits of the kernel entries mapping [start, end), walking once per last level table.
+// Block entries are updated as a whole. The tlb is not flushed, flush the whole range once afterwards.
+void pgtable_update_range(uint64_t start, uint64_t end, uint64_t set, uint64_t clear);
+
 static inline uint64_t *pgtable_entry_kernel(uint64_t va)
 {
     return pgtable_entry(pgd_va, va);
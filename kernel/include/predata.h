@@ -18,6 +18,13 @@ uint64_t rand_next();
 uint64_t get_build_config();
 struct patch_symbol *get_preset_patch_sym();
 
+/**
+ * get_preset_additional - value of a key=value pair added with kptools -a
+ * @value: output, NUL-terminated, truncated to @len - 1
+ * Return: length of @value, or -1 if @key isn't set
+ */
+int get_preset_additional(const char *key, char *value, int len);
+
 int on_each_extra_item(int (*callback)(const patch_extra_item_t *extra, const char *arg, const void *data, void *udata),
                        void *udata);
 
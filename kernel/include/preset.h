@@ -24,6 +24,10 @@
 #define MEMORY_RW_SIZE (2 << 20)
 #define MAP_ALIGN 0x10
 
+// The hook and rw pools start on a boundary of this size and are mapped with block descriptors where the kernel
+// allows, the rox pool before them is stretched up to that boundary. Only 4K pages have a block size this small.
+#define KP_POOL_BLOCK_SIZE(page_shift) ((page_shift) == 12 ? (2ul << 20) : (1ul << (page_shift)))
+
 #define CONFIG_DEBUG (1 << 0)
 #define CONFIG_ANDROID (1 << 1)
 
@@ -63,6 +67,8 @@ typedef struct _setup_header_t // 64-bytes
             uint32_t _;
             config_t config_flags;
             char compile_time[COMPILE_TIME_LEN];
+            int64_t ksym_names_offset; // offset in kpimg of the NUL separated symbol names kpimg resolves
+            int64_t ksym_names_size;
         };
         char _cap[64];
     };
@@ -75,6 +81,8 @@ _Static_assert(sizeof(setup_header_t) == KP_HEADER_SIZE, "sizeof setup_header_t
 #define header_kp_version_offset (MAGIC_LEN)
 #define header_config_flags (header_kp_version_offset + 4 + 4)
 #define header_compile_time_offset (header_config_flags + 8)
+#define header_ksym_names_offset (header_compile_time_offset + COMPILE_TIME_LEN)
+#define header_ksym_names_size (header_ksym_names_offset + 8)
 #endif
 
 #ifndef __ASSEMBLY__
@@ -153,6 +161,7 @@ typedef int32_t extra_item_type;
 #define EXTRA_TYPE_EXEC 3
 #define EXTRA_TYPE_RAW 4
 #define EXTRA_TYPE_ANDROID_RC 5
+#define EXTRA_TYPE_KSYM 6
 
 #define EXTRA_TYPE_NONE_STR "none"
 #define EXTRA_TYPE_KPM_STR "kpm"
@@ -160,12 +169,16 @@ typedef int32_t extra_item_type;
 #define EXTRA_TYPE_EXEC_STR "exec"
 #define EXTRA_TYPE_RAW_STR "raw"
 #define EXTRA_TYPE_ANDROID_RC_STR "android_rc"
+#define EXTRA_TYPE_KSYM_STR "ksym"
 
 // todo
 #define EXTRA_EVENT_PAGING_INIT "paging-init"
 
+// kpm loaded synchronously before kernel_init goes on
 #define EXTRA_EVENT_PRE_KERNEL_INIT "pre-kernel-init"
-#define EXTRA_EVENT_KPM_DEFAULT EXTRA_EVENT_PRE_KERNEL_INIT
+// kpm staged and initialized in priority order by a kernel thread, kernel_init doesn't wait for it
+#define EXTRA_EVENT_KERNEL_INIT_ASYNC "kernel-init-async"
+#define EXTRA_EVENT_KPM_DEFAULT EXTRA_EVENT_KERNEL_INIT_ASYNC
 #define EXTRA_EVENT_POST_KERNEL_INIT "post-kernel-init"
 
 #define EXTRA_EVENT_PRE_FIRST_STAGE "pre-init-first-stage"
@@ -196,6 +209,62 @@ struct _patch_extra_item
 };
 typedef struct _patch_extra_item patch_extra_item_t;
 _Static_assert(sizeof(patch_extra_item_t) == PATCH_EXTRA_ITEM_LEN, "sizeof patch_extra_item_t mismatch");
+
+// EXTRA_TYPE_KSYM content, kernel offsets of the kpimg symbol names resolved by kptools,
+// one entry for every name, sorted by hash, hash is FNV-1a 32 of the full symbol name.
+// Names the kernel does not have are kept with KSYM_CACHE_MISSING so the boot side can trust them too
+#define KSYM_CACHE_MAGIC "ks2"
+
+#define KSYM_CACHE_MISSING 0x1
+#define KSYM_CACHE_CLONE 0x2 // resolved to a compiler clone, name.llvm.<hash> and alike
+
+typedef struct
+{
+    char magic[4];
+    uint32_t names_hash; // FNV-1a 32 of the whole kpimg names section
+    int32_t num;
+    int32_t _;
+} ksym_cache_header_t;
+
+typedef struct
+{
+    uint32_t hash;
+    int32_t offset;
+    uint32_t flags;
+} ksym_cache_entry_t;
+
+// EXTRA_TYPE_KPM content laid out and relocated by kptools --prelink instead of an ELF,
+// the image must be loaded at KPM_PRELINK_ALIGN so adrp and lo12 relocations stay valid.
+// Text, then rodata, then data, the first two groups end on the target kernel's page boundaries
+#define KPM_PRELINK_MAGIC "kpmlink"
+#define KPM_PRELINK_ALIGN 0x1000
+#define KPM_PRELINK_SELF 0xffff
+#define KPM_PRELINK_NONE -1
+
+typedef struct
+{
+    char magic[8];
+    int32_t image_offset; // from the start of this header
+    int32_t image_size; // bytes to copy
+    int32_t mem_size; // bytes to allocate, zeroed after image_size
+    int32_t fixup_offset;
+    int32_t fixup_num;
+    int32_t import_offset; // NUL separated names of KernelPatch or kpm exported symbols
+    int32_t import_num;
+    int32_t init, exit, ctl0, ctl1; // .kpm.* section offsets in image
+    int32_t name, version, license, author, description; // modinfo string offsets in image
+    int32_t symbol_offset, symbol_size; // .kpm.symbol section in image
+    int32_t handover, upgrade; // .kpm.handover and .kpm.upgrade offsets in image, optional
+    int32_t text_size, ro_size; // executable prefix and read-only prefix of the image, text included
+} kpm_prelink_header_t;
+
+typedef struct
+{
+    uint32_t offset; // in image
+    uint16_t type; // R_AARCH64_*
+    uint16_t import; // import index, KPM_PRELINK_SELF for the image base
+    int64_t addend;
+} kpm_prelink_fixup_t;
 #endif
 
 #ifndef __ASSEMBLY__
@@ -267,7 +336,8 @@ typedef struct _setup_preset_t
 #define setup_superkey_offset (setup_header_backup_offset + HDR_BACKUP_SIZE)
 #define setup_root_superkey_offset (setup_superkey_offset + SUPER_KEY_LEN)
 #define setup_patch_symbol_offset (setup_root_superkey_offset + ROOT_SUPER_KEY_HASH_LEN + SETUP_PRESERVE_LEN)
-#define setup_end (setup_patch_symbol_offset + PATCH_SYMBOL_LEN)
+#define setup_additional_offset (setup_patch_symbol_offset + PATCH_SYMBOL_LEN)
+#define setup_end (setup_additional_offset + ADDITIONAL_LEN)
 #endif
 
 #ifndef __ASSEMBLY__
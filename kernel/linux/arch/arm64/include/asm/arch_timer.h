@@ -0,0 +1,23 @@
+#ifndef __ASM_ARCH_TIMER_H
+#define __ASM_ARCH_TIMER_H
+
+#include <stdint.h>
+
+// the virtual counter runs from boot at a fixed frequency and is readable from any context
+
+static inline uint64_t __arch_counter_get_cntvct(void)
+{
+    uint64_t cnt;
+    asm volatile("isb" : : : "memory");
+    asm volatile("mrs %0, cntvct_el0" : "=r"(cnt));
+    return cnt;
+}
+
+static inline uint32_t arch_timer_get_cntfrq(void)
+{
+    uint64_t val;
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(val));
+    return (uint32_t)val;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef _LINUX_COMPLETION_H
+#define _LINUX_COMPLETION_H
+
+#include <ktypes.h>
+#include <ksyms.h>
+#include <common.h>
+#include <linux/lockdep.h>
+
+// done followed by a wait queue head, a swait_queue_head since 5.7 and a wait_queue_head before,
+// init_completion is inline in the kernel, the head is set up by the kernel's init function of its type
+struct completion
+{
+    unsigned int done;
+    uint64_t wait[16];
+};
+
+extern void kfunc_def(__init_swait_queue_head)(void *q, const char *name, struct lock_class_key *key);
+extern void kfunc_def(__init_waitqueue_head)(void *wq_head, const char *name, struct lock_class_key *key);
+extern void kfunc_def(wait_for_completion)(struct completion *x);
+extern void kfunc_def(complete_all)(struct completion *x);
+
+static inline void __init_completion(struct completion *x, const char *name, struct lock_class_key *key)
+{
+    x->done = 0;
+    if (kver >= VERSION(5, 7, 0)) {
+        kfunc_direct_call_void(__init_swait_queue_head, x->wait, name, key);
+    } else {
+        kfunc_direct_call_void(__init_waitqueue_head, x->wait, name, key);
+    }
+}
+
+#define init_completion(x)                        \
+    do {                                          \
+        static struct lock_class_key __key;       \
+        __init_completion((x), #x, &__key);       \
+    } while (0)
+
+static inline void wait_for_completion(struct completion *x)
+{
+    kfunc_direct_call_void(wait_for_completion, x);
+}
+
+static inline void complete_all(struct completion *x)
+{
+    kfunc_direct_call_void(complete_all, x);
+}
+
+#endif
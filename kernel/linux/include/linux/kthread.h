@@ -0,0 +1,58 @@
+#ifndef _LINUX_KTHREAD_H
+#define _LINUX_KTHREAD_H
+
+#include <ktypes.h>
+#include <ksyms.h>
+#include <linux/err.h>
+#include <uapi/asm-generic/errno.h>
+
+#define NUMA_NO_NODE (-1)
+
+struct task_struct;
+
+extern struct task_struct *kvar_def(kthreadd_task);
+
+extern struct task_struct *kfunc_def(kthread_create_on_node)(int (*threadfn)(void *data), void *data, int node,
+                                                             const char namefmt[], ...);
+extern int kfunc_def(wake_up_process)(struct task_struct *tsk);
+extern long kfunc_def(schedule_timeout_uninterruptible)(long timeout);
+extern long kfunc_def(schedule_timeout_interruptible)(long timeout);
+
+/**
+ * kthread_run - create and wake a thread.
+ * @threadfn: the function to run until signal_pending(current).
+ * @data: data ptr for @threadfn.
+ * @name: name for the thread.
+ *
+ * Description: Convenient wrapper for kthread_create_on_node() followed by
+ * wake_up_process().  Returns the kthread or ERR_PTR(-ENOMEM).
+ */
+static inline struct task_struct *kthread_run(int (*threadfn)(void *data), void *data, const char *name)
+{
+    if (!kfunc(kthread_create_on_node) || !kfunc(wake_up_process)) return ERR_PTR(-ENOSYS);
+    struct task_struct *tsk = kfunc(kthread_create_on_node)(threadfn, data, NUMA_NO_NODE, "%s", name);
+    if (!IS_ERR(tsk)) kfunc(wake_up_process)(tsk);
+    return tsk;
+}
+
+// kthreadd is spawned by rest_init, kthread_create can't be used from kernel_init before it's up
+static inline bool kthreadd_ready()
+{
+    return kvar(kthreadd_task) && kvar_val(kthreadd_task);
+}
+
+static inline long kthread_sleep(long timeout)
+{
+    kfunc_call(schedule_timeout_uninterruptible, timeout);
+    kfunc_not_found();
+    return 0;
+}
+
+// for long waits, doesn't count towards loadavg or the hung task detector, may return early
+static inline long kthread_sleep_interruptible(long timeout)
+{
+    kfunc_call(schedule_timeout_interruptible, timeout);
+    return kthread_sleep(timeout);
+}
+
+#endif
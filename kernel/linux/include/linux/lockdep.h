@@ -10,10 +10,17 @@
 #ifndef __LINUX_LOCKDEP_H
 #define __LINUX_LOCKDEP_H
 
+#include <ktypes.h>
 #include <ksyms.h>
 
 struct lockdep_map;
 
+// empty without CONFIG_LOCKDEP, lockdep only uses its address and wants it in static memory
+struct lock_class_key
+{
+    uint64_t _[4];
+};
+
 /*
  * Acquire a lock.
  *
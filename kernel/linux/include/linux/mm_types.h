@@ -308,6 +308,7 @@ struct mm_struct_offset
     int16_t mmap_base_offset;
     int16_t task_size_offset;
     int16_t pgd_offset;
+    int16_t mmap_lock_offset; // mmap_sem before 5.8
     int16_t map_count_offset;
     int16_t total_vm_offset;
     int16_t locked_vm_offset;
@@ -0,0 +1,35 @@
+#ifndef _LINUX_MUTEX_H
+#define _LINUX_MUTEX_H
+
+#include <ktypes.h>
+#include <ksyms.h>
+#include <linux/lockdep.h>
+
+// layout differs across versions and configs, room for the largest one with the debug and lockdep fields,
+// only touched by the kernel's own functions
+struct mutex
+{
+    uint64_t _[32];
+};
+
+extern void kfunc_def(__mutex_init)(struct mutex *lock, const char *name, struct lock_class_key *key);
+extern void kfunc_def(mutex_lock)(struct mutex *lock);
+extern void kfunc_def(mutex_unlock)(struct mutex *lock);
+
+#define mutex_init(mutex)                                              \
+    do {                                                               \
+        static struct lock_class_key __key;                            \
+        kfunc_direct_call_void(__mutex_init, (mutex), #mutex, &__key); \
+    } while (0)
+
+static inline void mutex_lock(struct mutex *lock)
+{
+    kfunc_direct_call_void(mutex_lock, lock);
+}
+
+static inline void mutex_unlock(struct mutex *lock)
+{
+    kfunc_direct_call_void(mutex_unlock, lock);
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _LINUX_RWSEM_H
+#define _LINUX_RWSEM_H
+
+#include <ktypes.h>
+#include <ksyms.h>
+
+// layout differs across versions and configs, only used through pointers found at runtime
+struct rw_semaphore;
+
+extern void kfunc_def(down_read)(struct rw_semaphore *sem);
+extern void kfunc_def(up_read)(struct rw_semaphore *sem);
+
+static inline void down_read(struct rw_semaphore *sem)
+{
+    kfunc_direct_call_void(down_read, sem);
+}
+
+static inline void up_read(struct rw_semaphore *sem)
+{
+    kfunc_direct_call_void(up_read, sem);
+}
+
+#endif
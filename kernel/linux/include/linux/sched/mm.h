@@ -16,6 +16,10 @@ extern void kfunc_def(mmput_async)(struct mm_struct *);
 /* Grab a reference to a task's mm, if it is not already going away */
 extern struct mm_struct *kfunc_def(get_task_mm)(struct task_struct *task);
 
+// before 4.9 the last argument is int write, FOLL_WRITE is 1 so callers passing 0 or FOLL_WRITE work on both
+extern int kfunc_def(access_remote_vm)(struct mm_struct *mm, unsigned long addr, void *buf, int len,
+                                       unsigned int gup_flags);
+
 static inline void mmput(struct mm_struct *mm)
 {
     kfunc_direct_call_void(mmput, mm);
@@ -31,4 +35,11 @@ static inline struct mm_struct *get_task_mm(struct task_struct *task)
     kfunc_direct_call(get_task_mm, task);
 }
 
+static inline int access_remote_vm(struct mm_struct *mm, unsigned long addr, void *buf, int len, unsigned int gup_flags)
+{
+    kfunc_call(access_remote_vm, mm, addr, buf, len, gup_flags);
+    kfunc_not_found();
+    return 0;
+}
+
 #endif
\ No newline at end of file
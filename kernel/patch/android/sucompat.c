@@ -36,6 +36,7 @@
 #include <kconfig.h>
 #include <linux/vmalloc.h>
 #include <sucompat.h>
+#include <exechook.h>
 #include <symbol.h>
 #include <uapi/linux/limits.h>
 
@@ -45,7 +46,8 @@ static const char legacy_su_path[] = ANDROID_LEGACY_SU_PATH;
 static const char *current_su_path = 0;
 static const char apd_path[] = APD_PATH;
 
-static struct list_head allow_uid_list;
+// readers may come from kpms before su_compat_init, which runs deferred
+static LIST_HEAD(allow_uid_list);
 static spinlock_t list_lock;
 
 static void allow_reclaim_callback(struct rcu_head *rcu)
@@ -396,23 +398,21 @@ static void before_sysfstatat(hook_fargs4_t *args, void *udata)
 
 // #define TRY_DIRECT_MODIFY_USER
 
-static void handle_before_execve(hook_local_t *hook_local, char **__user u_filename_p, char **__user uargv, void *udata)
+static int before_exec(struct exec_args *exec, void *udata)
 {
+    char **__user u_filename_p = exec->u_filename_p;
+    char **__user uargv = exec->uargv_p;
+    const char *filename = exec->filename;
+    void *is_compact = (void *)(uintptr_t)exec->compat;
+
 #ifdef TRY_DIRECT_MODIFY_USER
     // copy to user len
-    hook_local->data0 = 0;
+    exec->local->data0 = 0;
 #endif
 
-    void *is_compact = udata;
-
-    char __user *ufilename = *u_filename_p;
-    char filename[SU_PATH_MAX_LEN];
-    int flen = compat_strncpy_from_user(filename, ufilename, sizeof(filename));
-    if (unlikely(flen <= 0)) return;
-
     if (unlikely(!strcmp(current_su_path, filename))) {
         uid_t uid = current_uid();
-        if (!is_su_allow_uid(uid)) return;
+        if (!is_su_allow_uid(uid)) return 0;
         struct su_profile profile = profile_su_allow_uid(uid);
 
         uid_t to_uid = profile.to_uid;
@@ -425,8 +425,8 @@ static void handle_before_execve(hook_local_t *hook_local, char **__user u_filen
 #ifdef TRY_DIRECT_MODIFY_USER
             cplen = compat_copy_to_user(*u_filename_p, sh_path, sizeof(sh_path));
             if (cplen > 0) {
-                hook_local->data0 = cplen;
-                hook_local->data1 = (uint64_t)u_filename_p;
+                exec->local->data0 = cplen;
+                exec->local->data1 = (uint64_t)u_filename_p;
                 logkfi("call su uid: %d, to_uid: %d, sctx: %s, cplen: %d\n", uid, to_uid, sctx, cplen);
             }
 #endif
@@ -445,8 +445,8 @@ static void handle_before_execve(hook_local_t *hook_local, char **__user u_filen
 #ifdef TRY_DIRECT_MODIFY_USER
             cplen = compat_copy_to_user(*u_filename_p, apd_path, sizeof(apd_path));
             if (cplen > 0) {
-                hook_local->data0 = cplen;
-                hook_local->data1 = (uint64_t)u_filename_p;
+                exec->local->data0 = cplen;
+                exec->local->data1 = (uint64_t)u_filename_p;
             }
 #endif
             uint64_t sp = 0;
@@ -485,14 +485,10 @@ static void handle_before_execve(hook_local_t *hook_local, char **__user u_filen
         }
 
     } else if (unlikely(!strcmp(SUPERCMD, filename))) {
-        // key
-        const char __user *p1 = get_user_arg_ptr(is_compact, *uargv, 1);
-        if (!p1 || IS_ERR(p1)) return;
-
         // auth key
-        char arg1[SUPER_KEY_LEN];
-        if (compat_strncpy_from_user(arg1, p1, sizeof(arg1)) <= 0) return;
-        if (auth_superkey(arg1)) return;
+        const char *arg1 = exec_arg(exec, 1);
+        if (!arg1) return 0;
+        if (auth_superkey(arg1)) return 0;
 
         commit_su(0, 0);
 
@@ -503,7 +499,7 @@ static void handle_before_execve(hook_local_t *hook_local, char **__user u_filen
         int exec_len = sizeof(sh_path);
         const char __user *p2 = get_user_arg_ptr(is_compact, *uargv, 2);
 
-        if (p1 && !IS_ERR(p2)) {
+        if (p2 && !IS_ERR(p2)) {
             char buffer[EMBEDDED_NAME_MAX];
             int len = compat_strncpy_from_user(buffer, p2, EMBEDDED_NAME_MAX);
             if (len >= 0) {
@@ -521,10 +517,11 @@ static void handle_before_execve(hook_local_t *hook_local, char **__user u_filen
         // shift args
         *uargv += 2 * (is_compact ? 4 : 8);
     }
+    return 0;
 }
 
 #ifdef TRY_DIRECT_MODIFY_USER
-static void handle_after_execve(hook_local_t *hook_local)
+static void after_exec(void *fargs, hook_local_t *hook_local, void *udata)
 {
     int cplen = hook_local->data0;
     char **__user u_filename_p = (char **__user)hook_local->data1;
@@ -532,56 +529,8 @@ static void handle_after_execve(hook_local_t *hook_local)
         compat_copy_to_user((void *)*u_filename_p, current_su_path, cplen);
     }
 }
-#endif
-
-// https://elixir.bootlin.com/linux/v6.1/source/fs/exec.c#L2107
-// COMPAT_SYSCALL_DEFINE3(execve, const char __user *, filename,
-// 	const compat_uptr_t __user *, argv,
-// 	const compat_uptr_t __user *, envp)
-
-// https://elixir.bootlin.com/linux/v6.1/source/fs/exec.c#L2087
-// SYSCALL_DEFINE3(execve, const char __user *, filename, const char __user *const __user *, argv,
-//                 const char __user *const __user *, envp)
-static void before_execve(hook_fargs3_t *args, void *udata)
-{
-    void *arg0p = syscall_argn_p(args, 0);
-    void *arg1p = syscall_argn_p(args, 1);
-    handle_before_execve(&args->local, (char **)arg0p, (char **)arg1p, udata);
-}
-
-#ifdef TRY_DIRECT_MODIFY_USER
-static void after_execve(hook_fargs3_t *args, void *udata)
-{
-    handle_after_execve(&args->local);
-}
-#else
-#define after_execve 0
-#endif
-
-// https://elixir.bootlin.com/linux/v6.1/source/fs/exec.c#L2114
-// COMPAT_SYSCALL_DEFINE5(execveat, int, fd,
-// 		       const char __user *, filename,
-// 		       const compat_uptr_t __user *, argv,
-// 		       const compat_uptr_t __user *, envp,
-// 		       int,  flags)
-
-// https://elixir.bootlin.com/linux/v6.1/source/fs/exec.c#L2095
-// SYSCALL_DEFINE5(execveat, int, fd, const char __user *, filename, const char __user *const __user *, argv,
-//                 const char __user *const __user *, envp, int, flags)
-static void before_execveat(hook_fargs5_t *args, void *udata)
-{
-    void *arg1p = syscall_argn_p(args, 1);
-    void *arg2p = syscall_argn_p(args, 2);
-    handle_before_execve(&args->local, (char **)arg1p, (char **)arg2p, udata);
-}
-
-#ifdef TRY_DIRECT_MODIFY_USER
-static void after_execveat(hook_fargs5_t *args, void *udata)
-{
-    handle_after_execve(&args->local);
-}
 #else
-#define after_execveat 0
+#define after_exec 0
 #endif
 
 // https://elixir.bootlin.com/linux/v6.1/source/fs/stat.c#L431
@@ -649,7 +598,6 @@ int su_compat_init()
 {
     current_su_path = default_su_path;
 
-    INIT_LIST_HEAD(&allow_uid_list);
     spin_lock_init(&list_lock);
 
     // default shell
@@ -697,11 +645,8 @@ int su_compat_init()
 
 #else
 
-    rc = fp_hook_syscalln(__NR_execve, 3, before_execve, after_execve, (void *)0);
-    log_boot("hook __NR_execve rc: %d\n", rc);
-
-    rc = fp_hook_syscalln(__NR_execveat, 5, before_execveat, after_execveat, (void *)0);
-    log_boot("hook __NR_execveat rc: %d\n", rc);
+    rc = exec_hook_register(before_exec, after_exec, 0);
+    log_boot("register exec hook rc: %d\n", rc);
 
     rc = fp_hook_syscalln(__NR3264_fstatat, 4, su_handler_arg1_ufilename_before, su_handler_arg1_ufilename_after,
                           (void *)0);
@@ -720,14 +665,6 @@ int su_compat_init()
 
     // #include <asm/unistd32.h>
 
-    // __NR_execve 11
-    rc = fp_hook_compat_syscalln(11, 3, before_execve, after_execve, (void *)1);
-    log_boot("hook 32 __NR_execve rc: %d\n", rc);
-
-    //  __NR_execveat 387
-    rc = fp_hook_compat_syscalln(387, 5, before_execveat, after_execveat, (void *)1);
-    log_boot("hook 32 __NR_execveat rc: %d\n", rc);
-
     // __NR_statx 397
     rc = fp_hook_compat_syscalln(397, 5, su_handler_arg1_ufilename_before, su_handler_arg1_ufilename_after, (void *)0);
     log_boot("hook 32 __NR_statx rc: %d\n", rc);
@@ -28,10 +28,14 @@
 #include <predata.h>
 #include <linux/string.h>
 #include <linux/kernel.h>
+#include <exechook.h>
 #include <linux/slab.h>
 #include <linux/umh.h>
 #include <uapi/scdefs.h>
 #include <uapi/linux/stat.h>
+#include <taskext.h>
+#include <asm/arch_timer.h>
+#include <linux/kthread.h>
 
 #define EV_KEY 0x01
 #define KEY_VOLUMEDOWN 114
@@ -39,28 +43,6 @@
 int android_is_safe_mode = 0;
 KP_EXPORT_SYMBOL(android_is_safe_mode);
 
-static const void *kernel_read_file(const char *path, loff_t *len)
-{
-    set_priv_selinx_allow(current, 1);
-    void *data = 0;
-
-    struct file *filp = filp_open(path, O_RDONLY, 0);
-    if (unlikely(!filp) || unlikely(IS_ERR(filp))) {
-        log_boot("open file: %s error: %d\n", path, PTR_ERR(filp));
-        goto out;
-    }
-    *len = vfs_llseek(filp, 0, SEEK_END);
-    vfs_llseek(filp, 0, SEEK_SET);
-    data = vmalloc(*len);
-    loff_t pos = 0;
-    kernel_read(filp, data, *len, &pos);
-    filp_close(filp, 0);
-
-out:
-    set_priv_selinx_allow(current, 0);
-    return data;
-}
-
 static loff_t kernel_write_file(const char *path, const void *data, loff_t len, umode_t mode)
 {
     loff_t off = 0;
@@ -99,6 +81,80 @@ static void notify_safemode_userspace() {
     set_priv_selinx_allow(current, 0);
 }
 
+// volume-down x3 only counts during boot, override the window with kptools -a safemode_window=<seconds>, 0 disables
+#define SAFEMODE_WINDOW_KEY "safemode_window"
+#define SAFEMODE_WINDOW_DEFAULT_SEC 60
+
+static void *input_handle_event_addr = 0;
+static uint64_t safemode_deadline = 0;
+static int safemode_armed = 0;
+
+// void input_handle_event(struct input_dev *dev, unsigned int type, unsigned int code, int value)
+static void before_input_handle_event(hook_fargs4_t *args, void *udata)
+{
+    unsigned int type = args->arg1;
+    if (likely(type != EV_KEY)) return;
+    if (unlikely(!__atomic_load_n(&safemode_armed, __ATOMIC_RELAXED))) return;
+    // the unwrap thread may not be running yet or at all
+    if (unlikely(__arch_counter_get_cntvct() > safemode_deadline)) {
+        __atomic_store_n(&safemode_armed, 0, __ATOMIC_RELAXED);
+        return;
+    }
+
+    static unsigned int volumedown_pressed_count = 0;
+    unsigned int code = args->arg2;
+    int value = args->arg3;
+    if (value && code == KEY_VOLUMEDOWN) {
+        volumedown_pressed_count++;
+        if (volumedown_pressed_count == 3) {
+            log_boot("notify entering safemode ...");
+            android_is_safe_mode = 1;
+            notify_safemode_userspace();
+        }
+    }
+}
+
+static void safemode_disarm()
+{
+    __atomic_store_n(&safemode_armed, 0, __ATOMIC_RELAXED);
+    void *addr = __atomic_exchange_n(&input_handle_event_addr, 0, __ATOMIC_RELAXED);
+    if (!addr) return;
+    // touch events may still be inside the transit, keep its memory from being handed to the next hook
+    hook_unwrap_retire(addr, before_input_handle_event, 0);
+    log_boot("safemode detector removed\n");
+}
+
+static int safemode_disarm_thread(void *data)
+{
+    // sleep counts jiffies and HZ isn't known, measure one against the counter
+    uint64_t start = __arch_counter_get_cntvct();
+    kthread_sleep(10);
+    uint64_t jiffy = (__arch_counter_get_cntvct() - start) / 10;
+    if (!jiffy) jiffy = 1;
+
+    // the window can be minutes, sleep interruptibly and in chunks of at most a second
+    uint64_t now, chunk = arch_timer_get_cntfrq();
+    while ((now = __arch_counter_get_cntvct()) < safemode_deadline) {
+        uint64_t left = safemode_deadline - now;
+        kthread_sleep_interruptible((left < chunk ? left : chunk) / jiffy + 1);
+    }
+    safemode_disarm();
+    return 0;
+}
+
+static void safemode_arm(uint64_t window_sec)
+{
+    unsigned long addr = get_preset_patch_sym()->input_handle_event;
+    log_boot("input handle event is: %llx, safemode window: %lld\n", addr, window_sec);
+    if (!addr || !window_sec) return;
+    safemode_deadline = __arch_counter_get_cntvct() + arch_timer_get_cntfrq() * window_sec;
+    hook_err_t rc = hook_wrap4((void *)addr, before_input_handle_event, 0, 0);
+    log_boot("hook input_handle_event rc: %d\n", rc);
+    if (rc) return;
+    input_handle_event_addr = (void *)addr;
+    safemode_armed = 1;
+}
+
 static int extract_kpatch_call_back(const patch_extra_item_t *extra, const char *arg, const void *con, void *udata)
 {
     const char *event = (const char *)udata;
@@ -125,6 +181,10 @@ static void pre_user_exec_init()
 {
     log_boot("event: %s\n", EXTRA_EVENT_PRE_EXEC_INIT);
     try_extract_kpatch(EXTRA_EVENT_PRE_EXEC_INIT);
+    if (input_handle_event_addr) {
+        struct task_struct *thread = kthread_run(safemode_disarm_thread, 0, "kp_safemode");
+        if (IS_ERR(thread)) log_boot("start safemode disarm thread error: %d\n", PTR_ERR(thread));
+    }
     if (unlikely(android_is_safe_mode)) {
         notify_safemode_userspace();
     }
@@ -148,11 +208,9 @@ static void on_first_app_process()
 {
 }
 
-static void handle_before_execve(hook_local_t *hook_local, char **__user u_filename_p, char **__user uargv,
-                                 char **__user uenvp, void *udata)
+static int before_exec(struct exec_args *exec, void *udata)
 {
-    // unhook flag
-    hook_local->data7 = 0;
+    if (exec->compat) return 0;
 
     static char app_process[] = "/system/bin/app_process";
     static char app_process64[] = "/system/bin/app_process64";
@@ -163,10 +221,7 @@ static void handle_before_execve(hook_local_t *hook_local, char **__user u_filen
     static int first_user_init_executed = 0;
     static int init_second_stage_executed = 0;
 
-    char __user *ufilename = *u_filename_p;
-    char filename[SU_PATH_MAX_LEN];
-    int flen = compat_strncpy_from_user(filename, ufilename, sizeof(filename));
-    if (unlikely(flen <= 0)) return;
+    const char *filename = exec->filename;
 
     if (unlikely(!strcmp(system_bin_init, filename)) || unlikely(!strcmp(root_init, filename))) {
         //
@@ -177,12 +232,9 @@ static void handle_before_execve(hook_local_t *hook_local, char **__user u_filen
         }
 
         if (!init_second_stage_executed) {
-            for (int i = 1;; i++) {
-                const char __user *p1 = get_user_arg_ptr(0, *uargv, i);
-                if (!p1 || IS_ERR(p1)) break;
-
-                char arg[16] = { '\0' };
-                if (compat_strncpy_from_user(arg, p1, sizeof(arg)) <= 0) break;
+            for (int i = 1; i < EXEC_ARGV_NUM; i++) {
+                const char *arg = exec_arg(exec, i);
+                if (!arg) break;
 
                 if (!strcmp(arg, "second_stage") || !strcmp(arg, "--second-stage")) {
                     log_boot("exec %s second stage 0\n", filename);
@@ -194,7 +246,7 @@ static void handle_before_execve(hook_local_t *hook_local, char **__user u_filen
 
         if (!init_second_stage_executed) {
             for (int i = 0;; i++) {
-                const char *__user uenv = get_user_arg_ptr(0, *uenvp, i);
+                const char *__user uenv = get_user_arg_ptr(0, *exec->uenvp_p, i);
                 if (!uenv || IS_ERR(uenv)) break;
 
                 char env[256];
@@ -219,55 +271,9 @@ static void handle_before_execve(hook_local_t *hook_local, char **__user u_filen
         first_app_process_execed = 1;
         log_boot("exec first app_process: %s\n", filename);
         on_first_app_process();
-        hook_local->data7 = 1;
-        return;
-    }
-}
-
-static void before_execve(hook_fargs3_t *args, void *udata);
-static void after_execve(hook_fargs3_t *args, void *udata);
-static void before_execveat(hook_fargs5_t *args, void *udata);
-static void after_execveat(hook_fargs5_t *args, void *udata);
-
-static void handle_after_execve(hook_local_t *hook_local)
-{
-    int unhook = hook_local->data7;
-    if (unhook) {
-        fp_unhook_syscall(__NR_execve, before_execve, after_execve);
-        fp_unhook_syscall(__NR_execveat, before_execveat, after_execveat);
+        return 1;
     }
-}
-
-// https://elixir.bootlin.com/linux/v6.1/source/fs/exec.c#L2087
-// SYSCALL_DEFINE3(execve, const char __user *, filename, const char __user *const __user *, argv,
-//                 const char __user *const __user *, envp)
-static void before_execve(hook_fargs3_t *args, void *udata)
-{
-    void *arg0p = syscall_argn_p(args, 0);
-    void *arg1p = syscall_argn_p(args, 1);
-    void *arg2p = syscall_argn_p(args, 2);
-    handle_before_execve(&args->local, (char **)arg0p, (char **)arg1p, (char **)arg2p, udata);
-}
-
-static void after_execve(hook_fargs3_t *args, void *udata)
-{
-    handle_after_execve(&args->local);
-}
-
-// https://elixir.bootlin.com/linux/v6.1/source/fs/exec.c#L2095
-// SYSCALL_DEFINE5(execveat, int, fd, const char __user *, filename, const char __user *const __user *, argv,
-//                 const char __user *const __user *, envp, int, flags)
-static void before_execveat(hook_fargs5_t *args, void *udata)
-{
-    void *arg1p = syscall_argn_p(args, 1);
-    void *arg2p = syscall_argn_p(args, 2);
-    void *arg3p = syscall_argn_p(args, 3);
-    handle_before_execve(&args->local, (char **)arg1p, (char **)arg2p, (char **)arg3p, udata);
-}
-
-static void after_execveat(hook_fargs5_t *args, void *udata)
-{
-    handle_after_execve(&args->local);
+    return 0;
 }
 
 #define ORIGIN_RC_FILE "/system/etc/init/atrace.rc"
@@ -300,9 +306,69 @@ static const char user_rc_data[] = { //
     ""
 };
 
+#define RC_COPY_BUF_SIZE 512
+
+// copy the original rc in small chunks instead of reading it whole
+static int copy_rc_file(struct file *newfp, const char *path, loff_t *off)
+{
+    int rc = 0;
+    set_priv_selinx_allow(current, 1);
+
+    struct file *fp = filp_open(path, O_RDONLY, 0);
+    if (unlikely(!fp || IS_ERR(fp))) {
+        log_boot("open file: %s error: %d\n", path, PTR_ERR(fp));
+        rc = -ENOENT;
+        goto out;
+    }
+    char buf[RC_COPY_BUF_SIZE];
+    loff_t pos = 0;
+    for (;;) {
+        ssize_t len = kernel_read(fp, buf, sizeof(buf), &pos);
+        if (len <= 0) {
+            rc = len;
+            break;
+        }
+        loff_t start = *off;
+        kernel_write(newfp, buf, len, off);
+        if (unlikely(*off - start != len)) {
+            rc = -EIO;
+            break;
+        }
+    }
+    filp_close(fp, 0);
+
+out:
+    set_priv_selinx_allow(current, 0);
+    return rc;
+}
+
+// write tmpl with every %s replaced by sk, straight into the file, no size limit
+static int write_rc_template(struct file *fp, const char *tmpl, const char *sk, loff_t *off)
+{
+    int sk_len = strlen(sk);
+    const char *seg = tmpl;
+    for (;;) {
+        const char *fmt = seg;
+        while (*fmt && !(fmt[0] == '%' && fmt[1] == 's')) fmt++;
+        int len = fmt - seg;
+        int arg_len = *fmt ? sk_len : 0;
+        loff_t start = *off;
+        if (len) kernel_write(fp, seg, len, off);
+        if (arg_len) kernel_write(fp, sk, arg_len, off);
+        if (unlikely(*off - start != len + arg_len)) return -EIO;
+        if (!*fmt) return 0;
+        seg = fmt + 2;
+    }
+}
+
 // todo: struct file *do_filp_open(int dfd, struct filename *pathname, const struct open_flags *op)
 // todo: import rc
 
+// init opens the rc files within seconds of boot, give up redirecting after this
+#define RC_REDIRECT_DEADLINE_SEC 120
+
+static uint64_t rc_redirect_deadline = 0;
+
 // https://elixir.bootlin.com/linux/v6.1/source/fs/open.c#L1337
 // SYSCALL_DEFINE4(openat, int, dfd, const char __user *, filename, int, flags, umode_t, mode)
 static void before_openat(hook_fargs4_t *args, void *udata)
@@ -317,6 +383,18 @@ static void before_openat(hook_fargs4_t *args, void *udata)
     static int replaced = 0;
     if (replaced) return;
 
+    if (unlikely(__arch_counter_get_cntvct() > rc_redirect_deadline)) {
+        if (!__atomic_exchange_n(&replaced, 1, __ATOMIC_RELAXED)) {
+            log_boot("rc redirect deadline passed\n");
+            args->local.data2 = 1;
+        }
+        return;
+    }
+
+    // only init parses rc files, everyone else leaves before touching user memory
+    struct task_ext *ext = get_current_task_ext();
+    if (likely(task_ext_valid(ext) && ext->tgid != 1)) return;
+
     const char __user *filename = (typeof(filename))syscall_argn(args, 1);
     char buf[32];
     compat_strncpy_from_user(buf, filename, sizeof(buf));
@@ -324,7 +402,6 @@ static void before_openat(hook_fargs4_t *args, void *udata)
 
     replaced = 1;
 
-    loff_t ori_len = 0;
     struct file *newfp = filp_open(REPLACE_RC_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0600);
     if (unlikely(!newfp || IS_ERR(newfp))) {
         log_boot("create replace rc error: %d\n", PTR_ERR(newfp));
@@ -332,20 +409,11 @@ static void before_openat(hook_fargs4_t *args, void *udata)
     }
 
     loff_t off = 0;
-    const char *ori_rc_data = kernel_read_file(ORIGIN_RC_FILE, &ori_len);
-    if (unlikely(!ori_rc_data)) goto out;
-    kernel_write(newfp, ori_rc_data, ori_len, &off);
-    if (unlikely(off != ori_len)) {
+    if (unlikely(copy_rc_file(newfp, ORIGIN_RC_FILE, &off))) {
         log_boot("write replace rc error: %x\n", off);
         goto free;
     }
-
-    char added_rc_data[2048];
-    const char *sk = get_superkey();
-    sprintf(added_rc_data, user_rc_data, sk, sk, sk, sk, sk, sk, sk, sk, sk, sk, sk, sk, sk, sk);
-
-    kernel_write(newfp, added_rc_data, strlen(added_rc_data), &off);
-    if (unlikely(off != strlen(added_rc_data) + ori_len)) {
+    if (unlikely(write_rc_template(newfp, user_rc_data, get_superkey(), &off))) {
         log_boot("write replace rc error: %x\n", off);
         goto free;
     }
@@ -364,7 +432,6 @@ static void before_openat(hook_fargs4_t *args, void *udata)
 
 free:
     filp_close(newfp, 0);
-    kvfree(ori_rc_data);
 
 out:
     args->local.data2 = 1;
@@ -382,46 +449,29 @@ static void after_openat(hook_fargs4_t *args, void *udata)
     }
 }
 
-// void input_handle_event(struct input_dev *dev, unsigned int type, unsigned int code, int value)
-static void before_input_handle_event(hook_fargs4_t *args, void *udata)
-{
-    static unsigned int volumedown_pressed_count = 0;
-    unsigned int type = args->arg1;
-    unsigned int code = args->arg2;
-    int value = args->arg3;
-    if (value && type == EV_KEY && code == KEY_VOLUMEDOWN) {
-        volumedown_pressed_count++;
-        if (volumedown_pressed_count == 3) {
-            log_boot("notify entering safemode ...");
-            android_is_safe_mode = 1;
-            notify_safemode_userspace();
-        }
-    }
-}
-
 int kpuserd_init()
 {
     hook_err_t ret = 0;
     hook_err_t rc = HOOK_NO_ERR;
 
-    rc = fp_hook_syscalln(__NR_execve, 3, before_execve, after_execve, (void *)__NR_execve);
-    log_boot("hook __NR_execve rc: %d\n", rc);
-    ret |= rc;
-
-    rc = fp_hook_syscalln(__NR_execveat, 5, before_execveat, after_execveat, (void *)__NR_execveat);
-    log_boot("hook __NR_execveat rc: %d\n", rc);
+    rc = exec_hook_register(before_exec, 0, 0);
+    log_boot("register exec hook rc: %d\n", rc);
     ret |= rc;
 
+    rc_redirect_deadline = __arch_counter_get_cntvct() + (uint64_t)arch_timer_get_cntfrq() * RC_REDIRECT_DEADLINE_SEC;
     rc = fp_hook_syscalln(__NR_openat, 4, before_openat, after_openat, 0);
     log_boot("hook __NR_openat rc: %d\n", rc);
     ret |= rc;
 
-    unsigned long input_handle_event_addr = get_preset_patch_sym()->input_handle_event;
-    log_boot("input handle event is: %llx", input_handle_event_addr);
-    // TODO: Check addr validation
-    rc = hook_wrap4((void *)input_handle_event_addr, before_input_handle_event, 0, 0);
-    ret |= rc;
-    log_boot("hook input_handle_event rc: %d\n", rc);
+    uint64_t window = SAFEMODE_WINDOW_DEFAULT_SEC;
+    char buf[16];
+    if (get_preset_additional(SAFEMODE_WINDOW_KEY, buf, sizeof(buf)) > 0) {
+        window = 0;
+        for (char *c = buf; *c >= '0' && *c <= '9'; c++) {
+            window = window * 10 + *c - '0';
+        }
+    }
+    safemode_arm(window);
 
     return ret;
 }
@@ -104,11 +104,36 @@ out:
     return rc;
 }
 
-// todo: rcu
-int task_su(pid_t pid, uid_t to_uid, const char *sctx)
+// creds already rewritten in one batch, threads cloned with CLONE_THREAD share the leader's cred,
+// so a whole thread group usually needs su_cred and the selinux override only once
+#define SU_BATCH_CRED_MAX 16
+
+struct su_batch
 {
-    int rc = 0;
+    int num;
+    struct cred *creds[SU_BATCH_CRED_MAX];
+    int scontext_changed[SU_BATCH_CRED_MAX];
+};
+
+static int su_batch_cred(struct su_batch *batch, struct cred *cred, uid_t to_uid, const char *sctx)
+{
+    for (int i = 0; i < batch->num; i++) {
+        if (batch->creds[i] == cred) return batch->scontext_changed[i];
+    }
+    su_cred(cred, to_uid);
     int scontext_changed = 0;
+    if (sctx && sctx[0]) scontext_changed = !set_security_override_from_ctx(cred, sctx);
+    if (batch->num < SU_BATCH_CRED_MAX) {
+        batch->creds[batch->num] = cred;
+        batch->scontext_changed[batch->num] = scontext_changed;
+        batch->num++;
+    }
+    return scontext_changed;
+}
+
+static int __task_su(struct su_batch *batch, pid_t pid, uid_t to_uid, const char *sctx)
+{
+    int rc = 0;
     struct task_struct *task = find_get_task_by_vpid(pid);
     if (unlikely(!task)) {
         logkfe("no such pid: %d\n", pid);
@@ -134,13 +159,11 @@ int task_su(pid_t pid, uid_t to_uid, const char *sctx)
     }
 
     struct cred *cred = *(struct cred **)((uintptr_t)task + task_struct_offset.cred_offset);
-    su_cred(cred, to_uid);
-    if (sctx && sctx[0]) scontext_changed = !set_security_override_from_ctx(cred, sctx);
+    int scontext_changed = su_batch_cred(batch, cred, to_uid, sctx);
 
     struct cred *real_cred = *(struct cred **)((uintptr_t)task + task_struct_offset.real_cred_offset);
     if (cred != real_cred) {
-        su_cred(real_cred, to_uid);
-        if (sctx && sctx[0]) scontext_changed = scontext_changed && !set_security_override_from_ctx(real_cred, sctx);
+        scontext_changed = su_batch_cred(batch, real_cred, to_uid, sctx) && scontext_changed;
     }
     ext->priv_selinux_allow = !scontext_changed;
 
@@ -149,3 +172,26 @@ int task_su(pid_t pid, uid_t to_uid, const char *sctx)
 out:
     return rc;
 }
+
+// todo: rcu
+int task_su(pid_t pid, uid_t to_uid, const char *sctx)
+{
+    struct su_batch batch = { 0 };
+    return __task_su(&batch, pid, to_uid, sctx);
+}
+
+int tasks_su(const pid_t *pids, int num, uid_t to_uid, const char *sctx)
+{
+    struct su_batch batch = { 0 };
+    int done = 0;
+    int rc = -ESRCH;
+    for (int i = 0; i < num; i++) {
+        // threads may exit between listing and elevating, keep going
+        int ret = __task_su(&batch, pids[i], to_uid, sctx);
+        if (!ret)
+            done++;
+        else
+            rc = ret;
+    }
+    return done ? done : rc;
+}
@@ -0,0 +1,205 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024 bmax121. All Rights Reserved.
+ */
+
+#include <exechook.h>
+#include <kpinit.h>
+#include <ktypes.h>
+#include <hook.h>
+#include <syscall.h>
+#include <log.h>
+#include <linux/err.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <uapi/asm-generic/errno.h>
+
+// One hook on execve/execveat for everyone interested in execs, the filename is copied from user once
+// and argv entries when first asked for, instead of once per consumer.
+
+struct exec_hook
+{
+    exec_hook_before_t before;
+    exec_hook_after_t after;
+    void *udata;
+    int done;
+};
+
+static struct exec_hook exec_hooks[EXEC_HOOK_MAX] = { 0 };
+static int exec_hook_claimed = 0;
+static int exec_hook_num = 0;
+static int exec_hook_alive = 0;
+static int exec_hooked = 0;
+// serializes installing and removing the syscall hooks
+static int exec_hook_lock = 0;
+
+const char *exec_arg(struct exec_args *exec, int n)
+{
+    if (n < 0 || n >= EXEC_ARGV_NUM) return 0;
+    for (int i = exec->argv_copied; i <= n; i++) {
+        exec->argv[i] = 0;
+        exec->argv_copied = i + 1;
+        // stop at the first hole, later entries aren't reachable either
+        if (i > 0 && !exec->argv[i - 1]) continue;
+        const char __user *uarg = get_user_arg_ptr((void *)(uintptr_t)exec->compat, *exec->uargv_p, i);
+        if (!uarg || IS_ERR(uarg)) continue;
+        if (compat_strncpy_from_user(exec->argv_buf[i], uarg, EXEC_ARG_LEN) <= 0) continue;
+        exec->argv[i] = exec->argv_buf[i];
+    }
+    return exec->argv[n];
+}
+
+static void exec_hook_unhook();
+
+static void handle_before_exec(void *fargs, int nr, int compat, char __user **u_filename_p, char __user **uargv_p,
+                               char __user **uenvp_p)
+{
+    struct exec_args exec;
+    exec.fargs = fargs;
+    exec.local = &((hook_fargs0_t *)fargs)->local;
+    exec.nr = nr;
+    exec.compat = compat;
+    exec.u_filename_p = u_filename_p;
+    exec.uargv_p = uargv_p;
+    exec.uenvp_p = uenvp_p;
+    exec.argv_copied = 0;
+    exec.filename_len = 0;
+
+    // consumers registered by deferred init stages must see the first exec from userspace
+    kp_init_wait();
+
+    int num = __atomic_load_n(&exec_hook_num, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < num; i++) {
+        struct exec_hook *hook = &exec_hooks[i];
+        if (hook->done || !hook->before) continue;
+        if (!exec.filename_len) {
+            exec.filename_len = compat_strncpy_from_user(exec.filename, *u_filename_p, sizeof(exec.filename));
+            if (unlikely(exec.filename_len <= 0)) return;
+        }
+        // concurrent execs may both see it returning non-zero, only one drops the alive count
+        if (hook->before(&exec, hook->udata) && !__atomic_exchange_n(&hook->done, 1, __ATOMIC_RELAXED)) {
+            __atomic_sub_fetch(&exec_hook_alive, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void handle_after_exec(void *fargs)
+{
+    hook_local_t *local = &((hook_fargs0_t *)fargs)->local;
+    int num = __atomic_load_n(&exec_hook_num, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < num; i++) {
+        struct exec_hook *hook = &exec_hooks[i];
+        if (hook->after) hook->after(fargs, local, hook->udata);
+    }
+    if (unlikely(!__atomic_load_n(&exec_hook_alive, __ATOMIC_RELAXED))) exec_hook_unhook();
+}
+
+// https://elixir.bootlin.com/linux/v6.1/source/fs/exec.c#L2087
+// SYSCALL_DEFINE3(execve, const char __user *, filename, const char __user *const __user *, argv,
+//                 const char __user *const __user *, envp)
+static void before_execve(hook_fargs3_t *args, void *udata)
+{
+    handle_before_exec(args, __NR_execve, (int)(uintptr_t)udata, syscall_argn_p(args, 0), syscall_argn_p(args, 1),
+                       syscall_argn_p(args, 2));
+}
+
+static void after_execve(hook_fargs3_t *args, void *udata)
+{
+    handle_after_exec(args);
+}
+
+// https://elixir.bootlin.com/linux/v6.1/source/fs/exec.c#L2095
+// SYSCALL_DEFINE5(execveat, int, fd, const char __user *, filename, const char __user *const __user *, argv,
+//                 const char __user *const __user *, envp, int, flags)
+static void before_execveat(hook_fargs5_t *args, void *udata)
+{
+    handle_before_exec(args, __NR_execveat, (int)(uintptr_t)udata, syscall_argn_p(args, 1), syscall_argn_p(args, 2),
+                       syscall_argn_p(args, 3));
+}
+
+static void after_execveat(hook_fargs5_t *args, void *udata)
+{
+    handle_after_exec(args);
+}
+
+static hook_err_t exec_hook_install()
+{
+    hook_err_t ret = 0;
+    hook_err_t rc = HOOK_NO_ERR;
+
+    rc = fp_hook_syscalln(__NR_execve, 3, before_execve, after_execve, (void *)0);
+    log_boot("hook __NR_execve rc: %d\n", rc);
+    ret |= rc;
+
+    rc = fp_hook_syscalln(__NR_execveat, 5, before_execveat, after_execveat, (void *)0);
+    log_boot("hook __NR_execveat rc: %d\n", rc);
+    ret |= rc;
+
+    // #include <asm/unistd32.h>
+
+    // __NR_execve 11
+    rc = fp_hook_compat_syscalln(11, 3, before_execve, after_execve, (void *)1);
+    log_boot("hook 32 __NR_execve rc: %d\n", rc);
+
+    //  __NR_execveat 387
+    rc = fp_hook_compat_syscalln(387, 5, before_execveat, after_execveat, (void *)1);
+    log_boot("hook 32 __NR_execveat rc: %d\n", rc);
+
+    exec_hooked = 1;
+    return ret;
+}
+
+static void exec_hook_unhook()
+{
+    // a register in progress holds the lock and has a live consumer, nothing to remove then
+    if (__atomic_exchange_n(&exec_hook_lock, 1, __ATOMIC_SEQ_CST)) return;
+    if (exec_hooked && !__atomic_load_n(&exec_hook_alive, __ATOMIC_SEQ_CST)) {
+        fp_unhook_syscall(__NR_execve, before_execve, after_execve);
+        fp_unhook_syscall(__NR_execveat, before_execveat, after_execveat);
+        fp_unhook_compat_syscall(11, before_execve, after_execve);
+        fp_unhook_compat_syscall(387, before_execveat, after_execveat);
+        exec_hooked = 0;
+        log_boot("exec hook removed\n");
+    }
+    __atomic_store_n(&exec_hook_lock, 0, __ATOMIC_SEQ_CST);
+}
+
+int exec_hook_register(exec_hook_before_t before, exec_hook_after_t after, void *udata)
+{
+    int idx = __atomic_fetch_add(&exec_hook_claimed, 1, __ATOMIC_RELAXED);
+    if (idx >= EXEC_HOOK_MAX) {
+        __atomic_sub_fetch(&exec_hook_claimed, 1, __ATOMIC_RELAXED);
+        return -ENOMEM;
+    }
+    struct exec_hook *hook = &exec_hooks[idx];
+    hook->before = before;
+    hook->after = after;
+    hook->udata = udata;
+    hook->done = 0;
+    // counted alive before the lock, an unhook that takes the lock later sees it and keeps the hook
+    __atomic_add_fetch(&exec_hook_alive, 1, __ATOMIC_SEQ_CST);
+    // may register while execs are running, entries are published in slot order once filled
+    while (__atomic_load_n(&exec_hook_num, __ATOMIC_ACQUIRE) != idx)
+        asm volatile("yield");
+    __atomic_store_n(&exec_hook_num, idx + 1, __ATOMIC_RELEASE);
+
+    // every earlier consumer finished and the syscalls were unhooked, hook them again for this one
+    while (__atomic_exchange_n(&exec_hook_lock, 1, __ATOMIC_SEQ_CST))
+        asm volatile("yield");
+    hook_err_t err = exec_hooked ? HOOK_NO_ERR : exec_hook_install();
+    __atomic_store_n(&exec_hook_lock, 0, __ATOMIC_SEQ_CST);
+    if (err) {
+        // published but possibly half hooked, retire the slot
+        __atomic_store_n(&hook->after, 0, __ATOMIC_RELAXED);
+        if (!__atomic_exchange_n(&hook->done, 1, __ATOMIC_RELAXED)) {
+            __atomic_sub_fetch(&exec_hook_alive, 1, __ATOMIC_SEQ_CST);
+        }
+        return -EFAULT;
+    }
+    return 0;
+}
+
+int exec_hook_init()
+{
+    return exec_hook_install();
+}
@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024 bmax121. All Rights Reserved.
+ */
+
+#include <kpinit.h>
+#include <log.h>
+#include <bootprof.h>
+#include <linux/err.h>
+#include <linux/kthread.h>
+#include <uapi/asm-generic/errno.h>
+
+// Stages are claimed with a cmpxchg on their state, so the kp_init thread and a first user can both try to run
+// the same deferred stage, one runs it and the other sleeps until it is done.
+
+#define STAGE_PENDING 0
+#define STAGE_RUNNING 1
+#define STAGE_DONE 2
+
+static struct kp_init_stage *init_stages = 0;
+static int init_stage_num = 0;
+static int deferred_done = 0;
+
+static void stage_wait_done(struct kp_init_stage *stage)
+{
+    while (__atomic_load_n(&stage->state, __ATOMIC_ACQUIRE) != STAGE_DONE) {
+        kthread_sleep(1);
+    }
+}
+
+static void stage_run(struct kp_init_stage *stage)
+{
+    int state = STAGE_PENDING;
+    if (!__atomic_compare_exchange_n(&stage->state, &state, STAGE_RUNNING, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        if (state == STAGE_RUNNING) stage_wait_done(stage);
+        return;
+    }
+
+    int rc = 0;
+    for (int i = 0; i < init_stage_num; i++) {
+        if (!(stage->deps & KP_INIT_DEP(i))) continue;
+        struct kp_init_stage *dep = &init_stages[i];
+        if (__atomic_load_n(&dep->state, __ATOMIC_ACQUIRE) != STAGE_DONE) stage_run(dep);
+        if (dep->rc) {
+            rc = -EAGAIN;
+            break;
+        }
+    }
+    if (!rc) {
+        int idx = boot_stage_begin(stage->name);
+        rc = stage->init();
+        boot_stage_end(idx, rc);
+        log_boot("%s done: %d\n", stage->name, rc);
+    } else {
+        log_boot("%s skipped\n", stage->name);
+    }
+    stage->rc = rc;
+    __atomic_store_n(&stage->state, STAGE_DONE, __ATOMIC_RELEASE);
+}
+
+static void run_deferred()
+{
+    for (int i = 0; i < init_stage_num; i++) {
+        if (init_stages[i].deferred) stage_run(&init_stages[i]);
+    }
+    __atomic_store_n(&deferred_done, 1, __ATOMIC_RELEASE);
+}
+
+void kp_init_run(struct kp_init_stage *stages, int num)
+{
+    if (num > KP_INIT_STAGE_MAX) num = KP_INIT_STAGE_MAX;
+    init_stages = stages;
+    init_stage_num = num;
+    for (int i = 0; i < num; i++) {
+        if (!stages[i].deferred) stage_run(&stages[i]);
+    }
+}
+
+static int kp_init_thread(void *data)
+{
+    run_deferred();
+    return 0;
+}
+
+void kp_init_defer()
+{
+    if (__atomic_load_n(&deferred_done, __ATOMIC_ACQUIRE)) return;
+    struct task_struct *thread = ERR_PTR(-EAGAIN);
+    if (kthreadd_ready()) thread = kthread_run(kp_init_thread, 0, "kp_init");
+    if (IS_ERR(thread)) {
+        log_boot("start kp_init thread error: %d, init synchronously\n", PTR_ERR(thread));
+        run_deferred();
+    }
+}
+
+void kp_init_wait()
+{
+    if (likely(__atomic_load_n(&deferred_done, __ATOMIC_ACQUIRE))) return;
+    if (!init_stages) return;
+    run_deferred();
+}
@@ -7,6 +7,11 @@
 #include <linux/sched/mm.h>
 #include <pgtable.h>
 #include <linux/err.h>
+#include <linux/rcupdate.h>
+#include <linux/vmalloc.h>
+#include <linux/rwsem.h>
+#include <kputils.h>
+#include <asm/current.h>
 
 //void free_task(struct task_struct *tsk)
 // EXPORT_SYMBOL(free_task);
@@ -57,46 +62,171 @@ uint64_t *local_pgtable_entry(uint64_t pgd, uint64_t va)
     return (uint64_t *)pxd_entry_va;
 }
 
-phys_addr_t pid_virt_to_phys(pid_t pid, uintptr_t vaddr)
+struct pmem_walk
+{
+    struct pmem_extent *extents;
+    int num;
+    int max;
+    uint64_t next;
+};
+
+static int pmem_walk_emit(struct pmem_walk *walk, uint64_t va, uint64_t pa, uint64_t size)
 {
-    if (mm_struct_offset.pgd_offset < 0) {
-        return -EFAULT;
+    if (walk->num) {
+        struct pmem_extent *last = &walk->extents[walk->num - 1];
+        if (last->vaddr + last->size == va && last->paddr + last->size == pa) {
+            last->size += size;
+            return 0;
+        }
     }
+    if (walk->num >= walk->max) return -ENOBUFS;
+    struct pmem_extent *extent = &walk->extents[walk->num++];
+    extent->vaddr = va;
+    extent->paddr = pa;
+    extent->size = size;
+    return 0;
+}
 
+// walk [start, end) of one table at level lv once, descending into next level tables and
+// taking block mappings whole, walk->next is the first va not reported yet
+static int pmem_walk_level(struct pmem_walk *walk, uint64_t table_va, int64_t lv, uint64_t start, uint64_t end)
+{
+    uint64_t pxd_bits = page_shift - 3;
+    uint64_t pxd_shift = pxd_bits * (3 - lv) + page_shift;
+    uint64_t pxd_size = 1ul << pxd_shift;
+    uint64_t pxd_mask = (1ul << pxd_bits) - 1;
     int rc = 0;
 
-    logkd("pid: %llx, vaddr: %llx\n", pid, vaddr);
-    logkd("aaaa %llx\n", kfunc(find_get_task_by_vpid));
+    for (uint64_t va = start; va < end;) {
+        uint64_t next = (va & ~(pxd_size - 1)) + pxd_size;
+        if (next > end) next = end;
+        uint64_t desc = ((uint64_t *)table_va)[(va >> pxd_shift) & pxd_mask];
+        uint64_t type = desc & 0b11;
+        if (lv < 3 && type == 0b11) { // table
+            uint64_t pa = desc & (((1ul << (48 - page_shift)) - 1) << page_shift);
+            rc = pmem_walk_level(walk, phys_to_virt(pa), lv + 1, va, next);
+        } else if ((lv < 3 && type == 0b01) || (lv == 3 && type == 0b11)) { // block or page
+            uint64_t pa = desc & (((1ul << (48 - pxd_shift)) - 1) << pxd_shift);
+            rc = pmem_walk_emit(walk, va, pa + (va & (pxd_size - 1)), next - va);
+        } // invalid, not mapped
+        if (rc) return rc;
+        walk->next = next;
+        va = next;
+    }
+    return rc;
+}
 
-    // struct task_struct *task = find_get_task_by_vpid(pid);
+static struct mm_struct *pid_get_mm(pid_t pid)
+{
+    rcu_read_lock();
     struct task_struct *task = find_task_by_vpid(pid);
-    if (!task) {
-        logkfe("no such pid: %d\n", pid);
-        return -ESRCH;
-    }
+    struct mm_struct *mm = task ? get_task_mm(task) : 0;
+    rcu_read_unlock();
+    if (!task) logkfe("no such pid: %d\n", pid);
+    if (IS_ERR(mm)) mm = 0;
+    return mm;
+}
 
-    logkd("task: %llx\n", task);
+long pid_virt_to_phys_range(pid_t pid, uintptr_t start, size_t size, struct pmem_extent *extents, int max,
+                            uintptr_t *next)
+{
+    if (mm_struct_offset.pgd_offset < 0) return -EFAULT;
+    if (mm_struct_offset.mmap_lock_offset < 0 || !kfunc(down_read) || !kfunc(up_read)) return -ENOSYS;
+    if (max <= 0) return -EINVAL;
+
+    uint64_t end = start + size;
+    uint64_t va_end = 1ul << va_bits;
+    if (end < start || end > va_end) end = va_end;
+    if (start >= end) return -EINVAL;
+
+    struct mm_struct *mm = pid_get_mm(pid);
+    if (!mm) return -ESRCH;
+
+    // one mm reference and one walk from the top for the whole range,
+    // the mmap read lock keeps munmap and mremap from freeing the tables under the walk
+    struct pmem_walk walk = { .extents = extents, .num = 0, .max = max, .next = start };
+    struct rw_semaphore *mmap_lock = (struct rw_semaphore *)((uintptr_t)mm + mm_struct_offset.mmap_lock_offset);
+    uintptr_t pgd = *(uintptr_t *)((uintptr_t)mm + mm_struct_offset.pgd_offset);
+    down_read(mmap_lock);
+    int rc = pmem_walk_level(&walk, pgd, 4 - page_level, start, end);
+    up_read(mmap_lock);
+    mmput(mm);
 
-    struct mm_struct *mm = get_task_mm(task);
-    if (!mm || IS_ERR(mm)) {
-        // todo
-    }
+    if (rc && rc != -ENOBUFS) return rc;
+    if (next) *next = walk.next;
+    return walk.num;
+}
 
-    logkd("mm: %llx\n", mm);
+phys_addr_t pid_virt_to_phys(pid_t pid, uintptr_t vaddr)
+{
+    struct pmem_extent extent;
+    // 0 for not mapped or any error, a negative errno would read as a valid high address
+    if (mm_struct_offset.mmap_lock_offset >= 0 && kfunc(down_read) && kfunc(up_read)) {
+        if (pid_virt_to_phys_range(pid, vaddr, 1, &extent, 1, 0) <= 0) return 0;
+        return extent.paddr;
+    }
 
+    // no mmap lock found, one address walked without it like before the range walk existed,
+    // a racing munmap can change the tables under it, the result is a snapshot
+    if (mm_struct_offset.pgd_offset < 0 || vaddr >= 1ul << va_bits) return 0;
+    struct mm_struct *mm = pid_get_mm(pid);
+    if (!mm) return 0;
+    struct pmem_walk walk = { .extents = &extent, .num = 0, .max = 1, .next = vaddr };
     uintptr_t pgd = *(uintptr_t *)((uintptr_t)mm + mm_struct_offset.pgd_offset);
-    logkd("pgd: %llx\n", pgd);
-
-    for (uintptr_t i = pgd; i < pgd + 512 * 8; i += 8) {
-        logkd("pgd i: %llx, val: %llx\n", i, *(uintptr_t *)i);
-    }
+    pmem_walk_level(&walk, pgd, 4 - page_level, vaddr, vaddr + 1);
+    mmput(mm);
+    return walk.num ? extent.paddr : 0;
+}
 
-    uintptr_t *entry = local_pgtable_entry(pgd, vaddr);
-    logkd("entry: %llx\n", entry);
-    logkd("entry value: %llx\n", *(uintptr_t *)entry);
+#define PMEM_FOLL_WRITE 0x01
 
-    // remap_pfn_range or direct modify pgtable
+// Streams through both iovec lists like process_vm_readv, bounced through one page sized kernel buffer.
+// The target is accessed with access_remote_vm, which takes the mmap lock and faults pages in, the page table walk
+// above can't be used for writes, a page may be freed and reused between the walk and the copy.
+// The local side is the caller's own memory and goes through the uaccess helpers.
+long pid_access_vm(pid_t pid, const struct pmem_iovec *local, int local_cnt, const struct pmem_iovec *remote,
+                   int remote_cnt, int write)
+{
+    if (!kfunc(access_remote_vm)) return -ENOSYS;
+    if (local_cnt <= 0 || remote_cnt <= 0) return -EINVAL;
+
+    struct mm_struct *mm = pid_get_mm(pid);
+    if (!mm) return -ESRCH;
+    long rc = -ENOMEM;
+    void *buf = vmalloc(page_size);
+    if (!buf) goto out;
+
+    long total = 0;
+    int li = 0, ri = 0;
+    uint64_t loff = 0, roff = 0;
+    while (li < local_cnt && ri < remote_cnt) {
+        if (loff >= local[li].len) {
+            li++, loff = 0;
+            continue;
+        }
+        if (roff >= remote[ri].len) {
+            ri++, roff = 0;
+            continue;
+        }
+        uint64_t n = local[li].len - loff;
+        if (n > remote[ri].len - roff) n = remote[ri].len - roff;
+        // compat_copy_to_user may bounce through a page sized buffer of its own
+        if (n > page_size) n = page_size;
+        void __user *laddr = (void __user *)(uintptr_t)(local[li].base + loff);
+        uint64_t raddr = remote[ri].base + roff;
+
+        int got = write ? compat_copy_from_user(buf, laddr, n) : access_remote_vm(mm, raddr, buf, n, 0);
+        if (got <= 0) break;
+        int put = write ? access_remote_vm(mm, raddr, buf, got, PMEM_FOLL_WRITE) : compat_copy_to_user(laddr, buf, got);
+        if (put > 0) total += put;
+        if (put != n) break;
+        loff += n;
+        roff += n;
+    }
+    rc = total ? total : -EFAULT;
 
+out:
+    if (buf) vfree(buf);
     mmput(mm);
     return rc;
-}
\ No newline at end of file
+}
@@ -0,0 +1,201 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024 bmax121. All Rights Reserved.
+ */
+
+#include "accctl.h"
+
+#include <ktypes.h>
+#include <kpmalloc.h>
+#include <baselib.h>
+#include <security/selinux/include/classmap.h>
+#include <log.h>
+#include <linux/spinlock.h>
+#include <linux/rcupdate.h>
+#include <uapi/asm-generic/errno.h>
+
+// (ssid, tsid, tclass) -> extra allowed permission bits, consulted from avc_denied so a tool can be given a few
+// permissions instead of running with selinux_allow. Readers are under rcu, writers serialize on grant_lock.
+
+#define GRANT_HASH_BITS 8
+#define GRANT_HASH_SIZE (1 << GRANT_HASH_BITS)
+
+struct selinux_grant_entry
+{
+    struct selinux_grant_entry *next;
+    u32 ssid;
+    u32 tsid;
+    u16 tclass;
+    u32 perms;
+};
+
+static struct selinux_grant_entry *grant_table[GRANT_HASH_SIZE] = { 0 };
+static spinlock_t grant_lock;
+static int grant_num = 0;
+
+static inline u32 grant_hash(u32 ssid, u32 tsid, u16 tclass)
+{
+    u32 hash = ssid * 0x9e3779b1 ^ tsid * 0x85ebca77 ^ tclass * 0xc2b2ae3d;
+    return (hash ^ (hash >> 16)) & (GRANT_HASH_SIZE - 1);
+}
+
+static struct selinux_grant_entry **grant_find(u32 ssid, u32 tsid, u16 tclass)
+{
+    struct selinux_grant_entry **pos = &grant_table[grant_hash(ssid, tsid, tclass)];
+    for (; *pos; pos = &(*pos)->next) {
+        struct selinux_grant_entry *entry = *pos;
+        if (entry->ssid == ssid && entry->tsid == tsid && entry->tclass == tclass) return pos;
+    }
+    return 0;
+}
+
+u32 selinux_grant_lookup(u32 ssid, u32 tsid, u16 tclass)
+{
+    if (likely(!__atomic_load_n(&grant_num, __ATOMIC_RELAXED))) return 0;
+
+    u32 perms = 0;
+    rcu_read_lock();
+    struct selinux_grant_entry *entry = rcu_dereference_raw(grant_table[grant_hash(ssid, tsid, tclass)]);
+    for (; entry; entry = rcu_dereference_raw(entry->next)) {
+        if (entry->ssid == ssid && entry->tsid == tsid && entry->tclass == tclass) {
+            perms = __atomic_load_n(&entry->perms, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    rcu_read_unlock();
+    return perms;
+}
+
+int selinux_grant_add(u32 ssid, u32 tsid, u16 tclass, u32 perms)
+{
+    if (!ssid || !tsid || !tclass || !perms) return -EINVAL;
+
+    struct selinux_grant_entry *new = kp_malloc(sizeof(*new));
+    if (!new) return -ENOMEM;
+    new->ssid = ssid;
+    new->tsid = tsid;
+    new->tclass = tclass;
+    new->perms = perms;
+
+    spin_lock(&grant_lock);
+    struct selinux_grant_entry **pos = grant_find(ssid, tsid, tclass);
+    if (pos) {
+        __atomic_or_fetch(&(*pos)->perms, perms, __ATOMIC_RELAXED);
+    } else {
+        struct selinux_grant_entry **head = &grant_table[grant_hash(ssid, tsid, tclass)];
+        new->next = *head;
+        rcu_assign_pointer(*head, new);
+        __atomic_add_fetch(&grant_num, 1, __ATOMIC_RELAXED);
+        new = 0;
+    }
+    spin_unlock(&grant_lock);
+
+    if (new) kp_free(new);
+    logkfi("ssid: %x, tsid: %x, tclass: %d, perms: %x\n", ssid, tsid, tclass, perms);
+    return 0;
+}
+
+int selinux_grant_remove(u32 ssid, u32 tsid, u16 tclass, u32 perms)
+{
+    struct selinux_grant_entry *old = 0;
+
+    spin_lock(&grant_lock);
+    struct selinux_grant_entry **pos = grant_find(ssid, tsid, tclass);
+    if (pos) {
+        struct selinux_grant_entry *entry = *pos;
+        if (perms && (entry->perms & ~perms)) {
+            __atomic_and_fetch(&entry->perms, ~perms, __ATOMIC_RELAXED);
+        } else {
+            rcu_assign_pointer(*pos, entry->next);
+            __atomic_sub_fetch(&grant_num, 1, __ATOMIC_RELAXED);
+            old = entry;
+        }
+    }
+    spin_unlock(&grant_lock);
+
+    if (!pos) return -ENOENT;
+    if (old) {
+        synchronize_rcu();
+        kp_free(old);
+    }
+    logkfi("ssid: %x, tsid: %x, tclass: %d, perms: %x\n", ssid, tsid, tclass, perms);
+    return 0;
+}
+
+int selinux_grant_clear()
+{
+    struct selinux_grant_entry *list = 0;
+
+    spin_lock(&grant_lock);
+    int num = grant_num;
+    for (int i = 0; i < GRANT_HASH_SIZE; i++) {
+        struct selinux_grant_entry *entry = grant_table[i];
+        rcu_assign_pointer(grant_table[i], 0);
+        // a reader still walking this chain may step onto other dying entries, harmless
+        while (entry) {
+            struct selinux_grant_entry *next = entry->next;
+            entry->next = list;
+            list = entry;
+            entry = next;
+        }
+    }
+    __atomic_store_n(&grant_num, 0, __ATOMIC_RELAXED);
+    spin_unlock(&grant_lock);
+
+    if (!num) return 0;
+    synchronize_rcu();
+    while (list) {
+        struct selinux_grant_entry *next = list->next;
+        kp_free(list);
+        list = next;
+    }
+    logkfi("cleared %d\n", num);
+    return num;
+}
+
+// avc_denied works on the kernel's own class values and permission bits, the order of secclass_map,
+// not on the policy's, security_compute_av maps between the two and policy order differs on Android.
+// Class value n is secclass_map[n - 1], permission bit i is its perms[i].
+int selinux_grant_resolve(const char *tclass, const char *perms, u16 *out_class, u32 *out_perms)
+{
+    if (!kvar(secclass_map)) return -ENOSYS;
+    const struct security_class_mapping *map = kvar_val(secclass_map);
+    int c = 0;
+    for (; map[c].name; c++) {
+        if (!lib_strcmp(map[c].name, tclass)) break;
+    }
+    if (!map[c].name) {
+        logkfw("unknown class: %s\n", tclass);
+        return -ENOENT;
+    }
+
+    u32 bits = 0;
+    const char *const *names = map[c].perms;
+    for (const char *p = perms; *p;) {
+        const char *name = p;
+        while (*p && *p != ' ' && *p != ',')
+            p++;
+        int len = p - name;
+        while (*p == ' ' || *p == ',')
+            p++;
+        if (!len) continue;
+        int i = 0;
+        for (; i < sizeof(u32) * 8 && names[i]; i++) {
+            if (!lib_strncmp(names[i], name, len) && !names[i][len]) break;
+        }
+        if (i >= sizeof(u32) * 8 || !names[i]) {
+            logkfw("unknown permission of %s in: %s\n", tclass, perms);
+            return -ENOENT;
+        }
+        bits |= 1u << i;
+    }
+    *out_class = c + 1;
+    *out_perms = bits;
+    return 0;
+}
+
+int selinux_grant_init()
+{
+    spin_lock_init(&grant_lock);
+    return 0;
+}
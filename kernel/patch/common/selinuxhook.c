@@ -86,6 +86,23 @@ static int avc_denied_replace(struct selinux_state *_state, void *_ssid, void *_
         avd->auditdeny = 0;
         return 0;
     }
+
+    // without selinux_state (< 4.17 and >= 6.4) every argument is shifted left by one
+    struct av_decision *avd = _avd;
+    u32 ssid = (u32)(uint64_t)_ssid, tsid = (u32)(uint64_t)_tsid, tclass = (u16)(uint64_t)_tclass;
+    u32 requested = (u32)(uint64_t)_requested;
+    if ((uint64_t)_state <= 0xffffffffL) {
+        avd = (struct av_decision *)_flags;
+        ssid = (u32)(uint64_t)_state, tsid = (u32)(uint64_t)_ssid, tclass = (u16)(uint64_t)_tsid;
+        requested = (u32)(uint64_t)_tclass;
+    }
+    u32 granted = selinux_grant_lookup(ssid, tsid, tclass);
+    if (unlikely(granted) && !(requested & ~(avd->allowed | granted))) {
+        avd->allowed |= granted;
+        avd->auditallow &= ~granted;
+        return 0;
+    }
+
     int rc = avc_denied_backup(_state, _ssid, _tsid, _tclass, _requested, _driver, _xperm, _flags, _avd);
     return rc;
 }
@@ -299,6 +316,8 @@ static int slow_avc_audit_replace(struct selinux_state *_state, void *_ssid, voi
 
 int selinux_hook_install()
 {
+    selinux_grant_init();
+
     unsigned long avc_denied_addr = get_preset_patch_sym()->avc_denied;
     if (avc_denied_addr) {
         hook_err_t err = hook((void *)avc_denied_addr, (void *)avc_denied_replace, (void **)&avc_denied_backup);
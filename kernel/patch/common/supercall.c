@@ -25,10 +25,15 @@
 #include <kputils.h>
 #include <linux/err.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <kputils.h>
 #include <pidmem.h>
+#include <kpmalloc.h>
+#include <bootprof.h>
+#include <kpinit.h>
 #include <predata.h>
 #include <linux/random.h>
+#include <security/selinux/include/security.h>
 
 #define MAX_KEY_LEN 128
 
@@ -58,6 +63,33 @@ static long call_bootlog()
     return 0;
 }
 
+static long call_mem_stat(struct kp_mem_stat *__user ustat)
+{
+    struct kp_mem_stat *stat = vmalloc(sizeof(struct kp_mem_stat));
+    if (!stat) return -ENOMEM;
+    memset(stat, 0, sizeof(struct kp_mem_stat));
+    kp_heap_stat(0, &stat->rw);
+    kp_heap_stat(1, &stat->exec);
+    hook_mem_stat(&stat->hook);
+    stat->mod_num = get_module_mem_stat(stat->mods, KP_MEM_STAT_MOD_MAX);
+    long rc = 0;
+    if (compat_copy_to_user(ustat, stat, sizeof(struct kp_mem_stat)) != sizeof(struct kp_mem_stat)) rc = -EFAULT;
+    vfree(stat);
+    return rc;
+}
+
+static long call_boot_prof(struct kp_boot_prof *__user uprof)
+{
+    struct kp_boot_prof *prof = vmalloc(sizeof(struct kp_boot_prof));
+    if (!prof) return -ENOMEM;
+    memset(prof, 0, sizeof(struct kp_boot_prof));
+    boot_prof_get(prof);
+    long rc = 0;
+    if (compat_copy_to_user(uprof, prof, sizeof(struct kp_boot_prof)) != sizeof(struct kp_boot_prof)) rc = -EFAULT;
+    vfree(prof);
+    return rc;
+}
+
 static long call_panic()
 {
     unsigned long panic_addr = kallsyms_lookup_name("panic");
@@ -74,6 +106,23 @@ static long call_klog(const char __user *arg1)
     return 0;
 }
 
+static long call_klog_read(int which, char *__user ubuf, int len, uint64_t *__user upos)
+{
+    if (which != SUPERCALL_KLOG_BOOT && which != SUPERCALL_KLOG_RUNTIME) return -EINVAL;
+    if (len <= 0) return -EINVAL;
+    if (len > SUPERCALL_KLOG_READ_MAX) len = SUPERCALL_KLOG_READ_MAX;
+    // upos is optional, callers without it always read from the first boot record
+    uint64_t pos = 0;
+    if (upos && compat_copy_from_user(&pos, upos, sizeof(pos)) != sizeof(pos)) return -EFAULT;
+    char *buf = vmalloc(len);
+    if (!buf) return -ENOMEM;
+    int rc = klog_read(which, &pos, buf, len);
+    if (compat_copy_to_user(ubuf, buf, rc + 1) != rc + 1) rc = -EFAULT;
+    if (rc >= 0 && upos && compat_copy_to_user(upos, &pos, sizeof(pos)) != sizeof(pos)) rc = -EFAULT;
+    vfree(buf);
+    return rc;
+}
+
 static long call_kpm_load(const char __user *arg1, const char *__user arg2, void *__user reserved)
 {
     char path[1024], args[KPM_ARGS_LEN];
@@ -100,6 +149,15 @@ static long call_kpm_unload(const char *__user arg1, void *__user reserved)
     return unload_module(name, reserved);
 }
 
+static long call_kpm_upgrade(const char __user *arg1, const char *__user arg2, void *__user reserved)
+{
+    char path[1024], args[KPM_ARGS_LEN];
+    long pathlen = compat_strncpy_from_user(path, arg1, sizeof(path));
+    if (unlikely(pathlen <= 0)) return -EINVAL;
+    long arglen = compat_strncpy_from_user(args, arg2, sizeof(args));
+    return upgrade_module_path(path, arglen <= 0 ? 0 : args, reserved);
+}
+
 static long call_kpm_nums()
 {
     return get_module_nums();
@@ -149,6 +207,53 @@ static long call_su_task(pid_t pid, struct su_profile *__user uprofile)
     return rc;
 }
 
+static long call_su_threads(pid_t *__user upids, int num, struct su_profile *__user uprofile)
+{
+    if (num <= 0 || num > SUPERCALL_SU_THREADS_MAX) return -EINVAL;
+    pid_t *pids = memdup_user(upids, num * sizeof(pid_t));
+    if (!pids || IS_ERR(pids)) return PTR_ERR(pids);
+    struct su_profile *profile = memdup_user(uprofile, sizeof(struct su_profile));
+    if (!profile || IS_ERR(profile)) {
+        kvfree(pids);
+        return PTR_ERR(profile);
+    }
+    profile->scontext[sizeof(profile->scontext) - 1] = '\0';
+    int rc = tasks_su(pids, num, profile->to_uid, profile->scontext);
+    kvfree(profile);
+    kvfree(pids);
+    return rc;
+}
+
+static long call_selinux_grant(struct selinux_grant *__user ugrant, int grant)
+{
+    struct selinux_grant *g = memdup_user(ugrant, sizeof(struct selinux_grant));
+    if (!g || IS_ERR(g)) return PTR_ERR(g);
+    g->scontext[sizeof(g->scontext) - 1] = '\0';
+    g->tcontext[sizeof(g->tcontext) - 1] = '\0';
+    g->tclass[sizeof(g->tclass) - 1] = '\0';
+    g->perms[sizeof(g->perms) - 1] = '\0';
+
+    long rc = -ENOSYS;
+    u32 ssid = 0, tsid = 0, perms = 0;
+    u16 tclass = 0;
+    if (!kfunc(security_context_to_sid)) goto out;
+    rc = selinux_grant_resolve(g->tclass, g->perms, &tclass, &perms);
+    if (rc) goto out;
+    // no gfp flags, they differ between versions and the sidtab rarely needs to allocate here
+    security_context_to_sid(g->scontext, strlen(g->scontext), &ssid, 0);
+    security_context_to_sid(g->tcontext, strlen(g->tcontext), &tsid, 0);
+    rc = -EINVAL;
+    if (!ssid || !tsid) goto out;
+
+    if (grant)
+        rc = selinux_grant_add(ssid, tsid, tclass, perms);
+    else
+        rc = selinux_grant_remove(ssid, tsid, tclass, perms);
+out:
+    kvfree(g);
+    return rc;
+}
+
 static long call_skey_get(char *__user out_key, int out_len)
 {
     const char *key = get_superkey();
@@ -178,14 +283,71 @@ static unsigned long call_pid_virt_to_phys(pid_t pid, uintptr_t vaddr)
     return pid_virt_to_phys(pid, vaddr);
 }
 
+static long call_pid_virt_to_phys_range(pid_t pid, struct pmem_range *__user urange, struct pmem_extent *__user uextents,
+                                        int max)
+{
+    if (max <= 0) return -EINVAL;
+    if (max > SUPERCALL_MEM_EXTENTS_MAX) max = SUPERCALL_MEM_EXTENTS_MAX;
+    struct pmem_range *range = memdup_user(urange, sizeof(struct pmem_range));
+    if (!range || IS_ERR(range)) return PTR_ERR(range);
+    long rc = -ENOMEM;
+    struct pmem_extent *extents = vmalloc(max * sizeof(struct pmem_extent));
+    if (!extents) goto out;
+    uintptr_t next = range->start;
+    rc = pid_virt_to_phys_range(pid, range->start, range->size, extents, max, &next);
+    if (rc < 0) goto out;
+    range->next = next;
+    int len = rc * sizeof(struct pmem_extent);
+    if (compat_copy_to_user(urange, range, sizeof(struct pmem_range)) != sizeof(struct pmem_range) ||
+        compat_copy_to_user(uextents, extents, len) != len)
+        rc = -EFAULT;
+out:
+    if (extents) vfree(extents);
+    kvfree(range);
+    return rc;
+}
+
+static long call_pid_access_vm(pid_t pid, struct pmem_rw *__user urw, int write)
+{
+    struct pmem_rw *rw = memdup_user(urw, sizeof(struct pmem_rw));
+    if (!rw || IS_ERR(rw)) return PTR_ERR(rw);
+    long rc = -EINVAL;
+    struct pmem_iovec *local = 0, *remote = 0;
+    if (!rw->local_cnt || rw->local_cnt > SUPERCALL_MEM_IOV_MAX) goto out;
+    if (!rw->remote_cnt || rw->remote_cnt > SUPERCALL_MEM_IOV_MAX) goto out;
+
+    local = memdup_user((void *__user)rw->local_iov, rw->local_cnt * sizeof(struct pmem_iovec));
+    if (!local || IS_ERR(local)) {
+        rc = PTR_ERR(local);
+        local = 0;
+        goto out;
+    }
+    remote = memdup_user((void *__user)rw->remote_iov, rw->remote_cnt * sizeof(struct pmem_iovec));
+    if (!remote || IS_ERR(remote)) {
+        rc = PTR_ERR(remote);
+        remote = 0;
+        goto out;
+    }
+    rc = pid_access_vm(pid, local, rw->local_cnt, remote, rw->remote_cnt, write);
+out:
+    if (remote) kvfree(remote);
+    if (local) kvfree(local);
+    kvfree(rw);
+    return rc;
+}
+
 static long supercall(long cmd, long arg1, long arg2, long arg3, long arg4)
 {
+    kp_init_wait();
+
     switch (cmd) {
     case SUPERCALL_HELLO:
         logki(SUPERCALL_HELLO_ECHO "\n");
         return SUPERCALL_HELLO_MAGIC;
     case SUPERCALL_KLOG:
         return call_klog((const char *__user)arg1);
+    case SUPERCALL_KLOG_READ:
+        return call_klog_read((int)arg1, (char *__user)arg2, (int)arg3, (uint64_t *__user)arg4);
     case SUPERCALL_KERNELPATCH_VER:
         return kpver;
     case SUPERCALL_KERNEL_VER:
@@ -207,12 +369,21 @@ static long supercall(long cmd, long arg1, long arg2, long arg3, long arg4)
         return call_su((struct su_profile * __user) arg1);
     case SUPERCALL_SU_TASK:
         return call_su_task((pid_t)arg1, (struct su_profile * __user) arg2);
+    case SUPERCALL_SU_THREADS:
+        return call_su_threads((pid_t * __user) arg1, (int)arg2, (struct su_profile * __user) arg3);
+    }
+
+    if (cmd >= SUPERCALL_KPM_LOAD && cmd <= SUPERCALL_KPM_INFO) async_kpm_wait();
+
+    switch (cmd) {
     case SUPERCALL_KPM_LOAD:
         return call_kpm_load((const char *__user)arg1, (const char *__user)arg2, (void *__user)arg3);
     case SUPERCALL_KPM_UNLOAD:
         return call_kpm_unload((const char *__user)arg1, (void *__user)arg2);
     case SUPERCALL_KPM_CONTROL:
         return call_kpm_control((const char *__user)arg1, (const char *__user)arg2, (char *__user)arg3, (int)arg4);
+    case SUPERCALL_KPM_UPGRADE:
+        return call_kpm_upgrade((const char *__user)arg1, (const char *__user)arg2, (void *__user)arg3);
     case SUPERCALL_KPM_NUMS:
         return call_kpm_nums();
     case SUPERCALL_KPM_LIST:
@@ -221,7 +392,24 @@ static long supercall(long cmd, long arg1, long arg2, long arg3, long arg4)
         return call_kpm_info((const char *__user)arg1, (char *__user)arg2, (int)arg3);
     case SUPERCALL_MEM_PHYS:
         return call_pid_virt_to_phys((pid_t)arg1, (uintptr_t)arg2);
-
+    case SUPERCALL_MEM_PHYS_RANGE:
+        return call_pid_virt_to_phys_range((pid_t)arg1, (struct pmem_range * __user) arg2,
+                                           (struct pmem_extent * __user) arg3, (int)arg4);
+    case SUPERCALL_MEM_READ:
+        return call_pid_access_vm((pid_t)arg1, (struct pmem_rw * __user) arg2, 0);
+    case SUPERCALL_MEM_WRITE:
+        return call_pid_access_vm((pid_t)arg1, (struct pmem_rw * __user) arg2, 1);
+    case SUPERCALL_SELINUX_GRANT:
+        return call_selinux_grant((struct selinux_grant * __user) arg1, 1);
+    case SUPERCALL_SELINUX_REVOKE:
+        return call_selinux_grant((struct selinux_grant * __user) arg1, 0);
+    case SUPERCALL_SELINUX_GRANT_CLEAR:
+        return selinux_grant_clear();
+
+    case SUPERCALL_BOOT_PROF:
+        return call_boot_prof((struct kp_boot_prof * __user) arg1);
+    case SUPERCALL_MEM_STAT:
+        return call_mem_stat((struct kp_mem_stat * __user) arg1);
     case SUPERCALL_BOOTLOG:
         return call_bootlog();
     case SUPERCALL_PANIC:
@@ -20,6 +20,69 @@
 #include <baselib.h>
 #include <uapi/asm-generic/errno.h>
 #include <predata.h>
+#include <symbol.h>
+#include <linux/spinlock.h>
+#include <linux/rcupdate.h>
+#include <linux/vmalloc.h>
+#include <linux/string.h>
+#include <exechook.h>
+
+static int task_ext_data_used = 0;
+static uint64_t task_ext_inherit_mask = 0; // one bit per data word
+static spinlock_t task_ext_slot_lock;
+
+struct task_ext_slot_owner
+{
+    char key[TASK_EXT_SLOT_KEY_LEN];
+    int slot;
+    int size;
+    int flags;
+};
+
+// every slot is at least one data word
+static struct task_ext_slot_owner task_ext_slot_owners[TASK_EXT_DATA_SIZE / sizeof(uint64_t)] = { 0 };
+static int task_ext_slot_owner_num = 0;
+
+_Static_assert(TASK_EXT_DATA_SIZE / sizeof(uint64_t) <= sizeof(task_ext_inherit_mask) * 8, "inherit mask too small");
+
+int task_ext_slot_alloc(const char *key, int size, int flags)
+{
+    if (size <= 0) return -EINVAL;
+    size = (size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+
+    int slot = -ENOSPC;
+    spin_lock(&task_ext_slot_lock);
+    struct task_ext_slot_owner *owner = 0;
+    for (int i = 0; key && i < task_ext_slot_owner_num; i++) {
+        if (!lib_strncmp(task_ext_slot_owners[i].key, key, TASK_EXT_SLOT_KEY_LEN - 1)) {
+            owner = &task_ext_slot_owners[i];
+            break;
+        }
+    }
+    if (owner) {
+        slot = owner->size == size && owner->flags == flags ? owner->slot : -EEXIST;
+    } else if (task_ext_data_used + size <= TASK_EXT_DATA_SIZE) {
+        slot = task_ext_data_used;
+        task_ext_data_used += size;
+        if (flags & TASK_EXT_SLOT_INHERIT) {
+            for (int i = slot / sizeof(uint64_t); i < task_ext_data_used / sizeof(uint64_t); i++) {
+                task_ext_inherit_mask |= 1ul << i;
+            }
+        }
+        if (key) {
+            owner = &task_ext_slot_owners[task_ext_slot_owner_num++];
+            lib_strlcpy(owner->key, key, sizeof(owner->key));
+            owner->slot = slot;
+            owner->size = size;
+            owner->flags = flags;
+        }
+    }
+    spin_unlock(&task_ext_slot_lock);
+
+    logkfi("key: %s, size: %d, flags: %x, slot: %d\n", key ? key : "", size, flags, slot);
+    return slot;
+}
+KP_EXPORT_SYMBOL(task_ext_slot_alloc);
 
 static inline void prepare_init_ext(struct task_struct *task)
 {
@@ -47,9 +110,241 @@ static void prepare_task_ext(struct task_struct *new, struct task_struct *old)
     new_ext->tgid = __task_pid_nr_ns(new, PIDTYPE_TGID, 0);
     new_ext->selinux_allow = old_ext->selinux_allow;
 
+    for (uint64_t mask = task_ext_inherit_mask; mask; mask &= mask - 1) {
+        int i = __builtin_ctzll(mask);
+        new_ext->data[i] = old_ext->data[i];
+    }
+
     dsb(ishst);
 }
 
+struct task_event_subscriber
+{
+    int mask;
+    task_event_callback_t callback;
+    void *udata;
+};
+
+struct task_event_ring
+{
+    uint32_t head;
+    uint32_t tail;
+    uint32_t dropped;
+    uint32_t seq[TASK_EVENT_QUEUE_SIZE];
+    struct task_event events[TASK_EVENT_QUEUE_SIZE];
+};
+
+static struct task_event_subscriber task_event_subscribers[TASK_EVENT_SUBSCRIBER_MAX] = { 0 };
+static spinlock_t task_event_lock;
+static int task_event_mask = 0;
+static int task_event_queue_mask = 0;
+static struct task_event_ring *task_event_rings = 0;
+static unsigned long cpu_number_addr = 0;
+static int do_exit_hooked = 0;
+static int exec_hook_registered = 0;
+
+static inline int task_event_cpu()
+{
+    if (!cpu_number_addr) return 0;
+    uint64_t el, offset;
+    asm volatile("mrs %0, CurrentEL" : "=r"(el));
+    if (((el >> 2) & 3) == 2) {
+        asm volatile("mrs %0, tpidr_el2" : "=r"(offset));
+    } else {
+        asm volatile("mrs %0, tpidr_el1" : "=r"(offset));
+    }
+    return *(int *)(cpu_number_addr + offset) & (TASK_EVENT_QUEUE_CPUS - 1);
+}
+
+// multiple producers may hit the same ring when preempted, so slots are reserved with cas
+static void task_event_record(const struct task_event *event)
+{
+    struct task_event_ring *ring = &task_event_rings[task_event_cpu()];
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    do {
+        if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= TASK_EVENT_QUEUE_SIZE) {
+            __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&ring->head, &head, head + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    uint32_t idx = head & (TASK_EVENT_QUEUE_SIZE - 1);
+    ring->events[idx] = *event;
+    __atomic_store_n(&ring->seq[idx], head + 1, __ATOMIC_RELEASE);
+}
+
+static void task_event_emit(int type, struct task_struct *task, struct task_event *event)
+{
+    event->type = type;
+    if (task_event_queue_mask & type) task_event_record(event);
+
+    rcu_read_lock();
+    for (int i = 0; i < TASK_EVENT_SUBSCRIBER_MAX; i++) {
+        struct task_event_subscriber *sub = &task_event_subscribers[i];
+        if (!(__atomic_load_n(&sub->mask, __ATOMIC_ACQUIRE) & type)) continue;
+        task_event_callback_t callback = sub->callback;
+        if (callback) callback(type, task, event, sub->udata);
+    }
+    rcu_read_unlock();
+}
+
+int task_event_drain(int cpu, struct task_event *out, int max, int *dropped)
+{
+    if (!task_event_rings || cpu < 0 || cpu >= TASK_EVENT_QUEUE_CPUS) return -EINVAL;
+    struct task_event_ring *ring = &task_event_rings[cpu];
+    uint32_t tail = ring->tail;
+    int n = 0;
+    for (; n < max; n++, tail++) {
+        uint32_t idx = tail & (TASK_EVENT_QUEUE_SIZE - 1);
+        if (__atomic_load_n(&ring->seq[idx], __ATOMIC_ACQUIRE) != tail + 1) break;
+        out[n] = ring->events[idx];
+    }
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    if (dropped) *dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+    return n;
+}
+KP_EXPORT_SYMBOL(task_event_drain);
+
+static void before_do_exit(hook_fargs1_t *args, void *udata)
+{
+    if (!(task_event_mask & TASK_EVENT_EXIT)) return;
+    struct task_event event = { .code = (int32_t)args->arg0 };
+    struct task_ext *ext = current_ext;
+    if (task_ext_valid(ext)) {
+        event.pid = ext->pid;
+        event.tgid = ext->tgid;
+    }
+    task_event_emit(TASK_EVENT_EXIT, current, &event);
+}
+
+static void after_exec_commit(void *fargs, hook_local_t *local, void *udata)
+{
+    if (!(task_event_mask & TASK_EVENT_EXEC)) return;
+    if (((hook_fargs0_t *)fargs)->ret) return;
+    struct task_event event = { 0 };
+    struct task_ext *ext = current_ext;
+    if (task_ext_valid(ext)) {
+        event.pid = ext->pid;
+        event.tgid = ext->tgid;
+    }
+    task_event_emit(TASK_EVENT_EXEC, current, &event);
+}
+
+static void emit_fork_event(struct task_struct *new)
+{
+    if (!(task_event_mask & TASK_EVENT_FORK)) return;
+    struct task_ext *new_ext = get_task_ext(new);
+    struct task_ext *old_ext = current_ext;
+    struct task_event event = { .pid = new_ext->pid, .tgid = new_ext->tgid };
+    if (task_ext_valid(old_ext)) event.parent = old_ext->pid;
+    task_event_emit(TASK_EVENT_FORK, new, &event);
+}
+
+// the exec hook is only joined and do_exit only hooked once someone wants those events,
+// an after-only exec consumer never finishes and would keep the exec hook installed forever
+static int task_event_prepare(int mask)
+{
+    if ((mask & TASK_EVENT_EXEC) && !__atomic_exchange_n(&exec_hook_registered, 1, __ATOMIC_ACQ_REL)) {
+        int rc = exec_hook_register(0, after_exec_commit, 0);
+        logkfi("exec hook register rc: %d\n", rc);
+        if (rc) {
+            __atomic_store_n(&exec_hook_registered, 0, __ATOMIC_RELEASE);
+            return rc;
+        }
+    }
+    if (!(mask & TASK_EVENT_EXIT) || __atomic_load_n(&do_exit_hooked, __ATOMIC_ACQUIRE)) return 0;
+    unsigned long do_exit_addr = kallsyms_lookup_name("do_exit");
+    if (!do_exit_addr) return -ENOENT;
+    hook_err_t err = hook_wrap1((void *)do_exit_addr, before_do_exit, 0, 0);
+    logkfi("hook do_exit: %llx, rc: %d\n", do_exit_addr, err);
+    if (err) return -EFAULT;
+    __atomic_store_n(&do_exit_hooked, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int task_event_subscribe(int mask, task_event_callback_t callback, void *udata)
+{
+    if (!mask || !callback) return -EINVAL;
+    int rc = task_event_prepare(mask);
+    if (rc) return rc;
+
+    rc = -ENOSPC;
+    spin_lock(&task_event_lock);
+    for (int i = 0; i < TASK_EVENT_SUBSCRIBER_MAX; i++) {
+        struct task_event_subscriber *sub = &task_event_subscribers[i];
+        if (sub->callback) continue;
+        sub->callback = callback;
+        sub->udata = udata;
+        __atomic_store_n(&sub->mask, mask, __ATOMIC_RELEASE);
+        task_event_mask |= mask;
+        rc = 0;
+        break;
+    }
+    spin_unlock(&task_event_lock);
+    return rc;
+}
+KP_EXPORT_SYMBOL(task_event_subscribe);
+
+void task_event_unsubscribe(task_event_callback_t callback)
+{
+    spin_lock(&task_event_lock);
+    int mask = task_event_queue_mask;
+    for (int i = 0; i < TASK_EVENT_SUBSCRIBER_MAX; i++) {
+        struct task_event_subscriber *sub = &task_event_subscribers[i];
+        if (sub->callback == callback) __atomic_store_n(&sub->mask, 0, __ATOMIC_RELEASE);
+        mask |= sub->mask;
+    }
+    task_event_mask = mask;
+    spin_unlock(&task_event_lock);
+
+    // wait for in-flight deliveries before the slot can be reused or the callback unloaded
+    synchronize_rcu();
+
+    spin_lock(&task_event_lock);
+    for (int i = 0; i < TASK_EVENT_SUBSCRIBER_MAX; i++) {
+        struct task_event_subscriber *sub = &task_event_subscribers[i];
+        if (sub->callback == callback && !sub->mask) sub->callback = 0;
+    }
+    spin_unlock(&task_event_lock);
+}
+KP_EXPORT_SYMBOL(task_event_unsubscribe);
+
+int task_event_refs(uint64_t start, uint64_t end)
+{
+    int refs = 0;
+    spin_lock(&task_event_lock);
+    for (int i = 0; i < TASK_EVENT_SUBSCRIBER_MAX; i++) {
+        struct task_event_subscriber *sub = &task_event_subscribers[i];
+        if (!sub->callback) continue;
+        if ((uint64_t)sub->callback >= start && (uint64_t)sub->callback < end) refs++;
+        if ((uint64_t)sub->udata >= start && (uint64_t)sub->udata < end) refs++;
+    }
+    spin_unlock(&task_event_lock);
+    return refs;
+}
+
+int task_event_queue_enable(int mask)
+{
+    if (!mask) return -EINVAL;
+    if (!task_event_rings) {
+        struct task_event_ring *rings = vmalloc(TASK_EVENT_QUEUE_CPUS * sizeof(struct task_event_ring));
+        if (!rings) return -ENOMEM;
+        memset(rings, 0, TASK_EVENT_QUEUE_CPUS * sizeof(struct task_event_ring));
+        struct task_event_ring *expected = 0;
+        if (!__atomic_compare_exchange_n(&task_event_rings, &expected, rings, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            vfree(rings);
+    }
+    int rc = task_event_prepare(mask);
+    if (rc) return rc;
+
+    spin_lock(&task_event_lock);
+    task_event_queue_mask |= mask;
+    task_event_mask |= mask;
+    spin_unlock(&task_event_lock);
+    return 0;
+}
+KP_EXPORT_SYMBOL(task_event_queue_enable);
+
 static struct task_struct *(*backup_copy_process)(void *a0, void *a1, void *a2, void *a3, void *a4, void *a5, void *a6,
                                                   void *a7) = 0;
 
@@ -58,6 +353,7 @@ struct task_struct *replace_copy_process(void *a0, void *a1, void *a2, void *a3,
     struct task_struct *new = backup_copy_process(a0, a1, a2, a3, a4, a5, a6, a7);
     if (unlikely(!new || IS_ERR(new))) return new;
     prepare_task_ext(new, current);
+    emit_fork_event(new);
     return new;
 }
 
@@ -68,14 +364,20 @@ static void replace_cgroup_post_fork(struct task_struct *p, void *a1)
     struct task_struct *new = p;
     backup_cgroup_post_fork(p, a1);
     prepare_task_ext(new, current);
+    emit_fork_event(new);
 }
 
 int task_observer()
 {
     int rc = 0;
 
+    spin_lock_init(&task_ext_slot_lock);
+    spin_lock_init(&task_event_lock);
     prepare_init_ext(init_task);
 
+    cpu_number_addr = kallsyms_lookup_name("cpu_number");
+    log_boot("cpu_number: %llx\n", cpu_number_addr);
+
     // __switch_to
     unsigned long copy_process_addr = get_preset_patch_sym()->copy_process;
     if (copy_process_addr) {
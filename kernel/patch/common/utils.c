@@ -15,6 +15,7 @@
 #include <linux/err.h>
 #include <linux/errno.h>
 #include <linux/random.h>
+#include <linux/slab.h>
 
 extern int kfunc_def(xt_data_to_user)(void __user *dst, const void *src, int usersize, int size, int aligned_size);
 
@@ -92,6 +93,17 @@ int __must_check compat_copy_to_user(void __user *to, const void *from, int n)
 }
 KP_EXPORT_SYMBOL(compat_copy_to_user);
 
+// copy_from_user is inline, memdup_user is the exported way in, faulting pages in like copy_from_user would
+int __must_check compat_copy_from_user(void *to, const void __user *from, int n)
+{
+    void *data = memdup_user(from, n);
+    if (!data || IS_ERR(data)) return 0;
+    memcpy(to, data, n);
+    kvfree(data);
+    return n;
+}
+KP_EXPORT_SYMBOL(compat_copy_from_user);
+
 #include <linux/uaccess.h>
 
 long compat_strncpy_from_user(char *dest, const char __user *src, long count)
@@ -16,8 +16,16 @@ int set_priv_selinx_allow(struct task_struct *task, int val);
 int commit_kernel_cred();
 int commit_su(uid_t uid, const char *sctx);
 int task_su(pid_t pid, uid_t to_uid, const char *sctx);
+int tasks_su(const pid_t *pids, int num, uid_t to_uid, const char *sctx);
 
 int selinux_hook_install();
+int selinux_grant_init();
+u32 selinux_grant_lookup(u32 ssid, u32 tsid, u16 tclass);
+// class and space or comma separated permission names to the kernel's class value and permission bits
+int selinux_grant_resolve(const char *tclass, const char *perms, u16 *out_class, u32 *out_perms);
+int selinux_grant_add(u32 ssid, u32 tsid, u16 tclass, u32 perms);
+int selinux_grant_remove(u32 ssid, u32 tsid, u16 tclass, u32 perms);
+int selinux_grant_clear();
 int supercall_install();
 
 #ifdef ANDROID
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024 bmax121. All Rights Reserved.
+ */
+
+#ifndef _KP_EXECHOOK_H_
+#define _KP_EXECHOOK_H_
+
+#include <ktypes.h>
+#include <hook.h>
+#include <preset.h>
+#include <uapi/scdefs.h>
+
+#define EXEC_HOOK_MAX 8
+#define EXEC_ARGV_NUM 4
+#define EXEC_ARG_LEN SUPER_KEY_LEN
+
+// Parsed view of an execve/execveat call, built once per exec on the front-end hook's stack.
+// filename and argv are copies of the arguments as passed in, consumers changing *u_filename_p or *uargv_p
+// don't update them.
+struct exec_args
+{
+    void *fargs;
+    hook_local_t *local;
+    int nr;
+    int compat;
+    char __user **u_filename_p;
+    char __user **uargv_p;
+    char __user **uenvp_p;
+
+    int filename_len;
+    char filename[SU_PATH_MAX_LEN];
+
+    int argv_copied;
+    const char *argv[EXEC_ARGV_NUM];
+    char argv_buf[EXEC_ARGV_NUM][EXEC_ARG_LEN];
+};
+
+// return non-zero to stop receiving execs, before may be NULL for after-only consumers,
+// those never finish and keep the exec hook installed, so register them only once actually needed
+typedef int (*exec_hook_before_t)(struct exec_args *exec, void *udata);
+typedef void (*exec_hook_after_t)(void *fargs, hook_local_t *local, void *udata);
+
+/**
+ * exec_arg - nth argv entry of the exec being handled, copied from user on first use
+ * @exec: parsed exec
+ * @n: index, less than EXEC_ARGV_NUM
+ * Return: NUL-terminated copy truncated to EXEC_ARG_LEN, or NULL if past the end of argv or not readable
+ */
+const char *exec_arg(struct exec_args *exec, int n);
+
+// the exec hook is installed again if every earlier consumer finished and it was removed,
+// -EFAULT if that fails
+int exec_hook_register(exec_hook_before_t before, exec_hook_after_t after, void *udata);
+
+int exec_hook_init();
+
+#endif
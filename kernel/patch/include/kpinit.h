@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024 bmax121. All Rights Reserved.
+ */
+
+#ifndef _KP_KPINIT_H_
+#define _KP_KPINIT_H_
+
+#include <ktypes.h>
+
+#define KP_INIT_STAGE_MAX 64
+
+#define KP_INIT_DEP(id) (1ull << (id))
+
+// A stage runs once, after every stage in deps returned 0, and is skipped if one of them failed.
+// Deferred stages run after rest_init on the kp_init thread, or on the first kp_init_wait, whichever comes first.
+struct kp_init_stage
+{
+    const char *name;
+    int (*init)();
+    uint64_t deps;
+    int deferred;
+    int state;
+    int rc;
+};
+
+/**
+ * kp_init_run - run the early stages in table order, the table is kept for the deferred ones
+ * @stages: stages, deps only point to earlier entries
+ * @num: number of stages, up to KP_INIT_STAGE_MAX
+ */
+void kp_init_run(struct kp_init_stage *stages, int num);
+
+// start the deferred stages on a kthread, or run them here if one can't be created
+void kp_init_defer();
+
+// make sure deferred stages have run, may sleep, for first use from syscall or supercall context
+void kp_init_wait();
+
+#endif
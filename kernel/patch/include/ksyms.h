@@ -9,7 +9,7 @@
 #include <linux/kallsyms.h>
 #include <log.h>
 
-#define INIT_USE_KALLSYMS_LOOKUP_NAME
+// #define INIT_USE_KALLSYMS_LOOKUP_NAME
 
 #define KFUNC_POISON 0xdeaddead00000000
 
@@ -31,13 +31,22 @@
     kf_##func = (typeof(kf_##func))kallsyms_lookup_name(#func ".cfi_jt"); \
     if (!kf_##func) kf_##func = (typeof(kf_##func))kallsyms_lookup_name(#func);
 #else
-int _ksym_local_strcmp(const char *s1, const char *s2);
-#define kvar_match(var, name, addr) \
-    if (!kv_##var && !_ksym_local_strcmp(#var, name)) kv_##var = (typeof(kv_##var))addr;
-#define kfunc_match(func, name, addr) \
-    if (!kf_##func && !_ksym_local_strcmp(#func, name)) kf_##func = (typeof(kf_##func))addr
+// collected by linux_*_symbol_init, resolved together by linux_symbol_resolve in one kallsyms pass,
+// the names are also kept in .kp.ksym.names so kptools can precompute their offsets
+#define KSYM_NAME(sym)                                                                          \
+    ({                                                                                          \
+        static const char __ksym_name[] __attribute__((section(".kp.ksym.names"), used)) = sym; \
+        __ksym_name;                                                                            \
+    })
+void ksym_want(const char *name, void *addr_ptr, int cfi);
+#define kvar_match(var, name, addr) ksym_want(KSYM_NAME(#var), &kv_##var, 0)
+#define kfunc_match(func, name, addr) ksym_want(KSYM_NAME(#func), &kf_##func, 0)
+#define kfunc_match_cfi(func, name, addr) \
+    ksym_want(KSYM_NAME(#func), &kf_##func, ((void)KSYM_NAME(#func ".cfi_jt"), 1))
 #endif
 
+int linux_symbol_resolve();
+
 #define kfunc_call(func, ...) \
     if (kf_##func) return kf_##func(__VA_ARGS__);
 
@@ -41,6 +41,8 @@ struct module
     mod_ctl0call_t *ctl0;
     mod_ctl1call_t *ctl1;
     mod_exitcall_t *exit;
+    mod_handovercall_t *handover;
+    mod_upgradecall_t *upgrade;
 
     unsigned int size;
     unsigned int text_size;
@@ -48,20 +50,50 @@ struct module
 
     void *start;
 
+    // symbols exported by KPM_EXPORT_SYMBOL
+    kp_symbol_t *symbols;
+    int symbol_num;
+
+    // modules whose symbols this one imports, and the number of modules importing from this one
+    struct module **deps;
+    int dep_num;
+    int users;
+
     struct list_head list;
 };
 
+// module list changes and module callbacks are serialized by modules_lock, which may sleep
+void modules_lock();
+void modules_unlock();
+
+// wait until the boot kpm loader has started every kpm it was given, kpm supercalls must not run ahead of it
+void async_kpm_wait();
+
+// stage_module and start_module expect the caller to hold modules_lock, the other calls take it themselves
+long stage_module(const void *data, int len, const char *args, struct module **out);
+long start_module(struct module *mod, const char *event, void *__user reserved);
 long load_module(const void *data, int len, const char *args, const char *event, void *__user reserved);
 long load_module_path(const char *path, const char *args, void *__user reserved);
 long module_control0(const char *name, const char *ctl_args, char *__user out_msg, int outlen);
 long module_control1(const char *name, void *a1, void *a2, void *a3);
 long unload_module(const char *name, void *__user reserved);
+long upgrade_module(const void *data, int len, const char *args, void *__user reserved);
+long upgrade_module_path(const char *path, const char *args, void *__user reserved);
 struct module *find_module(const char *name);
 
 int get_module_nums();
 int list_modules(char *out_names, int size);
 int get_module_info(const char *name, char *out_info, int size);
 
+struct kp_mod_mem_stat;
+int get_module_mem_stat(struct kp_mod_mem_stat *out, int max);
+
+unsigned long module_import_lookup(struct module *mod, const char *name);
+int module_export_symbols(struct module *mod);
+void module_release_symbols(struct module *mod);
+unsigned long module_import_size(struct module *mod);
+int module_import_init();
+
 int module_init();
 
 #endif
\ No newline at end of file
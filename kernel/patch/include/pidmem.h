@@ -8,8 +8,32 @@
 
 #include <ktypes.h>
 
+#include <uapi/scdefs.h>
+
+// 0 if vaddr isn't mapped or the lookup fails, walks without the mmap lock on kernels where it wasn't found
 phys_addr_t pid_virt_to_phys(pid_t pid, uintptr_t vaddr);
 
+/**
+ * pid_virt_to_phys_range - physical extents backing [start, start + size) of a process
+ * @pid: target pid
+ * @extents: output, physically and virtually contiguous runs merged into one extent, holes skipped
+ * @max: capacity of @extents
+ * @next: output, first va not covered yet, start + size once the whole range is reported
+ * Return: number of extents, or negative errno, -ENOSYS if the mmap lock wasn't found
+ */
+long pid_virt_to_phys_range(pid_t pid, uintptr_t start, size_t size, struct pmem_extent *extents, int max,
+                            uintptr_t *next);
+
+/**
+ * pid_access_vm - copy between the caller and a process, like process_vm_readv/process_vm_writev
+ * @local: iovecs in the caller's address space
+ * @remote: iovecs in the address space of @pid
+ * @write: copy local to remote if non-zero, remote to local otherwise
+ * Return: bytes copied, stopping at the first fault, or negative errno if nothing could be copied
+ */
+long pid_access_vm(pid_t pid, const struct pmem_iovec *local, int local_cnt, const struct pmem_iovec *remote,
+                   int remote_cnt, int write);
+
 // void *pid_map_mem(pid_t pid, void *mem, size_t size, )
 
 #endif
@@ -69,6 +69,12 @@ static inline void fp_unhook_syscall(int nr, void *before, void *after)
     fp_hook_unwrap(fp_addr, before, after);
 }
 
+static inline hook_err_t fp_rehook_syscall(int nr, void *old_before, void *old_after, void *before, void *after)
+{
+    uintptr_t fp_addr = (uintptr_t)(sys_call_table + nr);
+    return fp_hook_wrap_replace(fp_addr, old_before, old_after, before, after);
+}
+
 static inline hook_err_t fp_hook_compat_syscalln(int nr, int narg, void *before, void *after, void *udata)
 {
     if (!compat_sys_call_table) return HOOK_BAD_ADDRESS;
@@ -84,6 +90,13 @@ static inline void fp_unhook_compat_syscall(int nr, void *before, void *after)
     fp_hook_unwrap(fp_addr, before, after);
 }
 
+static inline hook_err_t fp_rehook_compat_syscall(int nr, void *old_before, void *old_after, void *before, void *after)
+{
+    if (!compat_sys_call_table) return -HOOK_BAD_ADDRESS;
+    uintptr_t fp_addr = (uintptr_t)(compat_sys_call_table + nr);
+    return fp_hook_wrap_replace(fp_addr, old_before, old_after, before, after);
+}
+
 /*
 xxx.cfi_jt example:
 hint #0x22
@@ -102,6 +115,12 @@ static inline void inline_unhook_syscall(int nr, void *before, void *after)
     hook_unwrap((void *)fp, before, after);
 }
 
+static inline hook_err_t inline_rehook_syscall(int nr, void *old_before, void *old_after, void *before, void *after)
+{
+    uintptr_t fp = sys_call_table[nr];
+    return hook_wrap_replace((void *)fp, old_before, old_after, before, after);
+}
+
 static inline hook_err_t inline_hook_compat_syscalln(int nr, int narg, void *before, void *after, void *udata)
 {
     if (!compat_sys_call_table) return HOOK_BAD_ADDRESS;
@@ -117,6 +136,14 @@ static inline void inline_unhook_compat_syscall(int nr, void *before, void *afte
     hook_unwrap((void *)fp, before, after);
 }
 
+static inline hook_err_t inline_rehook_compat_syscall(int nr, void *old_before, void *old_after, void *before,
+                                                      void *after)
+{
+    if (!compat_sys_call_table) return -HOOK_BAD_ADDRESS;
+    uintptr_t fp = compat_sys_call_table[nr];
+    return hook_wrap_replace((void *)fp, old_before, old_after, before, after);
+}
+
 int syscall_init();
 
 #endif
\ No newline at end of file
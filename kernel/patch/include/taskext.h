@@ -12,6 +12,18 @@
 
 #define TASK_EXT_MAGIC 0x1158115811581158
 
+// Per-task area handed out to kpms by task_ext_slot_alloc. Like the rest of task_ext it sits at the bottom of
+// every kernel stack, just above STACK_END_MAGIC, so each byte here is taken from every thread's stack depth.
+// Only the kernel side allocates slots, kpms index data[] and don't depend on the size.
+#ifndef TASK_EXT_DATA_SIZE
+#define TASK_EXT_DATA_SIZE 0x80
+#endif
+
+// copy the slot from the parent on fork instead of zeroing it
+#define TASK_EXT_SLOT_INHERIT 0x1
+
+#define TASK_EXT_SLOT_KEY_LEN 32
+
 struct task_ext
 {
     // first
@@ -22,8 +34,9 @@ struct task_ext
     int selinux_allow;
     int priv_selinux_allow;
     void *__;
-    // last
+    // last of the fixed part, prebuilt kpms check it at this offset
     uint64_t magic;
+    uint64_t data[TASK_EXT_DATA_SIZE / sizeof(uint64_t)];
 };
 
 static inline int task_ext_valid(struct task_ext *ext)
@@ -31,4 +44,30 @@ static inline int task_ext_valid(struct task_ext *ext)
     return ext && (ext->magic == TASK_EXT_MAGIC);
 }
 
+/**
+ * task_ext_slot_alloc - reserve per-task storage
+ * @key: owner, usually the module name, truncated to TASK_EXT_SLOT_KEY_LEN - 1, or NULL for an anonymous slot
+ * @size: bytes, rounded up to 8
+ * @flags: TASK_EXT_SLOT_INHERIT or 0
+ * Return: slot offset for task_ext_slot(), or a negative errno, -ENOSPC when the area is used up,
+ * -EEXIST when @key already owns a slot of another size or flags.
+ * Slots are never released, allocating again with the same key returns the same offset, so a reloaded module
+ * gets its slot back instead of using up the area. Tasks keep whatever the previous load stored there.
+ */
+int task_ext_slot_alloc(const char *key, int size, int flags);
+
+// ext must have passed task_ext_valid()
+static inline void *task_ext_slot(struct task_ext *ext, int slot)
+{
+    return (char *)ext->data + slot;
+}
+
+// NULL if current's task_ext isn't set up, e.g. a task forked before KernelPatch was loaded
+static inline void *current_ext_slot(int slot)
+{
+    struct task_ext *ext = current_ext;
+    if (unlikely(!task_ext_valid(ext))) return 0;
+    return task_ext_slot(ext, slot);
+}
+
 #endif
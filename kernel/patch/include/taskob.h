@@ -7,8 +7,54 @@
 #define _KP_TASKOB_H_
 
 #include <hook.h>
+#include <ktypes.h>
 
 hook_err_t add_execv_hook(hook_chain8_callback before, hook_chain8_callback after, void *udata);
 void remove_execv_hook(hook_chain8_callback before, hook_chain8_callback after);
 
+#define TASK_EVENT_FORK 0x1 // after copy_process, task is the child
+#define TASK_EVENT_EXEC 0x2 // after a successful execve/execveat, task is current
+#define TASK_EVENT_EXIT 0x4 // entering do_exit, task is current
+
+#define TASK_EVENT_SUBSCRIBER_MAX 16
+#define TASK_EVENT_QUEUE_CPUS 32
+#define TASK_EVENT_QUEUE_SIZE 128 // per cpu, power of 2
+
+struct task_struct;
+
+struct task_event
+{
+    uint32_t type;
+    pid_t pid;
+    pid_t tgid;
+    union
+    {
+        pid_t parent; // fork: pid of the forking task
+        int32_t code; // exit: exit code
+    };
+};
+
+// called synchronously in the context of the event under rcu_read_lock, must not sleep
+typedef void (*task_event_callback_t)(int type, struct task_struct *task, const struct task_event *event, void *udata);
+
+int task_event_subscribe(int mask, task_event_callback_t callback, void *udata);
+void task_event_unsubscribe(task_event_callback_t callback);
+
+// number of subscribers whose callback or udata points into [start, end)
+int task_event_refs(uint64_t start, uint64_t end);
+
+/**
+ * task_event_queue_enable - also record events in per-cpu rings, for readers preferring batches
+ * @mask: event types to record, added to the ones already recorded
+ */
+int task_event_queue_enable(int mask);
+
+/**
+ * task_event_drain - copy out recorded events of one cpu ring, one reader per ring at a time
+ * @cpu: ring index, less than TASK_EVENT_QUEUE_CPUS
+ * @dropped: if not NULL, set to the number of events lost to a full ring since the last drain
+ * Return: number of events copied
+ */
+int task_event_drain(int cpu, struct task_event *out, int max, int *dropped);
+
 #endif
\ No newline at end of file
@@ -22,6 +22,7 @@ static inline long hash_key(const char *key)
 
 #define SUPERCALL_HELLO 0x1000
 #define SUPERCALL_KLOG 0x1004
+#define SUPERCALL_KLOG_READ 0x1005
 
 #define SUPERCALL_KERNELPATCH_VER 0x1008
 #define SUPERCALL_KERNEL_VER 0x1009
@@ -32,10 +33,12 @@ static inline long hash_key(const char *key)
 
 #define SUPERCALL_SU 0x1010
 #define SUPERCALL_SU_TASK 0x1011 // syscall(__NR_gettid)
+#define SUPERCALL_SU_THREADS 0x1012 // tids of /proc/<pid>/task
 
 #define SUPERCALL_KPM_LOAD 0x1020
 #define SUPERCALL_KPM_UNLOAD 0x1021
 #define SUPERCALL_KPM_CONTROL 0x1022
+#define SUPERCALL_KPM_UPGRADE 0x1023
 
 #define SUPERCALL_KPM_NUMS 0x1030
 #define SUPERCALL_KPM_LIST 0x1031
@@ -43,17 +46,31 @@ static inline long hash_key(const char *key)
 
 #define SUPERCALL_MEM_PHYS 0x1041
 #define SUPERCALL_MEM_KERNEL_PHYS 0x1042
+#define SUPERCALL_MEM_PHYS_RANGE 0x1043
+#define SUPERCALL_MEM_READ 0x1044
+#define SUPERCALL_MEM_WRITE 0x1045
 #define SUPERCALL_MEM_MAP_KERNEL 0x1048
 #define SUPERCALL_MEM_MAP_USER 0x1049
 #define SUPERCALL_MEM_PROT 0x1049
 #define SUPERCALL_MEM_CACHE_FLUSH 0x1049
 
+#define SUPERCALL_SELINUX_GRANT 0x1050
+#define SUPERCALL_SELINUX_REVOKE 0x1051
+#define SUPERCALL_SELINUX_GRANT_CLEAR 0x1052
+
+#define SUPERCALL_BOOT_PROF 0x10fb
+#define SUPERCALL_MEM_STAT 0x10fc
 #define SUPERCALL_BOOTLOG 0x10fd
 #define SUPERCALL_PANIC 0x10fe
 #define SUPERCALL_TEST 0x10ff
 
 #define SUPERCALL_KEY_MAX_LEN 0x40
+#define SUPERCALL_SU_THREADS_MAX 0x400
 #define SUPERCALL_SCONTEXT_LEN 0x60
+#define SUPERCALL_KLOG_READ_MAX 0x40000
+
+#define SUPERCALL_KLOG_BOOT 0
+#define SUPERCALL_KLOG_RUNTIME 1
 
 struct su_profile
 {
@@ -62,6 +79,120 @@ struct su_profile
     char scontext[SUPERCALL_SCONTEXT_LEN];
 };
 
+struct pmem_extent
+{
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint64_t size;
+};
+
+// start and size in, next out: first va not covered by the returned extents
+struct pmem_range
+{
+    uint64_t start;
+    uint64_t size;
+    uint64_t next;
+};
+
+#define SUPERCALL_MEM_EXTENTS_MAX 0x200
+
+// same layout as struct iovec on 64-bit
+struct pmem_iovec
+{
+    uint64_t base;
+    uint64_t len;
+};
+
+struct pmem_rw
+{
+    uint64_t local_iov;
+    uint64_t remote_iov;
+    uint32_t local_cnt;
+    uint32_t remote_cnt;
+};
+
+#define SUPERCALL_MEM_IOV_MAX 0x400
+
+#define SUPERCALL_SELINUX_CLASS_LEN 0x40
+#define SUPERCALL_SELINUX_PERMS_LEN 0x100
+
+// tclass and perms are names, e.g. "file" and "read write", resolved against the kernel's class map, the
+// selinuxfs class index and perms bits are the policy's values, which avc doesn't use.
+// perms are space or comma separated, empty revokes all
+struct selinux_grant
+{
+    char scontext[SUPERCALL_SCONTEXT_LEN];
+    char tcontext[SUPERCALL_SCONTEXT_LEN];
+    char tclass[SUPERCALL_SELINUX_CLASS_LEN];
+    char perms[SUPERCALL_SELINUX_PERMS_LEN];
+};
+
+#define KP_HEAP_HIST_NUM 16
+#define KP_MEM_STAT_MOD_MAX 32
+
+// free_hist[n] counts free blocks of [16 << n, 32 << n) bytes, the last bucket also takes anything larger
+struct kp_heap_stat
+{
+    uint64_t total;
+    uint64_t used;
+    uint64_t free;
+    uint64_t largest_free;
+    uint64_t cached; // part of used sitting in the per-cpu caches, rw heap only
+    uint32_t pools;
+    uint32_t used_blocks;
+    uint32_t free_blocks;
+    uint32_t free_hist[KP_HEAP_HIST_NUM];
+};
+
+struct kp_hook_mem_stat
+{
+    uint32_t slot_size;
+    uint32_t total;
+    uint32_t used;
+    uint32_t inline_hooks;
+    uint32_t inline_chains;
+    uint32_t fp_chains;
+};
+
+struct kp_mod_mem_stat
+{
+    char name[0x20];
+    uint64_t exec_size; // whole image, text and data
+    uint64_t ro_size; // part of it mapped read-only
+    uint64_t rw_size; // rw heap used for its exports and dependencies
+};
+
+struct kp_mem_stat
+{
+    struct kp_heap_stat rw;
+    struct kp_heap_stat exec;
+    struct kp_hook_mem_stat hook;
+    int32_t mod_num; // all loaded modules, mods holds up to KP_MEM_STAT_MOD_MAX
+    int32_t _;
+    struct kp_mod_mem_stat mods[KP_MEM_STAT_MOD_MAX];
+};
+
+#define KP_BOOT_STAGE_MAX 32
+#define KP_BOOT_STAGE_NAME_LEN 0x30
+
+// start and end are cntvct ticks since the counter started, divide by freq, end is 0 if the stage never returned
+struct kp_boot_stage
+{
+    char name[KP_BOOT_STAGE_NAME_LEN];
+    int32_t rc;
+    int32_t depth; // nesting level, 0 for top level stages
+    uint64_t start;
+    uint64_t end;
+};
+
+struct kp_boot_prof
+{
+    uint64_t freq;
+    int32_t num;
+    int32_t _;
+    struct kp_boot_stage stages[KP_BOOT_STAGE_MAX];
+};
+
 #ifdef ANDROID
 
 #define ANDROID_SH_PATH "/system/bin/sh"
@@ -7,6 +7,7 @@
 #include <linux/ptrace.h>
 #include <log.h>
 #include <preset.h>
+#include <exechook.h>
 
 static int first_init_execed = 0;
 
@@ -15,25 +16,19 @@ static void before_first_exec()
     log_boot("event: %s\n", EXTRA_EVENT_PRE_EXEC_INIT);
 }
 
-// https://elixir.bootlin.com/linux/v6.1/source/fs/exec.c#L2087
-// SYSCALL_DEFINE3(execve, const char __user *, filename, const char __user *const __user *, argv,
-//                 const char __user *const __user *, envp)
-
-// https://elixir.bootlin.com/linux/v6.1/source/fs/exec.c#L2095
-// SYSCALL_DEFINE5(execveat, int, fd, const char __user *, filename, const char __user *const __user *, argv,
-//                 const char __user *const __user *, envp, int, flags)
-static void before_execve(hook_fargs3_t *args, void *udata)
+static int before_execve(struct exec_args *exec, void *udata)
 {
-    if (first_init_execed) return;
+    if (exec->compat) return 0;
+    if (first_init_execed) return 1;
     first_init_execed = 1;
     before_first_exec();
 
     log_boot("kernel stack:\n");
 
-    uint64_t arg0 = syscall_argn(args, 0);
-    uint64_t arg1 = syscall_argn(args, 1);
-    uint64_t arg2 = syscall_argn(args, 2);
-    uint64_t nr = (uint64_t)udata;
+    uint64_t arg0 = syscall_argn(exec->fargs, 0);
+    uint64_t arg1 = syscall_argn(exec->fargs, 1);
+    uint64_t arg2 = syscall_argn(exec->fargs, 2);
+    uint64_t nr = exec->nr;
 
     unsigned long stack = (unsigned long)get_stack(current);
     uintptr_t addr = (uintptr_t)(thread_size + stack);
@@ -52,26 +47,12 @@ static void before_execve(hook_fargs3_t *args, void *udata)
         }
     }
     log_boot("    pt_regs offset: %x\n", pt_regs_offset);
-}
-
-static void after_execv(hook_fargs5_t *args, void *udata)
-{
-    fp_unhook_syscall(__NR_execve, before_execve, after_execv);
-    fp_unhook_syscall(__NR_execveat, before_execve, after_execv);
+    return 1;
 }
 
 int resolve_pt_regs()
 {
-    hook_err_t ret = 0;
-    hook_err_t rc = HOOK_NO_ERR;
-
-    rc = fp_hook_syscalln(__NR_execve, 3, before_execve, after_execv, (void *)__NR_execve);
-    log_boot("hook __NR_execve rc: %d\n", rc);
-    ret |= rc;
-
-    rc = fp_hook_syscalln(__NR_execveat, 5, before_execve, after_execv, (void *)__NR_execveat);
-    log_boot("hook __NR_execveat rc: %d\n", rc);
-    ret |= rc;
-
+    int rc = exec_hook_register(before_execve, 0, 0);
+    log_boot("register exec hook rc: %d\n", rc);
     return rc;
-}
\ No newline at end of file
+}
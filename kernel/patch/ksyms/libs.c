@@ -259,10 +259,6 @@ static int _linux_libs_symbol_init(void *data, const char *name, struct module *
 
 int linux_libs_symbol_init(const char *name, unsigned long addr)
 {
-#ifdef INIT_USE_KALLSYMS_LOOKUP_NAME
     _linux_libs_symbol_init(0, 0, 0, 0);
-#else
-    kallsyms_on_each_symbol(_linux_libs_symbol_init, 0);
-#endif
     return 0;
 }
@@ -13,21 +13,6 @@
 #include <linux/cred.h>
 #include <linux/sched/task.h>
 
-#ifndef INIT_USE_KALLSYMS_LOOKUP_NAME
-int _ksym_local_strcmp(const char *s1, const char *s2)
-{
-    const unsigned char *c1 = (const unsigned char *)s1;
-    const unsigned char *c2 = (const unsigned char *)s2;
-    unsigned char ch;
-    int d = 0;
-    while (1) {
-        d = (int)(ch = *c1++) - (int)*c2++;
-        if (d || !ch) break;
-    }
-    return d;
-}
-#endif
-
 struct group_info *kfunc_def(groups_alloc)(int gidsetsize) = 0;
 void kfunc_def(set_groups)(struct cred *, struct group_info *group_info) = 0;
 
@@ -109,6 +94,48 @@ void kfunc_def(_raw_write_unlock_irqrestore)(rwlock_t *lock, unsigned long flags
 void kfunc_def(_raw_write_unlock_irq)(rwlock_t *lock) = 0;
 void kfunc_def(_raw_write_unlock_bh)(rwlock_t *lock) = 0;
 
+// kernel/locking/rwsem.c
+#include <linux/rwsem.h>
+
+void kfunc_def(down_read)(struct rw_semaphore *sem) = 0;
+void kfunc_def(up_read)(struct rw_semaphore *sem) = 0;
+
+static void _linux_locking_rwsem_sym_match(const char *name, unsigned long addr)
+{
+    kfunc_match(down_read, name, addr);
+    kfunc_match(up_read, name, addr);
+}
+
+// kernel/locking/mutex.c
+#include <linux/mutex.h>
+
+void kfunc_def(__mutex_init)(struct mutex *lock, const char *name, struct lock_class_key *key) = 0;
+void kfunc_def(mutex_lock)(struct mutex *lock) = 0;
+void kfunc_def(mutex_unlock)(struct mutex *lock) = 0;
+
+static void _linux_locking_mutex_sym_match(const char *name, unsigned long addr)
+{
+    kfunc_match(__mutex_init, name, addr);
+    kfunc_match(mutex_lock, name, addr);
+    kfunc_match(mutex_unlock, name, addr);
+}
+
+// kernel/sched/completion.c
+#include <linux/completion.h>
+
+void kfunc_def(__init_swait_queue_head)(void *q, const char *name, struct lock_class_key *key) = 0;
+void kfunc_def(__init_waitqueue_head)(void *wq_head, const char *name, struct lock_class_key *key) = 0;
+void kfunc_def(wait_for_completion)(struct completion *x) = 0;
+void kfunc_def(complete_all)(struct completion *x) = 0;
+
+static void _linux_sched_completion_sym_match(const char *name, unsigned long addr)
+{
+    kfunc_match(__init_swait_queue_head, name, addr);
+    kfunc_match(__init_waitqueue_head, name, addr);
+    kfunc_match(wait_for_completion, name, addr);
+    kfunc_match(complete_all, name, addr);
+}
+
 void _linux_locking_spinlock_sym_match(const char *name, unsigned long addr)
 {
     kfunc_match(_raw_spin_trylock, name, addr);
@@ -268,6 +295,25 @@ static void _linux_kernel_stop_machine_sym_match(const char *name, unsigned long
     kfunc_match(stop_machine, name, addr);
 }
 
+// kernel/kthread.c
+#include <linux/kthread.h>
+
+struct task_struct *kvar_def(kthreadd_task) = 0;
+struct task_struct *kfunc_def(kthread_create_on_node)(int (*threadfn)(void *data), void *data, int node,
+                                                      const char namefmt[], ...) = 0;
+int kfunc_def(wake_up_process)(struct task_struct *tsk) = 0;
+long kfunc_def(schedule_timeout_uninterruptible)(long timeout) = 0;
+long kfunc_def(schedule_timeout_interruptible)(long timeout) = 0;
+
+static void _linux_kernel_kthread_sym_match(const char *name, unsigned long addr)
+{
+    kvar_match(kthreadd_task, name, addr);
+    kfunc_match(kthread_create_on_node, name, addr);
+    kfunc_match(wake_up_process, name, addr);
+    kfunc_match(schedule_timeout_uninterruptible, name, addr);
+    kfunc_match(schedule_timeout_interruptible, name, addr);
+}
+
 // mm/util.c
 struct file;
 struct page;
@@ -583,8 +629,8 @@ static void _linux_security_selinux_sym_match(const char *name, unsigned long ad
 {
     // kvar_match(selinux_enabled_boot, name, addr);
     // kvar_match(selinux_enabled, name, addr);
-    // kvar_match(selinux_state, name, addr);
-    // kvar_match(secclass_map, name, addr);
+    kvar_match(selinux_state, name, addr);
+    kvar_match(secclass_map, name, addr);
     // kfunc_match(security_mls_enabled, name, addr);
     // kfunc_match(security_load_policy, name, addr);
     // kfunc_match(selinux_policy_commit, name, addr);
@@ -602,7 +648,7 @@ static void _linux_security_selinux_sym_match(const char *name, unsigned long ad
     // kfunc_match(security_sid_to_context, name, addr);
     // kfunc_match(security_sid_to_context_force, name, addr);
     // kfunc_match(security_sid_to_context_inval, name, addr);
-    // kfunc_match(security_context_to_sid, name, addr);
+    kfunc_match(security_context_to_sid, name, addr);
     // kfunc_match(security_context_str_to_sid, name, addr);
     // kfunc_match(security_context_to_sid_default, name, addr);
     // kfunc_match(security_context_to_sid_force, name, addr);
@@ -826,12 +872,15 @@ static void _linux_rcu_symbol_init(const char *name, unsigned long addr)
 void kfunc_def(mmput)(struct mm_struct *);
 void kfunc_def(mmput_async)(struct mm_struct *);
 struct mm_struct *kfunc_def(get_task_mm)(struct task_struct *task);
+int kfunc_def(access_remote_vm)(struct mm_struct *mm, unsigned long addr, void *buf, int len,
+                                unsigned int gup_flags) = 0;
 
 static void _linux_sched_mm_init(const char *name, unsigned long addr)
 {
     kfunc_match(mmput, name, addr);
     kfunc_match(mmput_async, name, addr);
     kfunc_match(get_task_mm, name, addr);
+    kfunc_match(access_remote_vm, name, addr);
 }
 
 static int _linux_misc_symbol_init(void *data, const char *name, struct module *m, unsigned long addr)
@@ -839,10 +888,14 @@ static int _linux_misc_symbol_init(void *data, const char *name, struct module *
     _linux_kernel_cred_sym_match(name, addr);
     _linux_kernel_pid_sym_match(name, addr);
     _linux_kernel_stop_machine_sym_match(name, addr);
+    _linux_kernel_kthread_sym_match(name, addr);
     _linux_mm_utils_sym_match(name, addr);
     _linux_mm_vmalloc_sym_match(name, addr);
     _linux_fs_sym_match(name, addr);
     _linux_locking_spinlock_sym_match(name, addr);
+    _linux_locking_rwsem_sym_match(name, addr);
+    _linux_locking_mutex_sym_match(name, addr);
+    _linux_sched_completion_sym_match(name, addr);
     _linux_stacktrace_sym_match(name, addr);
     _linux_security_selinux_sym_match(name, addr);
     _linux_security_commoncap_sym_match(name, addr);
@@ -857,10 +910,6 @@ static int _linux_misc_symbol_init(void *data, const char *name, struct module *
 
 int linux_misc_symbol_init()
 {
-#ifdef INIT_USE_KALLSYMS_LOOKUP_NAME
     _linux_misc_symbol_init(0, 0, 0, 0);
-#else
-    kallsyms_on_each_symbol(_linux_misc_symbol_init, 0);
-#endif
     return 0;
 }
@@ -0,0 +1,374 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024 bmax121. All Rights Reserved.
+ */
+
+#include <ksyms.h>
+#include <ktypes.h>
+#include <common.h>
+#include <baselib.h>
+#include <kpmalloc.h>
+#include <predata.h>
+#include <pgtable.h>
+#include <uapi/asm-generic/errno.h>
+
+#ifndef INIT_USE_KALLSYMS_LOOKUP_NAME
+
+#define KSYM_WANT_STEP 64
+#define KSYM_NAME_MAX 128
+#define KSYM_CFI_SUFFIX ".cfi_jt"
+
+// a later match only replaces an earlier one of lower rank
+#define KSYM_FOUND_SUFFIX 1
+#define KSYM_FOUND_NAME 2
+#define KSYM_FOUND_CFI 3
+
+#define KSYM_CACHE_VERIFY_NUM 3
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+extern char _kp_ksym_names_start[];
+extern char _kp_ksym_names_end[];
+
+struct ksym_want
+{
+    const char *name;
+    unsigned long *addr_ptr;
+    uint32_t hash;
+    int16_t dup; // next want with the same name, -1 if none
+    int16_t bnext; // next want in the same bucket, -1 if none
+    uint8_t cfi;
+    uint8_t found;
+    uint8_t primary;
+    uint8_t cache_clone;
+    unsigned long cache_addr;
+};
+
+static struct ksym_want *wants = 0;
+static int want_num = 0;
+static int want_cap = 0;
+static int want_unique = 0;
+
+// hash-and-displace perfect hash over the wanted names,
+// every kernel symbol costs one hash, one probe and at most one strcmp
+static uint16_t *ph_table = 0; // slot -> want index + 1
+static uint16_t *ph_disp = 0; // bucket -> displacement
+static uint32_t ph_mask = 0;
+static uint32_t ph_bucket_num = 0;
+
+// FNV-1a over the name before the first '.'
+static inline uint32_t ksym_hash(const char *name, int *len)
+{
+    uint32_t hash = FNV_OFFSET_BASIS;
+    const char *p = name;
+    for (; *p && *p != '.'; p++)
+        hash = (hash ^ (unsigned char)*p) * FNV_PRIME;
+    *len = p - name;
+    return hash;
+}
+
+static inline uint32_t ph_slot(uint32_t hash, uint32_t disp)
+{
+    // odd step, so displacements walk every slot
+    uint32_t step = ((hash >> 16) | (hash << 16)) | 1;
+    return (hash + disp * step) & ph_mask;
+}
+
+void ksym_want(const char *name, void *addr_ptr, int cfi)
+{
+    if (want_num >= want_cap) {
+        struct ksym_want *nwants = kp_realloc(wants, (want_cap + KSYM_WANT_STEP) * sizeof(*wants));
+        if (!nwants) {
+            logke("ksym_want: no memory for %s\n", name);
+            return;
+        }
+        wants = nwants;
+        want_cap += KSYM_WANT_STEP;
+    }
+
+    int len;
+    struct ksym_want *want = &wants[want_num];
+    want->name = name;
+    want->addr_ptr = (unsigned long *)addr_ptr;
+    want->hash = ksym_hash(name, &len);
+    want->dup = -1;
+    want->bnext = -1;
+    want->cfi = cfi;
+    want->found = 0;
+    want->primary = 1;
+
+    // the same symbol can be wanted by several groups
+    for (int i = 0; i < want_num; i++) {
+        struct ksym_want *prev = &wants[i];
+        if (!prev->primary || prev->hash != want->hash || lib_strcmp(prev->name, name)) continue;
+        want->primary = 0;
+        want->dup = prev->dup;
+        prev->dup = want_num;
+        prev->cfi |= cfi;
+        break;
+    }
+    if (want->primary) want_unique++;
+    want_num++;
+}
+
+static int ph_build()
+{
+    uint32_t size = 1;
+    while (size < want_unique * 2)
+        size <<= 1;
+    ph_mask = size - 1;
+    ph_bucket_num = (want_unique + 3) / 4;
+    if (!ph_bucket_num) ph_bucket_num = 1;
+
+    ph_table = kp_malloc(size * sizeof(*ph_table));
+    ph_disp = kp_malloc(ph_bucket_num * sizeof(*ph_disp));
+    int16_t *heads = kp_malloc(ph_bucket_num * sizeof(*heads));
+    uint16_t *sizes = kp_malloc(ph_bucket_num * sizeof(*sizes));
+    int rc = -ENOMEM;
+    if (!ph_table || !ph_disp || !heads || !sizes) goto out;
+
+    lib_memset(ph_table, 0, size * sizeof(*ph_table));
+    lib_memset(ph_disp, 0, ph_bucket_num * sizeof(*ph_disp));
+    lib_memset(sizes, 0, ph_bucket_num * sizeof(*sizes));
+    int max_bucket = 0;
+    for (int i = 0; i < ph_bucket_num; i++)
+        heads[i] = -1;
+
+    for (int i = 0; i < want_num; i++) {
+        struct ksym_want *want = &wants[i];
+        if (!want->primary) continue;
+        uint32_t b = want->hash % ph_bucket_num;
+        want->bnext = heads[b];
+        heads[b] = i;
+        if (++sizes[b] > max_bucket) max_bucket = sizes[b];
+    }
+
+    // place the largest buckets first, they are the hardest to fit
+    rc = -ENOSPC;
+    for (int bsize = max_bucket; bsize > 0; bsize--) {
+        for (uint32_t b = 0; b < ph_bucket_num; b++) {
+            if (sizes[b] != bsize) continue;
+            uint32_t disp;
+            for (disp = 0; disp <= ph_mask; disp++) {
+                int i;
+                for (i = heads[b]; i >= 0; i = wants[i].bnext) {
+                    uint32_t slot = ph_slot(wants[i].hash, disp);
+                    if (ph_table[slot]) break;
+                    ph_table[slot] = i + 1;
+                }
+                if (i < 0) break;
+                // roll back this attempt
+                for (int j = heads[b]; j != i; j = wants[j].bnext) {
+                    ph_table[ph_slot(wants[j].hash, disp)] = 0;
+                }
+            }
+            if (disp > ph_mask) goto out;
+            ph_disp[b] = disp;
+        }
+    }
+    rc = 0;
+
+out:
+    if (heads) kp_free(heads);
+    if (sizes) kp_free(sizes);
+    return rc;
+}
+
+static inline void want_fill(struct ksym_want *want, unsigned long addr, int found)
+{
+    for (int i = want - wants; i >= 0; i = wants[i].dup) {
+        *wants[i].addr_ptr = addr;
+    }
+    want->found = found;
+}
+
+// compiler generated local copies, LTO promotes statics to name.llvm.<hash>,
+// gcc clones them to name.isra.<n>, name.constprop.<n> and chains of those
+static const char *const ksym_clone_suffixes[] = { ".llvm.", ".isra.", ".constprop." };
+
+static int ksym_suffix_rank(const char *suffix)
+{
+    if (!*suffix) return KSYM_FOUND_NAME;
+    if (!lib_strcmp(suffix, KSYM_CFI_SUFFIX)) return KSYM_FOUND_CFI;
+    for (int i = 0; i < sizeof(ksym_clone_suffixes) / sizeof(ksym_clone_suffixes[0]); i++) {
+        const char *s = ksym_clone_suffixes[i];
+        if (!lib_strncmp(suffix, s, lib_strlen(s))) return KSYM_FOUND_SUFFIX;
+    }
+    return 0;
+}
+
+static int ksym_resolve_each(void *data, const char *name, struct module *m, unsigned long addr)
+{
+    // kernel 6.4 dropped the module argument
+    if (kver >= VERSION(6, 4, 0)) addr = (unsigned long)m;
+
+    int len;
+    uint32_t hash = ksym_hash(name, &len);
+    int found = ksym_suffix_rank(name + len);
+    if (!found) return 0;
+
+    uint16_t idx = ph_table[ph_slot(hash, ph_disp[hash % ph_bucket_num])];
+    if (!idx) return 0;
+    struct ksym_want *want = &wants[idx - 1];
+    if (want->hash != hash || lib_strncmp(want->name, name, len) || want->name[len]) return 0;
+
+    // the first exact match wins, like kallsyms_lookup_name, a clone only stands in when there is none,
+    // the cfi jump table entry overrides both
+    if (found == KSYM_FOUND_CFI && !want->cfi) return 0;
+    if (found <= want->found) return 0;
+    want_fill(want, addr, found);
+    return 0;
+}
+
+static unsigned long ksym_lookup_one(struct ksym_want *want)
+{
+    char buf[KSYM_NAME_MAX];
+    unsigned long addr = 0;
+    if (want->cfi) {
+        lib_strlcpy(buf, want->name, sizeof(buf));
+        lib_strncat(buf, KSYM_CFI_SUFFIX, sizeof(buf) - lib_strlen(buf) - 1);
+        addr = kallsyms_lookup_name(buf);
+    }
+    if (!addr) addr = kallsyms_lookup_name(want->name);
+    return addr;
+}
+
+// kallsyms_lookup_name for every want, used when the one pass over kallsyms is not available
+static void ksym_resolve_lookup()
+{
+    for (int i = 0; i < want_num; i++) {
+        struct ksym_want *want = &wants[i];
+        if (!want->primary || want->found) continue;
+        unsigned long addr = ksym_lookup_one(want);
+        if (addr) want_fill(want, addr, KSYM_FOUND_NAME);
+    }
+}
+
+static inline uint32_t fnv1a(uint32_t hash, const char *data, int len)
+{
+    for (int i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char)data[i]) * FNV_PRIME;
+    return hash;
+}
+
+static const ksym_cache_entry_t *ksym_cache_lookup(const ksym_cache_header_t *header, uint32_t hash)
+{
+    const ksym_cache_entry_t *entries = (const ksym_cache_entry_t *)(header + 1);
+    int lo = 0, hi = header->num - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (entries[mid].hash == hash) return &entries[mid];
+        if (entries[mid].hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return 0;
+}
+
+static int find_ksym_cache(const patch_extra_item_t *extra, const char *args, const void *con, void *udata)
+{
+    if (extra->type != EXTRA_TYPE_KSYM) return 0;
+    *(const ksym_cache_header_t **)udata = (const ksym_cache_header_t *)con;
+    return 1;
+}
+
+// offsets precomputed by kptools, only the KASLR slide is applied here,
+// the table has an entry for every name, names kptools did not find are trusted to be missing
+static int ksym_resolve_cache()
+{
+    const ksym_cache_header_t *header = 0;
+    on_each_extra_item(find_ksym_cache, &header);
+    if (!header) return -ENOENT;
+    if (lib_strncmp(header->magic, KSYM_CACHE_MAGIC, sizeof(header->magic))) return -EINVAL;
+
+    uint32_t names_hash = fnv1a(FNV_OFFSET_BASIS, _kp_ksym_names_start, _kp_ksym_names_end - _kp_ksym_names_start);
+    if (names_hash != header->names_hash) return -EINVAL;
+
+    int found = 0;
+    for (int i = 0; i < want_num; i++) {
+        struct ksym_want *want = &wants[i];
+        if (!want->primary) continue;
+        uint32_t hash = fnv1a(FNV_OFFSET_BASIS, want->name, lib_strlen(want->name));
+        const ksym_cache_entry_t *entry = ksym_cache_lookup(header, hash);
+        if (!entry) return -EINVAL;
+        if (want->cfi) {
+            uint32_t cfi_hash = fnv1a(hash, KSYM_CFI_SUFFIX, sizeof(KSYM_CFI_SUFFIX) - 1);
+            const ksym_cache_entry_t *cfi_entry = ksym_cache_lookup(header, cfi_hash);
+            if (!cfi_entry) return -EINVAL;
+            if (!(cfi_entry->flags & KSYM_CACHE_MISSING)) entry = cfi_entry;
+        }
+        want->cache_addr = 0;
+        want->cache_clone = !!(entry->flags & KSYM_CACHE_CLONE);
+        if (!(entry->flags & KSYM_CACHE_MISSING)) {
+            want->cache_addr = kernel_va + entry->offset;
+            found++;
+        }
+    }
+
+    // spot check the table against kallsyms before trusting it,
+    // clones are skipped, not every kallsyms_lookup_name strips their suffix
+    int step = found / KSYM_CACHE_VERIFY_NUM;
+    if (!step) step = 1;
+    for (int i = 0, n = 0; i < want_num; i++) {
+        struct ksym_want *want = &wants[i];
+        if (!want->primary || !want->cache_addr || want->cache_clone) continue;
+        if (n++ % step) continue;
+        unsigned long addr = ksym_lookup_one(want);
+        if (addr != want->cache_addr) {
+            logkw("ksyms cache mismatch: %s, %llx != %llx\n", want->name, want->cache_addr, addr);
+            return -EINVAL;
+        }
+    }
+
+    for (int i = 0; i < want_num; i++) {
+        struct ksym_want *want = &wants[i];
+        if (!want->primary || !want->cache_addr) continue;
+        want_fill(want, want->cache_addr, want->cache_clone ? KSYM_FOUND_SUFFIX : KSYM_FOUND_NAME);
+    }
+    return 0;
+}
+
+int linux_symbol_resolve()
+{
+    int rc = ksym_resolve_cache();
+    if (!rc) {
+        logkd("ksyms resolved from cache\n");
+    } else if (!kallsyms_on_each_symbol || (rc = ph_build())) {
+        if (kallsyms_on_each_symbol) logkw("ksyms perfect hash build error: %d\n", rc);
+        ksym_resolve_lookup();
+    } else {
+        kallsyms_on_each_symbol(ksym_resolve_each, 0);
+    }
+
+    int found = 0;
+    for (int i = 0; i < want_num; i++) {
+        if (!wants[i].primary) continue;
+        if (wants[i].found) {
+            found++;
+        } else {
+            logkfv("%s not found\n", wants[i].name);
+        }
+    }
+    logkd("ksyms resolved %d of %d\n", found, want_unique);
+
+    if (ph_table) kp_free(ph_table);
+    if (ph_disp) kp_free(ph_disp);
+    if (wants) kp_free(wants);
+    ph_table = 0;
+    ph_disp = 0;
+    wants = 0;
+    want_num = want_cap = want_unique = 0;
+    return 0;
+}
+
+#else
+
+int linux_symbol_resolve()
+{
+    return 0;
+}
+
+#endif
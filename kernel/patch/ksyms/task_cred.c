@@ -31,11 +31,13 @@
 #define THREAD_INFO_MAX_SIZE 0x90
 #define CRED_MAX_SIZE 0x100
 #define MM_STRUCT_MAX_SIZE 0xb0
+#define MM_STRUCT_LOCK_SCAN 0x200
 
 struct mm_struct_offset mm_struct_offset = {
     .mmap_base_offset = -1,
     .task_size_offset = -1,
     .pgd_offset = -1,
+    .mmap_lock_offset = -1,
     .map_count_offset = -1,
     .total_vm_offset = -1,
     .locked_vm_offset = -1,
@@ -597,6 +599,20 @@ int resolve_mm_struct_offset()
         }
     }
     log_boot("    pgd offset: %x\n", mm_struct_offset.pgd_offset);
+
+    // nobody waits on init_mm's mmap_lock this early, the first list_head after pgd pointing at itself on both
+    // ends is its wait_list, everything between pgd and it is counters and page_table_lock.
+    // wait_list follows count, owner, osq and wait_lock since 5.3, only count before
+    if (mm_struct_offset.pgd_offset >= 0) {
+        uintptr_t wait_list_offset = kver >= VERSION(5, 3, 0) ? 24 : 8;
+        uintptr_t start = init_mm_addr + mm_struct_offset.pgd_offset + sizeof(uintptr_t);
+        for (uintptr_t i = start; i < init_mm_addr + MM_STRUCT_LOCK_SCAN; i += sizeof(uintptr_t)) {
+            if (*(uintptr_t *)i != i || *(uintptr_t *)(i + sizeof(uintptr_t)) != i) continue;
+            if (i - wait_list_offset >= start) mm_struct_offset.mmap_lock_offset = i - wait_list_offset - init_mm_addr;
+            break;
+        }
+    }
+    log_boot("    mmap_lock offset: %x\n", mm_struct_offset.mmap_lock_offset);
     return 0;
 }
 
@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * Copyright (C) 2024 bmax121. All Rights Reserved.
+ */
+
+#include <uapi/asm-generic/errno.h>
+#include <kpmalloc.h>
+#include <symbol.h>
+#include <log.h>
+#include <linux/string.h>
+#include <linux/spinlock.h>
+
+#include "module.h"
+
+// Name -> address of everything a kpm may import, KernelPatch exports are cached on first use,
+// kpm exports are added when the module is started and dropped when it is unloaded.
+
+#define IMPORT_HASH_BITS 7
+#define IMPORT_HASH_SIZE (1 << IMPORT_HASH_BITS)
+
+struct import_entry
+{
+    struct import_entry *next;
+    unsigned long hash;
+    unsigned long addr;
+    struct module *owner;
+    char name[];
+};
+
+static struct import_entry *import_table[IMPORT_HASH_SIZE] = { 0 };
+static spinlock_t import_lock;
+
+// DJB2, same as the KernelPatch symbol table
+static unsigned long import_hash(const char *name)
+{
+    unsigned long hash = 5381;
+    int c;
+    while ((c = *name++)) {
+        hash = ((hash << 5) + hash) + c;
+    }
+    return hash;
+}
+
+static struct import_entry *import_find(const char *name, unsigned long hash)
+{
+    struct import_entry *entry = import_table[hash & (IMPORT_HASH_SIZE - 1)];
+    for (; entry; entry = entry->next) {
+        if (entry->hash == hash && !strcmp(entry->name, name)) return entry;
+    }
+    return 0;
+}
+
+static struct import_entry *import_insert(const char *name, unsigned long hash, unsigned long addr,
+                                          struct module *owner)
+{
+    int len = strlen(name);
+    struct import_entry *entry = kp_malloc(sizeof(struct import_entry) + len + 1);
+    if (!entry) return 0;
+    entry->hash = hash;
+    entry->addr = addr;
+    entry->owner = owner;
+    memcpy(entry->name, name, len + 1);
+    struct import_entry **head = &import_table[hash & (IMPORT_HASH_SIZE - 1)];
+    entry->next = *head;
+    *head = entry;
+    return entry;
+}
+
+static int module_add_dep(struct module *mod, struct module *dep)
+{
+    for (int i = 0; i < mod->dep_num; i++) {
+        if (mod->deps[i] == dep) return 0;
+    }
+    struct module **deps = kp_realloc(mod->deps, (mod->dep_num + 1) * sizeof(*deps));
+    if (!deps) return -ENOMEM;
+    mod->deps = deps;
+    mod->deps[mod->dep_num++] = dep;
+    dep->users++;
+    return 0;
+}
+
+unsigned long module_import_lookup(struct module *mod, const char *name)
+{
+    unsigned long hash = import_hash(name);
+    unsigned long addr = 0;
+
+    spin_lock(&import_lock);
+    struct import_entry *entry = import_find(name, hash);
+    if (entry) {
+        if (entry->owner && module_add_dep(mod, entry->owner)) goto out;
+        addr = entry->addr;
+        goto out;
+    }
+    addr = symbol_lookup_name(name);
+    if (addr) import_insert(name, hash, addr, 0);
+out:
+    spin_unlock(&import_lock);
+    return addr;
+}
+
+int module_export_symbols(struct module *mod)
+{
+    int num = 0;
+    spin_lock(&import_lock);
+    for (int i = 0; i < mod->symbol_num; i++) {
+        kp_symbol_t *symbol = &mod->symbols[i];
+        unsigned long hash = import_hash(symbol->name);
+        if (import_find(symbol->name, hash) || symbol_lookup_name(symbol->name)) {
+            logkw("[%s] symbol %s already exported\n", mod->info.name, symbol->name);
+            continue;
+        }
+        if (!import_insert(symbol->name, hash, symbol->addr, mod)) break;
+        num++;
+    }
+    spin_unlock(&import_lock);
+    if (num) logkfi("[%s] exported %d symbols\n", mod->info.name, num);
+    return num;
+}
+
+void module_release_symbols(struct module *mod)
+{
+    spin_lock(&import_lock);
+    for (int i = 0; i < IMPORT_HASH_SIZE; i++) {
+        struct import_entry **pos = &import_table[i];
+        while (*pos) {
+            struct import_entry *entry = *pos;
+            if (entry->owner == mod) {
+                *pos = entry->next;
+                kp_free(entry);
+            } else {
+                pos = &entry->next;
+            }
+        }
+    }
+    for (int i = 0; i < mod->dep_num; i++) {
+        mod->deps[i]->users--;
+    }
+    spin_unlock(&import_lock);
+    if (mod->deps) kp_free(mod->deps);
+    mod->deps = 0;
+    mod->dep_num = 0;
+}
+
+unsigned long module_import_size(struct module *mod)
+{
+    unsigned long size = mod->dep_num * sizeof(*mod->deps);
+    spin_lock(&import_lock);
+    for (int i = 0; i < IMPORT_HASH_SIZE; i++) {
+        for (struct import_entry *entry = import_table[i]; entry; entry = entry->next) {
+            if (entry->owner == mod) size += sizeof(struct import_entry) + strlen(entry->name) + 1;
+        }
+    }
+    spin_unlock(&import_lock);
+    return size;
+}
+
+int module_import_init()
+{
+    spin_lock_init(&import_lock);
+    return 0;
+}
@@ -15,6 +15,8 @@
 #include <linux/fs.h>
 #include <uapi/linux/fs.h>
 #include <hotpatch.h>
+#include <hook.h>
+#include <taskob.h>
 #include <linux/list.h>
 #include <linux/kernel.h>
 #include <linux/spinlock.h>
@@ -22,6 +24,11 @@
 #include <linux/vmalloc.h>
 #include <linux/rcupdate.h>
 #include <linux/rculist.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+
+#include <preset.h>
+#include <uapi/scdefs.h>
 
 #include "module.h"
 #include "relo.h"
@@ -33,6 +40,8 @@
 
 #define align(X) ALIGN(X, page_size)
 
+#define MODULE_RW_HEADROOM (256 << 10)
+
 #define elf_check_arch(x) ((x)->e_machine == EM_AARCH64)
 
 #define ARCH_SHF_SMALL 0
@@ -186,7 +195,7 @@ static int simplify_symbols(struct module *mod, const struct load_info *info)
         case SHN_ABS:
             break;
         case SHN_UNDEF:
-            unsigned long addr = symbol_lookup_name(name);
+            unsigned long addr = module_import_lookup(mod, name);
             // kernel symbol cause overflow in relocation
             // if (!addr) addr = kallsyms_lookup_name(name);
             if (!addr) {
@@ -272,14 +281,24 @@ static int rewrite_section_headers(struct load_info *info)
     return 0;
 }
 
+// the kp heaps can only grow where sleeping is allowed, leave some rw room for what the module does later
+static void *module_alloc_exec(size_t align, size_t size)
+{
+    if (kp_heap_free(0) < MODULE_RW_HEADROOM) kp_heap_grow(0, MODULE_RW_HEADROOM);
+    void *start = kp_memalign_exec(align, size);
+    if (!start && !kp_heap_grow(1, size + align)) start = kp_memalign_exec(align, size);
+    return start;
+}
+
 static int move_module(struct module *mod, struct load_info *info)
 {
     // todo:
     logki("alloc module size: %llx\n", mod->size);
-    mod->start = kp_malloc_exec(mod->size);
+    mod->start = module_alloc_exec(page_size, mod->size);
     if (!mod->start) {
         return -ENOMEM;
     }
+    kp_exec_set_writable(mod->start, mod->size, 1);
     memset(mod->start, 0, mod->size);
 
     /* Transfer each section which specifies SHF_ALLOC */
@@ -303,10 +322,17 @@ static int move_module(struct module *mod, struct load_info *info)
 
         if (!strcmp(".kpm.ctl0", sname)) mod->ctl0 = (mod_ctl0call_t *)dest;
         if (!strcmp(".kpm.ctl1", sname)) mod->ctl1 = (mod_ctl1call_t *)dest;
+        if (!strcmp(".kpm.handover", sname)) mod->handover = (mod_handovercall_t *)dest;
+        if (!strcmp(".kpm.upgrade", sname)) mod->upgrade = (mod_upgradecall_t *)dest;
 
         if (!mod->exit && !strcmp(".kpm.exit", sname)) mod->exit = (mod_exitcall_t *)dest;
 
         if (!mod->info.base && !strcmp(".kpm.info", sname)) mod->info.base = (const char *)dest;
+
+        if (!mod->symbols && !strcmp(".kpm.symbol", sname)) {
+            mod->symbols = (kp_symbol_t *)dest;
+            mod->symbol_num = shdr->sh_size / sizeof(kp_symbol_t);
+        }
     }
     mod->info.name = info->info.name - info->info.base + mod->info.base;
     mod->info.version = info->info.version - info->info.base + mod->info.base;
@@ -398,18 +424,206 @@ static int elf_header_check(struct load_info *info)
 }
 
 struct module modules = { 0 };
-static spinlock_t module_lock;
+// held across module callbacks, which may sleep, so a kernel mutex and not a spinlock
+static struct mutex module_mutex;
 
-long load_module(const void *data, int len, const char *args, const char *event, void *__user reserved)
+void modules_lock()
+{
+    mutex_lock(&module_mutex);
+}
+
+void modules_unlock()
+{
+    mutex_unlock(&module_mutex);
+}
+
+static void free_module(struct module *mod)
+{
+    module_release_symbols(mod);
+    if (mod->args) kvfree(mod->args);
+    if (mod->start) {
+        klog_forget((uint64_t)mod->start, (uint64_t)mod->start + mod->size);
+        kp_exec_set_writable(mod->start, mod->size, 0);
+        kp_free_exec(mod->start);
+    }
+    kvfree(mod);
+}
+
+static inline const char *prelink_str(void *image, int32_t offset)
+{
+    return offset == KPM_PRELINK_NONE ? 0 : (const char *)image + offset;
+}
+
+// [offset, offset + size) inside [0, limit), KPM_PRELINK_NONE allowed if optional
+static inline int prelink_range_ok(int32_t offset, int64_t size, int64_t limit, int optional)
+{
+    if (optional && offset == KPM_PRELINK_NONE) return 1;
+    return offset >= 0 && size >= 0 && offset + size <= limit;
+}
+
+// NUL terminated string starting at offset, inside [0, limit) of base
+static inline int prelink_str_ok(const char *base, int32_t offset, int64_t limit, int optional)
+{
+    if (optional && offset == KPM_PRELINK_NONE) return 1;
+    return offset >= 0 && offset < limit && memchr(base + offset, 0, limit - offset);
+}
+
+// the header comes from userspace or an extra item, nothing in it is trusted before this
+static int prelink_header_check(const kpm_prelink_header_t *hdr, int len)
+{
+    const char *data = (const char *)hdr;
+    int64_t image_size = hdr->image_size;
+    const char *image = data + hdr->image_offset;
+
+    if (hdr->image_offset < (int64_t)sizeof(*hdr) || image_size < 0 || image_size > hdr->mem_size ||
+        (int64_t)hdr->image_offset + image_size > len)
+        return -ENOEXEC;
+    if (hdr->fixup_num < 0 ||
+        !prelink_range_ok(hdr->fixup_offset, (int64_t)hdr->fixup_num * sizeof(kpm_prelink_fixup_t), len, 0))
+        return -ENOEXEC;
+
+    // entries are code, they lie in the copied image and hold at least one instruction
+    if (!prelink_range_ok(hdr->init, 4, image_size, 0) || !prelink_range_ok(hdr->exit, 4, image_size, 0) ||
+        !prelink_range_ok(hdr->ctl0, 4, image_size, 1) || !prelink_range_ok(hdr->ctl1, 4, image_size, 1) ||
+        !prelink_range_ok(hdr->handover, 4, image_size, 1) || !prelink_range_ok(hdr->upgrade, 4, image_size, 1))
+        return -ENOEXEC;
+    if (hdr->symbol_size > 0 && !prelink_range_ok(hdr->symbol_offset, hdr->symbol_size, image_size, 0))
+        return -ENOEXEC;
+    if (hdr->text_size < 0 || hdr->text_size > hdr->ro_size || hdr->ro_size > hdr->mem_size) return -ENOEXEC;
+
+    if (!prelink_str_ok(image, hdr->name, image_size, 0) || !prelink_str_ok(image, hdr->version, image_size, 0) ||
+        !prelink_str_ok(image, hdr->license, image_size, 1) || !prelink_str_ok(image, hdr->author, image_size, 1) ||
+        !prelink_str_ok(image, hdr->description, image_size, 1))
+        return -ENOEXEC;
+
+    if (hdr->import_num < 0) return -ENOEXEC;
+    int32_t import = hdr->import_offset;
+    for (int i = 0; i < hdr->import_num; i++) {
+        if (!prelink_str_ok(data, import, len, 0)) return -ENOEXEC;
+        import += strlen(data + import) + 1;
+    }
+    return 0;
+}
+
+// image laid out and relocated by kptools, only the fixups depending on the load address are left
+static long stage_prelinked_module(const void *data, int len, const char *args, int replace, struct module **out)
+{
+    const kpm_prelink_header_t *hdr = (const kpm_prelink_header_t *)data;
+    const char *image = (const char *)data + hdr->image_offset;
+    unsigned long *imports = 0;
+    long rc = 0;
+
+    if (prelink_header_check(hdr, len)) return -ENOEXEC;
+
+    if (!replace && find_module(image + hdr->name)) {
+        logkfd("%s exist\n", image + hdr->name);
+        return -EEXIST;
+    }
+
+    struct module *mod = (struct module *)vmalloc(sizeof(struct module));
+    if (!mod) return -ENOMEM;
+    memset(mod, 0, sizeof(struct module));
+
+    if (args) {
+        mod->args = vmalloc(strlen(args) + 1);
+        if (!mod->args) {
+            rc = -ENOMEM;
+            goto free;
+        }
+        strcpy(mod->args, args);
+    }
+
+    if (hdr->import_num > 0) {
+        imports = vmalloc(hdr->import_num * sizeof(*imports));
+        if (!imports) {
+            rc = -ENOMEM;
+            goto free;
+        }
+        const char *import = (const char *)data + hdr->import_offset;
+        for (int i = 0; i < hdr->import_num; i++) {
+            imports[i] = module_import_lookup(mod, import);
+            if (!imports[i]) {
+                logke("unknown symbol: %s\n", import);
+                rc = -ENOENT;
+                goto free;
+            }
+            import += strlen(import) + 1;
+        }
+    }
+
+    // whole pages, so changing this module's permissions never touches a neighbour,
+    // page_size is a multiple of KPM_PRELINK_ALIGN
+    mod->size = align(hdr->mem_size);
+    mod->start = module_alloc_exec(page_size, mod->size);
+    if (!mod->start) {
+        rc = -ENOMEM;
+        goto free;
+    }
+    kp_exec_set_writable(mod->start, mod->size, 1);
+    memcpy(mod->start, image, hdr->image_size);
+    memset(mod->start + hdr->image_size, 0, mod->size - hdr->image_size);
+
+    const kpm_prelink_fixup_t *fixup = (const kpm_prelink_fixup_t *)((const char *)data + hdr->fixup_offset);
+    for (int i = 0; i < hdr->fixup_num; i++, fixup++) {
+        unsigned long base = (unsigned long)mod->start;
+        if (fixup->import != KPM_PRELINK_SELF) base = fixup->import < hdr->import_num ? imports[fixup->import] : 0;
+        // every fixup type writes at most 8 bytes
+        if (!base || (int64_t)fixup->offset + 8 > hdr->mem_size) {
+            rc = -ENOEXEC;
+            goto free;
+        }
+        rc = apply_relocate_one(fixup->type, mod->start + fixup->offset, base + fixup->addend);
+        if (rc) goto free;
+    }
+
+    // kptools ends text and rodata on the target's page boundaries, an image laid out for smaller pages
+    // only gets the pages wholly inside its read-only prefix protected, the one shared with data stays writable
+    mod->text_size = hdr->text_size;
+    mod->ro_size = hdr->ro_size & ~(page_size - 1);
+    kp_exec_set_writable(mod->start, mod->ro_size, 0);
+    flush_icache_all();
+
+    mod->init = (mod_initcall_t *)(mod->start + hdr->init);
+    mod->exit = (mod_exitcall_t *)(mod->start + hdr->exit);
+    if (hdr->ctl0 != KPM_PRELINK_NONE) mod->ctl0 = (mod_ctl0call_t *)(mod->start + hdr->ctl0);
+    if (hdr->ctl1 != KPM_PRELINK_NONE) mod->ctl1 = (mod_ctl1call_t *)(mod->start + hdr->ctl1);
+    if (hdr->handover != KPM_PRELINK_NONE) mod->handover = (mod_handovercall_t *)(mod->start + hdr->handover);
+    if (hdr->upgrade != KPM_PRELINK_NONE) mod->upgrade = (mod_upgradecall_t *)(mod->start + hdr->upgrade);
+    mod->info.base = prelink_str(mod->start, hdr->name);
+    mod->info.name = prelink_str(mod->start, hdr->name);
+    mod->info.version = prelink_str(mod->start, hdr->version);
+    mod->info.license = prelink_str(mod->start, hdr->license);
+    mod->info.author = prelink_str(mod->start, hdr->author);
+    mod->info.description = prelink_str(mod->start, hdr->description);
+    if (hdr->symbol_size > 0) {
+        mod->symbols = (kp_symbol_t *)(mod->start + hdr->symbol_offset);
+        mod->symbol_num = hdr->symbol_size / sizeof(kp_symbol_t);
+    }
+
+    *out = mod;
+    goto out;
+
+free:
+    free_module(mod);
+out:
+    if (imports) kvfree(imports);
+    return rc;
+}
+
+// replace: a module with the same name may be loaded, the staged one is meant to take its place
+static long do_stage_module(const void *data, int len, const char *args, int replace, struct module **out)
 {
     struct load_info load_info = { .len = len, .hdr = data };
     struct load_info *info = &load_info;
     long rc = 0;
 
+    if (len > sizeof(kpm_prelink_header_t) && !memcmp(data, KPM_PRELINK_MAGIC, sizeof(KPM_PRELINK_MAGIC)))
+        return stage_prelinked_module(data, len, args, replace, out);
+
     if ((rc = elf_header_check(info))) goto out;
     if ((rc = setup_load_info(info))) goto out;
 
-    if (find_module(info->info.name)) {
+    if (!replace && find_module(info->info.name)) {
         logkfd("%s exist\n", info->info.name);
         rc = -EEXIST;
         goto out;
@@ -423,7 +637,7 @@ long load_module(const void *data, int len, const char *args, const char *event,
         mod->args = vmalloc(strlen(args) + 1);
         if (!mod->args) {
             rc = -ENOMEM;
-            goto free1;
+            goto free;
         }
         strcpy(mod->args, args);
     }
@@ -435,34 +649,60 @@ long load_module(const void *data, int len, const char *args, const char *event,
     if ((rc = simplify_symbols(mod, info))) goto free;
     if ((rc = apply_relocations(mod, info))) goto free;
 
+    // text and rodata are page aligned by layout_sections, data and bss after them stay writable
+    kp_exec_set_writable(mod->start, mod->ro_size, 0);
     flush_icache_all();
 
-    rc = (*mod->init)(mod->args, event, reserved);
+    *out = mod;
+    goto out;
 
+free:
+    free_module(mod);
+out:
+    return rc;
+}
+
+long stage_module(const void *data, int len, const char *args, struct module **out)
+{
+    return do_stage_module(data, len, args, 0, out);
+}
+
+long start_module(struct module *mod, const char *event, void *__user reserved)
+{
+    if (find_module(mod->info.name)) {
+        logkfd("%s exist\n", mod->info.name);
+        free_module(mod);
+        return -EEXIST;
+    }
+
+    long rc = (*mod->init)(mod->args, event, reserved);
     if (!rc) {
-        logkfi("[%s] succeed with [%s] \n", mod->info.name, args);
+        logkfi("[%s] succeed with [%s] \n", mod->info.name, mod->args);
+        module_export_symbols(mod);
         list_add_tail(&mod->list, &modules.list);
-        goto out;
     } else {
-        logkfi("[%s] failed with [%s] error: %d, try exit ...\n", mod->info.name, args, rc);
+        logkfi("[%s] failed with [%s] error: %d, try exit ...\n", mod->info.name, mod->args, rc);
         (*mod->exit)(reserved);
+        free_module(mod);
     }
+    return rc;
+}
 
-free:
-    if (mod->args) kvfree(mod->args);
-    kp_free_exec(mod->start);
-free1:
-    kvfree(mod);
-out:
+long load_module(const void *data, int len, const char *args, const char *event, void *__user reserved)
+{
+    struct module *mod = 0;
+    modules_lock();
+    long rc = stage_module(data, len, args, &mod);
+    if (!rc) rc = start_module(mod, event, reserved);
+    modules_unlock();
     return rc;
 }
 
-// todo: lock
 long unload_module(const char *name, void *__user reserved)
 {
     logkfe("name: %s\n", name);
 
-    rcu_read_lock();
+    modules_lock();
     long rc = 0;
 
     struct module *mod = find_module(name);
@@ -470,23 +710,91 @@ long unload_module(const char *name, void *__user reserved)
         rc = -ENOENT;
         goto out;
     }
+    if (mod->users) {
+        logkfe("[%s] symbols in use by %d modules\n", name, mod->users);
+        rc = -EBUSY;
+        goto out;
+    }
     list_del(&mod->list);
+    module_release_symbols(mod);
     rc = (*mod->exit)(reserved);
 
-    if (mod->args) kvfree(mod->args);
     if (mod->ctl_args) kvfree(mod->ctl_args);
-
-    kp_free_exec(mod->start);
-    kvfree(mod);
+    free_module(mod);
 
     logkfi("name: %s, rc: %d\n", name, rc);
 
 out:
-    rcu_read_unlock();
+    modules_unlock();
+    kp_heap_trim();
     return rc;
 }
 
-long load_module_path(const char *path, const char *args, void *__user reserved)
+// Replace a running module without a window where its hooks are gone: the new image is loaded next to the old one,
+// takes over the old one's state and swaps its callbacks into the same hook chain items, then the old image is freed
+// after a best effort grace period. The old module's exit is never called. If any hook still points into the old
+// image after the upgrade callback, the image is kept rather than freed under it.
+long upgrade_module(const void *data, int len, const char *args, void *__user reserved)
+{
+    struct module *mod = 0;
+    modules_lock();
+    long rc = do_stage_module(data, len, args, 1, &mod);
+    if (rc) goto out;
+
+    struct module *old = find_module(mod->info.name);
+    if (!old) {
+        rc = -ENOENT;
+        goto free;
+    }
+    if (!old->handover || !mod->upgrade) {
+        logkfe("[%s] no handover or upgrade callback\n", mod->info.name);
+        rc = -EOPNOTSUPP;
+        goto free;
+    }
+    // importers hold relocations into the old image, including the new module itself
+    if (old->users) {
+        logkfe("[%s] symbols in use by %d modules\n", old->info.name, old->users);
+        rc = -EBUSY;
+        goto free;
+    }
+
+    void *state = 0;
+    rc = (*old->handover)(&state, reserved);
+    if (rc) {
+        logkfe("[%s] handover error: %d\n", old->info.name, rc);
+        goto free;
+    }
+    // on failure the new module must have left the old callbacks in place, the old module keeps running
+    rc = (*mod->upgrade)(mod->args, state, reserved);
+    if (rc) {
+        logkfe("[%s] upgrade error: %d\n", mod->info.name, rc);
+        goto free;
+    }
+
+    list_replace_rcu(&old->list, &mod->list);
+    module_release_symbols(old);
+    module_export_symbols(mod);
+    logkfi("[%s] %s upgraded to %s with [%s]\n", mod->info.name, old->info.version, mod->info.version, mod->args);
+
+    // Hook transits and task event deliveries don't count who is inside them and callbacks may sleep, so no wait
+    // proves the old text idle. The image is retired instead of freed: it stays mapped for good, unreachable from
+    // the module list, the way hook_unwrap_retire keeps a transit around. Leftover references are only reported.
+    uint64_t start = (uint64_t)old->start, end = start + old->size;
+    int hook_refs = hook_mem_refs(start, end);
+    int event_refs = task_event_refs(start, end);
+    logkfi("[%s] old image retired, %d bytes kept, %d hook and %d task event refs left\n", mod->info.name, old->size,
+           hook_refs, event_refs);
+    modules_unlock();
+    return 0;
+
+free:
+    free_module(mod);
+out:
+    modules_unlock();
+    return rc;
+}
+
+static long read_module_file(const char *path, void **out, loff_t *out_len)
 {
     long rc = 0;
     logkfd("%s\n", path);
@@ -494,8 +802,7 @@ long load_module_path(const char *path, const char *args, void *__user reserved)
     struct file *filp = filp_open(path, O_RDONLY, 0);
     if (unlikely(!filp || IS_ERR(filp))) {
         logkfe("open module: %s error\n", path);
-        rc = PTR_ERR(filp);
-        goto out;
+        return PTR_ERR(filp);
     }
     loff_t len = vfs_llseek(filp, 0, SEEK_END);
     logkfd("module size: %llx\n", len);
@@ -503,8 +810,8 @@ long load_module_path(const char *path, const char *args, void *__user reserved)
 
     void *data = vmalloc(len);
     if (!data) {
-        rc = -ENOMEM;
-        goto out;
+        filp_close(filp, 0);
+        return -ENOMEM;
     }
     memset(data, 0, len);
 
@@ -514,14 +821,34 @@ long load_module_path(const char *path, const char *args, void *__user reserved)
 
     if (pos != len) {
         logkfe("read module: %s error\n", path);
+        kvfree(data);
         rc = -EIO;
-        goto free;
+    } else {
+        *out = data;
+        *out_len = len;
     }
+    return rc;
+}
 
+long load_module_path(const char *path, const char *args, void *__user reserved)
+{
+    void *data = 0;
+    loff_t len = 0;
+    long rc = read_module_file(path, &data, &len);
+    if (rc) return rc;
     rc = load_module(data, len, args, "load-file", reserved);
-free:
     kvfree(data);
-out:
+    return rc;
+}
+
+long upgrade_module_path(const char *path, const char *args, void *__user reserved)
+{
+    void *data = 0;
+    loff_t len = 0;
+    long rc = read_module_file(path, &data, &len);
+    if (rc) return rc;
+    rc = upgrade_module(data, len, args, reserved);
+    kvfree(data);
     return rc;
 }
 
@@ -534,7 +861,7 @@ long module_control0(const char *name, const char *ctl_args, char *__user out_ms
     logkfi("name %s, args: %s\n", name, ctl_args);
 
     long rc = 0;
-    rcu_read_lock();
+    modules_lock();
 
     struct module *mod = find_module(name);
     if (!mod) {
@@ -562,7 +889,7 @@ long module_control0(const char *name, const char *ctl_args, char *__user out_ms
 
     logkfi("name: %s, rc: %d\n", name, rc);
 out:
-    rcu_read_unlock();
+    modules_unlock();
     return rc;
 }
 
@@ -570,7 +897,7 @@ long module_control1(const char *name, void *a1, void *a2, void *a3)
 {
     logkfi("name %s, a1: %llx, a2: %llx, a3: %llx\n", name, a1, a2, a3);
     long rc = 0;
-    rcu_read_lock();
+    modules_lock();
 
     struct module *mod = find_module(name);
     if (!mod) {
@@ -588,7 +915,7 @@ long module_control1(const char *name, void *a1, void *a2, void *a3)
 
     logkfi("name: %s, rc: %d\n", name, rc);
 out:
-    rcu_read_unlock();
+    modules_unlock();
     return rc;
 }
 
@@ -606,7 +933,7 @@ struct module *find_module(const char *name)
 
 int get_module_nums()
 {
-    rcu_read_lock();
+    modules_lock();
 
     struct module *pos;
     int n = 0;
@@ -614,7 +941,7 @@ int get_module_nums()
     {
         n++;
     }
-    rcu_read_unlock();
+    modules_unlock();
 
     logkfd("%d\n", n);
     return n;
@@ -622,7 +949,7 @@ int get_module_nums()
 
 int list_modules(char *out_names, int size)
 {
-    rcu_read_lock();
+    modules_lock();
 
     struct module *pos;
     int off = 0;
@@ -632,19 +959,42 @@ int list_modules(char *out_names, int size)
     }
     out_names[off] = '\0';
 
-    rcu_read_unlock();
+    modules_unlock();
     return off;
 }
 
+int get_module_mem_stat(struct kp_mod_mem_stat *out, int max)
+{
+    modules_lock();
+
+    struct module *pos;
+    int n = 0;
+    list_for_each_entry(pos, &modules.list, list)
+    {
+        if (n < max) {
+            struct kp_mod_mem_stat *stat = &out[n];
+            strncpy(stat->name, pos->info.name, sizeof(stat->name) - 1);
+            stat->name[sizeof(stat->name) - 1] = '\0';
+            stat->exec_size = pos->size;
+            stat->ro_size = pos->ro_size;
+            stat->rw_size = module_import_size(pos);
+        }
+        n++;
+    }
+    modules_unlock();
+    return n;
+}
+
 int get_module_info(const char *name, char *out_info, int size)
 {
     if (size <= 0) return 0;
-    rcu_read_lock();
+    modules_lock();
 
+    int sz = -ENOENT;
     struct module *mod = find_module(name);
-    if (!mod) return -ENOENT;
+    if (!mod) goto out;
 
-    int sz = snprintf(out_info, size - 1,
+    sz = snprintf(out_info, size - 1,
                       "name=%s\n"
                       "version=%s\n"
                       "license=%s\n"
@@ -655,13 +1005,15 @@ int get_module_info(const char *name, char *out_info, int size)
                       mod->args);
     logkfd("%s", out_info);
 
-    rcu_read_unlock();
+out:
+    modules_unlock();
     return sz;
 }
 
 int module_init()
 {
+    if (!kfunc(__mutex_init) || !kfunc(mutex_lock) || !kfunc(mutex_unlock)) return -ENOENT;
+    mutex_init(&module_mutex);
     INIT_LIST_HEAD(&modules.list);
-    spin_lock_init(&module_lock);
-    return 0;
+    return module_import_init();
 }
\ No newline at end of file
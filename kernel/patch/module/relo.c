@@ -165,12 +165,155 @@ int apply_relocate(Elf64_Shdr *sechdrs, const char *strtab, unsigned int syminde
     return 0;
 };
 
+int apply_relocate_one(uint32_t type, void *loc, u64 val)
+{
+    int ovf;
+    bool overflow_check = true;
+
+    switch (type) {
+    /* Null relocations. */
+    case R_ARM_NONE:
+    case R_AARCH64_NONE:
+        ovf = 0;
+        break;
+    /* Data relocations. */
+    case R_AARCH64_ABS64:
+        overflow_check = false;
+        ovf = reloc_data(RELOC_OP_ABS, loc, val, 64);
+        break;
+    case R_AARCH64_ABS32:
+        ovf = reloc_data(RELOC_OP_ABS, loc, val, 32);
+        break;
+    case R_AARCH64_ABS16:
+        ovf = reloc_data(RELOC_OP_ABS, loc, val, 16);
+        break;
+    case R_AARCH64_PREL64:
+        overflow_check = false;
+        ovf = reloc_data(RELOC_OP_PREL, loc, val, 64);
+        break;
+    case R_AARCH64_PREL32:
+        ovf = reloc_data(RELOC_OP_PREL, loc, val, 32);
+        break;
+    case R_AARCH64_PREL16:
+        ovf = reloc_data(RELOC_OP_PREL, loc, val, 16);
+        break;
+
+    /* MOVW instruction relocations. */
+    case R_AARCH64_MOVW_UABS_G0_NC:
+        overflow_check = false;
+    case R_AARCH64_MOVW_UABS_G0:
+        ovf = reloc_insn_movw(RELOC_OP_ABS, loc, val, 0, AARCH64_INSN_IMM_16);
+        break;
+    case R_AARCH64_MOVW_UABS_G1_NC:
+        overflow_check = false;
+    case R_AARCH64_MOVW_UABS_G1:
+        ovf = reloc_insn_movw(RELOC_OP_ABS, loc, val, 16, AARCH64_INSN_IMM_16);
+        break;
+    case R_AARCH64_MOVW_UABS_G2_NC:
+        overflow_check = false;
+    case R_AARCH64_MOVW_UABS_G2:
+        ovf = reloc_insn_movw(RELOC_OP_ABS, loc, val, 32, AARCH64_INSN_IMM_16);
+        break;
+    case R_AARCH64_MOVW_UABS_G3:
+        /* We're using the top bits so we can't overflow. */
+        overflow_check = false;
+        ovf = reloc_insn_movw(RELOC_OP_ABS, loc, val, 48, AARCH64_INSN_IMM_16);
+        break;
+    case R_AARCH64_MOVW_SABS_G0:
+        ovf = reloc_insn_movw(RELOC_OP_ABS, loc, val, 0, AARCH64_INSN_IMM_MOVNZ);
+        break;
+    case R_AARCH64_MOVW_SABS_G1:
+        ovf = reloc_insn_movw(RELOC_OP_ABS, loc, val, 16, AARCH64_INSN_IMM_MOVNZ);
+        break;
+    case R_AARCH64_MOVW_SABS_G2:
+        ovf = reloc_insn_movw(RELOC_OP_ABS, loc, val, 32, AARCH64_INSN_IMM_MOVNZ);
+        break;
+    case R_AARCH64_MOVW_PREL_G0_NC:
+        overflow_check = false;
+        ovf = reloc_insn_movw(RELOC_OP_PREL, loc, val, 0, AARCH64_INSN_IMM_MOVK);
+        break;
+    case R_AARCH64_MOVW_PREL_G0:
+        ovf = reloc_insn_movw(RELOC_OP_PREL, loc, val, 0, AARCH64_INSN_IMM_MOVNZ);
+        break;
+    case R_AARCH64_MOVW_PREL_G1_NC:
+        overflow_check = false;
+        ovf = reloc_insn_movw(RELOC_OP_PREL, loc, val, 16, AARCH64_INSN_IMM_MOVK);
+        break;
+    case R_AARCH64_MOVW_PREL_G1:
+        ovf = reloc_insn_movw(RELOC_OP_PREL, loc, val, 16, AARCH64_INSN_IMM_MOVNZ);
+        break;
+    case R_AARCH64_MOVW_PREL_G2_NC:
+        overflow_check = false;
+        ovf = reloc_insn_movw(RELOC_OP_PREL, loc, val, 32, AARCH64_INSN_IMM_MOVK);
+        break;
+    case R_AARCH64_MOVW_PREL_G2:
+        ovf = reloc_insn_movw(RELOC_OP_PREL, loc, val, 32, AARCH64_INSN_IMM_MOVNZ);
+        break;
+    case R_AARCH64_MOVW_PREL_G3:
+        /* We're using the top bits so we can't overflow. */
+        overflow_check = false;
+        ovf = reloc_insn_movw(RELOC_OP_PREL, loc, val, 48, AARCH64_INSN_IMM_MOVNZ);
+        break;
+    /* Immediate instruction relocations. */
+    case R_AARCH64_LD_PREL_LO19:
+        ovf = reloc_insn_imm(RELOC_OP_PREL, loc, val, 2, 19, AARCH64_INSN_IMM_19);
+        break;
+    case R_AARCH64_ADR_PREL_LO21:
+        ovf = reloc_insn_imm(RELOC_OP_PREL, loc, val, 0, 21, AARCH64_INSN_IMM_ADR);
+        break;
+    case R_AARCH64_ADR_PREL_PG_HI21_NC:
+        overflow_check = false;
+    case R_AARCH64_ADR_PREL_PG_HI21:
+        ovf = reloc_insn_imm(RELOC_OP_PAGE, loc, val, 12, 21, AARCH64_INSN_IMM_ADR);
+        break;
+    case R_AARCH64_ADD_ABS_LO12_NC:
+    case R_AARCH64_LDST8_ABS_LO12_NC:
+        overflow_check = false;
+        ovf = reloc_insn_imm(RELOC_OP_ABS, loc, val, 0, 12, AARCH64_INSN_IMM_12);
+        break;
+    case R_AARCH64_LDST16_ABS_LO12_NC:
+        overflow_check = false;
+        ovf = reloc_insn_imm(RELOC_OP_ABS, loc, val, 1, 11, AARCH64_INSN_IMM_12);
+        break;
+    case R_AARCH64_LDST32_ABS_LO12_NC:
+        overflow_check = false;
+        ovf = reloc_insn_imm(RELOC_OP_ABS, loc, val, 2, 10, AARCH64_INSN_IMM_12);
+        break;
+    case R_AARCH64_LDST64_ABS_LO12_NC:
+        overflow_check = false;
+        ovf = reloc_insn_imm(RELOC_OP_ABS, loc, val, 3, 9, AARCH64_INSN_IMM_12);
+        break;
+    case R_AARCH64_LDST128_ABS_LO12_NC:
+        overflow_check = false;
+        ovf = reloc_insn_imm(RELOC_OP_ABS, loc, val, 4, 8, AARCH64_INSN_IMM_12);
+        break;
+    case R_AARCH64_TSTBR14:
+        ovf = reloc_insn_imm(RELOC_OP_PREL, loc, val, 2, 14, AARCH64_INSN_IMM_14);
+        break;
+    case R_AARCH64_CONDBR19:
+        ovf = reloc_insn_imm(RELOC_OP_PREL, loc, val, 2, 19, AARCH64_INSN_IMM_19);
+        break;
+    case R_AARCH64_JUMP26:
+    case R_AARCH64_CALL26:
+        ovf = reloc_insn_imm(RELOC_OP_PREL, loc, val, 2, 26, AARCH64_INSN_IMM_26);
+        break;
+    default:
+        pr_err("unsupported RELA relocation: %u\n", type);
+        return -ENOEXEC;
+    }
+
+    if (overflow_check && ovf == -ERANGE) {
+        pr_err("overflow in relocation type %d val %llx\n", (int)type, val);
+        return -ENOEXEC;
+    }
+    return 0;
+}
+
 int apply_relocate_add(Elf64_Shdr *sechdrs, const char *strtab, unsigned int symindex, unsigned int relsec,
                        struct module *me)
 {
     unsigned int i;
-    int ovf;
-    bool overflow_check;
+    int rc;
     Elf64_Sym *sym;
     void *loc;
     u64 val;
@@ -184,145 +327,9 @@ int apply_relocate_add(Elf64_Shdr *sechdrs, const char *strtab, unsigned int sym
         /* val corresponds to (S + A) in the AArch64 ELF document. */
         val = sym->st_value + rel[i].r_addend;
 
-        overflow_check = true;
-
         /* Perform the static relocation. */
-        switch (ELF64_R_TYPE(rel[i].r_info)) {
-        /* Null relocations. */
-        case R_ARM_NONE:
-        case R_AARCH64_NONE:
-            ovf = 0;
-            break;
-        /* Data relocations. */
-        case R_AARCH64_ABS64:
-            overflow_check = false;
-            ovf = reloc_data(RELOC_OP_ABS, loc, val, 64);
-            break;
-        case R_AARCH64_ABS32:
-            ovf = reloc_data(RELOC_OP_ABS, loc, val, 32);
-            break;
-        case R_AARCH64_ABS16:
-            ovf = reloc_data(RELOC_OP_ABS, loc, val, 16);
-            break;
-        case R_AARCH64_PREL64:
-            overflow_check = false;
-            ovf = reloc_data(RELOC_OP_PREL, loc, val, 64);
-            break;
-        case R_AARCH64_PREL32:
-            ovf = reloc_data(RELOC_OP_PREL, loc, val, 32);
-            break;
-        case R_AARCH64_PREL16:
-            ovf = reloc_data(RELOC_OP_PREL, loc, val, 16);
-            break;
-
-        /* MOVW instruction relocations. */
-        case R_AARCH64_MOVW_UABS_G0_NC:
-            overflow_check = false;
-        case R_AARCH64_MOVW_UABS_G0:
-            ovf = reloc_insn_movw(RELOC_OP_ABS, loc, val, 0, AARCH64_INSN_IMM_16);
-            break;
-        case R_AARCH64_MOVW_UABS_G1_NC:
-            overflow_check = false;
-        case R_AARCH64_MOVW_UABS_G1:
-            ovf = reloc_insn_movw(RELOC_OP_ABS, loc, val, 16, AARCH64_INSN_IMM_16);
-            break;
-        case R_AARCH64_MOVW_UABS_G2_NC:
-            overflow_check = false;
-        case R_AARCH64_MOVW_UABS_G2:
-            ovf = reloc_insn_movw(RELOC_OP_ABS, loc, val, 32, AARCH64_INSN_IMM_16);
-            break;
-        case R_AARCH64_MOVW_UABS_G3:
-            /* We're using the top bits so we can't overflow. */
-            overflow_check = false;
-            ovf = reloc_insn_movw(RELOC_OP_ABS, loc, val, 48, AARCH64_INSN_IMM_16);
-            break;
-        case R_AARCH64_MOVW_SABS_G0:
-            ovf = reloc_insn_movw(RELOC_OP_ABS, loc, val, 0, AARCH64_INSN_IMM_MOVNZ);
-            break;
-        case R_AARCH64_MOVW_SABS_G1:
-            ovf = reloc_insn_movw(RELOC_OP_ABS, loc, val, 16, AARCH64_INSN_IMM_MOVNZ);
-            break;
-        case R_AARCH64_MOVW_SABS_G2:
-            ovf = reloc_insn_movw(RELOC_OP_ABS, loc, val, 32, AARCH64_INSN_IMM_MOVNZ);
-            break;
-        case R_AARCH64_MOVW_PREL_G0_NC:
-            overflow_check = false;
-            ovf = reloc_insn_movw(RELOC_OP_PREL, loc, val, 0, AARCH64_INSN_IMM_MOVK);
-            break;
-        case R_AARCH64_MOVW_PREL_G0:
-            ovf = reloc_insn_movw(RELOC_OP_PREL, loc, val, 0, AARCH64_INSN_IMM_MOVNZ);
-            break;
-        case R_AARCH64_MOVW_PREL_G1_NC:
-            overflow_check = false;
-            ovf = reloc_insn_movw(RELOC_OP_PREL, loc, val, 16, AARCH64_INSN_IMM_MOVK);
-            break;
-        case R_AARCH64_MOVW_PREL_G1:
-            ovf = reloc_insn_movw(RELOC_OP_PREL, loc, val, 16, AARCH64_INSN_IMM_MOVNZ);
-            break;
-        case R_AARCH64_MOVW_PREL_G2_NC:
-            overflow_check = false;
-            ovf = reloc_insn_movw(RELOC_OP_PREL, loc, val, 32, AARCH64_INSN_IMM_MOVK);
-            break;
-        case R_AARCH64_MOVW_PREL_G2:
-            ovf = reloc_insn_movw(RELOC_OP_PREL, loc, val, 32, AARCH64_INSN_IMM_MOVNZ);
-            break;
-        case R_AARCH64_MOVW_PREL_G3:
-            /* We're using the top bits so we can't overflow. */
-            overflow_check = false;
-            ovf = reloc_insn_movw(RELOC_OP_PREL, loc, val, 48, AARCH64_INSN_IMM_MOVNZ);
-            break;
-        /* Immediate instruction relocations. */
-        case R_AARCH64_LD_PREL_LO19:
-            ovf = reloc_insn_imm(RELOC_OP_PREL, loc, val, 2, 19, AARCH64_INSN_IMM_19);
-            break;
-        case R_AARCH64_ADR_PREL_LO21:
-            ovf = reloc_insn_imm(RELOC_OP_PREL, loc, val, 0, 21, AARCH64_INSN_IMM_ADR);
-            break;
-        case R_AARCH64_ADR_PREL_PG_HI21_NC:
-            overflow_check = false;
-        case R_AARCH64_ADR_PREL_PG_HI21:
-            ovf = reloc_insn_imm(RELOC_OP_PAGE, loc, val, 12, 21, AARCH64_INSN_IMM_ADR);
-            break;
-        case R_AARCH64_ADD_ABS_LO12_NC:
-        case R_AARCH64_LDST8_ABS_LO12_NC:
-            overflow_check = false;
-            ovf = reloc_insn_imm(RELOC_OP_ABS, loc, val, 0, 12, AARCH64_INSN_IMM_12);
-            break;
-        case R_AARCH64_LDST16_ABS_LO12_NC:
-            overflow_check = false;
-            ovf = reloc_insn_imm(RELOC_OP_ABS, loc, val, 1, 11, AARCH64_INSN_IMM_12);
-            break;
-        case R_AARCH64_LDST32_ABS_LO12_NC:
-            overflow_check = false;
-            ovf = reloc_insn_imm(RELOC_OP_ABS, loc, val, 2, 10, AARCH64_INSN_IMM_12);
-            break;
-        case R_AARCH64_LDST64_ABS_LO12_NC:
-            overflow_check = false;
-            ovf = reloc_insn_imm(RELOC_OP_ABS, loc, val, 3, 9, AARCH64_INSN_IMM_12);
-            break;
-        case R_AARCH64_LDST128_ABS_LO12_NC:
-            overflow_check = false;
-            ovf = reloc_insn_imm(RELOC_OP_ABS, loc, val, 4, 8, AARCH64_INSN_IMM_12);
-            break;
-        case R_AARCH64_TSTBR14:
-            ovf = reloc_insn_imm(RELOC_OP_PREL, loc, val, 2, 14, AARCH64_INSN_IMM_14);
-            break;
-        case R_AARCH64_CONDBR19:
-            ovf = reloc_insn_imm(RELOC_OP_PREL, loc, val, 2, 19, AARCH64_INSN_IMM_19);
-            break;
-        case R_AARCH64_JUMP26:
-        case R_AARCH64_CALL26:
-            ovf = reloc_insn_imm(RELOC_OP_PREL, loc, val, 2, 26, AARCH64_INSN_IMM_26);
-            break;
-        default:
-            pr_err("unsupported RELA relocation: %llu\n", ELF64_R_TYPE(rel[i].r_info));
-            return -ENOEXEC;
-        }
-
-        if (overflow_check && ovf == -ERANGE) goto overflow;
+        rc = apply_relocate_one(ELF64_R_TYPE(rel[i].r_info), loc, val);
+        if (rc) return rc;
     }
     return 0;
-overflow:
-    pr_err("overflow in relocation type %d val %llx\n", (int)ELF64_R_TYPE(rel[i].r_info), val);
-    return -ENOEXEC;
-}
\ No newline at end of file
+}
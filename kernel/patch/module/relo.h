@@ -5,6 +5,7 @@
 
 int apply_relocate_add(Elf64_Shdr *sechdrs, const char *strtab, unsigned int symindex, unsigned int relsec,
                        struct module *me);
+int apply_relocate_one(uint32_t type, void *loc, u64 val);
 int apply_relocate(Elf64_Shdr *sechdrs, const char *strtab, unsigned int symindex, unsigned int relsec,
                    struct module *me);
 
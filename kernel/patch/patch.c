@@ -13,6 +13,12 @@
 #include <module.h>
 #include <predata.h>
 #include <linux/string.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <kpmalloc.h>
+#include <exechook.h>
+#include <bootprof.h>
+#include <kpinit.h>
 
 int linux_misc_symbol_init();
 int linux_libs_symbol_init();
@@ -24,19 +30,16 @@ int resolve_pt_regs();
 
 void print_bootlog()
 {
-    const char *log = get_boot_log();
-    char buf[1024];
-    int off = 0;
-    char c;
-    for (int i = 0; (c = log[i]); i++) {
-        if (c == '\n') {
-            buf[off++] = c;
-            buf[off] = '\0';
-
-            printk("KP %s", buf);
-            off = 0;
-        } else {
-            buf[off++] = log[i];
+    char buf[LOG_LINE_MAX];
+    uint64_t pos = 0;
+    while (klog_read(KLOG_BOOT, &pos, buf, sizeof(buf)) > 0) {
+        for (char *line = buf, *end; *line; line = end) {
+            end = strchr(line, '\n');
+            end = end ? end + 1 : line + strlen(line);
+            char c = *end;
+            *end = '\0';
+            printk("KP %s", line);
+            *end = c;
         }
     }
 }
@@ -48,74 +51,158 @@ void before_panic(hook_fargs12_t *args, void *udata)
     printk("==== End KernelPatch for Kernel panic ====\n");
 }
 
-static void before_rest_init(hook_fargs4_t *args, void *udata)
+enum
 {
-    int rc = 0;
-    log_boot("entering init ...\n");
-
-    if ((rc = linux_libs_symbol_init())) goto out;
-    log_boot("linux_libs_symbol_init done: %d\n", rc);
-
-    if ((rc = linux_misc_symbol_init())) goto out;
-    log_boot("linux_misc_symbol_init done: %d\n", rc);
-
-    if ((rc = bypass_kcfi())) goto out;
-    log_boot("bypass_kcfi done: %d\n", rc);
-
-    if ((rc = syscall_init())) goto out;
-    log_boot("syscall_init done: %d\n", rc);
-
-    if ((rc = resolve_struct())) goto out;
-    log_boot("resolve_struct done: %d\n", rc);
-
-    if ((rc = selinux_hook_install())) goto out;
-    log_boot("selinux_hook_install done: %d\n", rc);
-
-    if ((rc = task_observer())) goto out;
-    log_boot("task_observer done: %d\n", rc);
-
-    if ((rc = module_init())) goto out;
-    log_boot("module_init done: %d\n", rc);
-
-    rc = supercall_install();
-    log_boot("supercall_install done: %d\n", rc);
-
-    rc = resolve_pt_regs();
-    log_boot("resolve_pt_regs done: %d\n", rc);
-
+    INIT_LIBS_SYMBOL,
+    INIT_MISC_SYMBOL,
+    INIT_SYMBOL_RESOLVE,
+    INIT_BYPASS_KCFI,
+    INIT_SYSCALL,
+    INIT_RESOLVE_STRUCT,
+    INIT_SELINUX_HOOK,
+    INIT_TASK_OBSERVER,
+    INIT_MODULE,
+    INIT_SUPERCALL,
+    INIT_EXEC_HOOK,
+    INIT_PT_REGS,
 #ifdef ANDROID
-    rc = su_compat_init();
-    log_boot("su_compat_init done: %d\n", rc);
-
-    rc = kpuserd_init();
-    log_boot("kpuserd_init done: %d\n", rc);
+    INIT_SU_COMPAT,
+    INIT_USERD,
 #endif
+    INIT_STAGE_NUM,
+};
+
+// each core stage needs the one before it, which makes everything after a failed one skip like it used to
+#define INIT_CORE KP_INIT_DEP(INIT_MODULE)
+
+// su and userd aren't used before init's second stage, the exec hook and supercalls wait for them on first use
+static struct kp_init_stage init_stages[INIT_STAGE_NUM] = {
+    [INIT_LIBS_SYMBOL] = { "linux_libs_symbol_init", linux_libs_symbol_init, 0 },
+    [INIT_MISC_SYMBOL] = { "linux_misc_symbol_init", linux_misc_symbol_init, KP_INIT_DEP(INIT_LIBS_SYMBOL) },
+    [INIT_SYMBOL_RESOLVE] = { "linux_symbol_resolve", linux_symbol_resolve, KP_INIT_DEP(INIT_MISC_SYMBOL) },
+    [INIT_BYPASS_KCFI] = { "bypass_kcfi", bypass_kcfi, KP_INIT_DEP(INIT_SYMBOL_RESOLVE) },
+    [INIT_SYSCALL] = { "syscall_init", syscall_init, KP_INIT_DEP(INIT_BYPASS_KCFI) },
+    [INIT_RESOLVE_STRUCT] = { "resolve_struct", resolve_struct, KP_INIT_DEP(INIT_SYSCALL) },
+    [INIT_SELINUX_HOOK] = { "selinux_hook_install", selinux_hook_install, KP_INIT_DEP(INIT_RESOLVE_STRUCT) },
+    [INIT_TASK_OBSERVER] = { "task_observer", task_observer, KP_INIT_DEP(INIT_SELINUX_HOOK) },
+    [INIT_MODULE] = { "module_init", module_init, KP_INIT_DEP(INIT_TASK_OBSERVER) },
+    [INIT_SUPERCALL] = { "supercall_install", supercall_install, INIT_CORE },
+    [INIT_EXEC_HOOK] = { "exec_hook_init", exec_hook_init, INIT_CORE },
+    [INIT_PT_REGS] = { "resolve_pt_regs", resolve_pt_regs, INIT_CORE },
+#ifdef ANDROID
+    [INIT_SU_COMPAT] = { "su_compat_init", su_compat_init, INIT_CORE, 1 },
+    [INIT_USERD] = { "kpuserd_init", kpuserd_init, INIT_CORE, 1 },
+#endif
+};
+
+static int kernel_init_hooked = 0;
 
-out:
-    return;
+static void before_rest_init(hook_fargs4_t *args, void *udata)
+{
+    int stage = boot_stage_begin("before_rest_init()");
+    log_boot("entering init ...\n");
+    kp_init_run(init_stages, INIT_STAGE_NUM);
+    // nothing to start the deferred stages from later
+    if (!kernel_init_hooked) kp_init_defer();
+    boot_stage_end(stage, init_stages[INIT_MODULE].rc);
 }
 
+struct async_kpm
+{
+    const patch_extra_item_t *extra;
+    const char *args;
+    const void *data;
+    struct module *mod;
+    long rc;
+};
+
+static struct async_kpm *async_kpms = 0;
+static int async_kpm_num = 0;
+static struct completion async_kpm_done;
+static int async_kpm_pending = 0;
+
 static int pre_kernel_init(const patch_extra_item_t *extra, const char *args, const void *data, void *udata)
 {
-    const char *event = (const char *)udata;
-    if (extra->type == EXTRA_TYPE_KPM) {
-        if (!strcmp(EXTRA_EVENT_PRE_KERNEL_INIT, extra->event) || !extra->event[0]) {
-            int rc = load_module(data, extra->con_size, args, event, 0);
-            log_boot("%s loading extra kpm return: %d\n", event, rc);
-        }
+    const char *event = EXTRA_EVENT_PRE_KERNEL_INIT;
+    if (extra->type != EXTRA_TYPE_KPM) return 0;
+
+    if (!strcmp(EXTRA_EVENT_PRE_KERNEL_INIT, extra->event)) {
+        int rc = load_module(data, extra->con_size, args, event, 0);
+        log_boot("%s loading extra kpm return: %d\n", event, rc);
+    } else if (!strcmp(EXTRA_EVENT_KERNEL_INIT_ASYNC, extra->event) || !extra->event[0]) {
+        struct async_kpm *kpms = kp_realloc(async_kpms, (async_kpm_num + 1) * sizeof(struct async_kpm));
+        if (!kpms) return -ENOMEM;
+        async_kpms = kpms;
+        async_kpms[async_kpm_num++] = (struct async_kpm){ .extra = extra, .args = args, .data = data };
     }
     return 0;
 }
 
+// Extra items are already sorted by priority, so stage all of them first and then call init in that order.
+// This runs next to kernel_init, the kp_init thread and early supercalls. The loader holds modules_lock while it
+// works and completes async_kpm_done after, kpm supercalls wait for that instead of racing it for the lock.
+static int async_kpm_loader(void *data)
+{
+    const char *event = EXTRA_EVENT_KERNEL_INIT_ASYNC;
+    modules_lock();
+    for (int i = 0; i < async_kpm_num; i++) {
+        struct async_kpm *kpm = &async_kpms[i];
+        kpm->rc = stage_module(kpm->data, kpm->extra->con_size, kpm->args, &kpm->mod);
+    }
+    for (int i = 0; i < async_kpm_num; i++) {
+        struct async_kpm *kpm = &async_kpms[i];
+        if (!kpm->rc) kpm->rc = start_module(kpm->mod, event, 0);
+        log_boot("%s loading extra kpm %s return: %d\n", event, kpm->extra->name, kpm->rc);
+    }
+    kp_free(async_kpms);
+    async_kpms = 0;
+    async_kpm_num = 0;
+    modules_unlock();
+    if (__atomic_load_n(&async_kpm_pending, __ATOMIC_ACQUIRE)) {
+        complete_all(&async_kpm_done);
+        __atomic_store_n(&async_kpm_pending, 0, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+void async_kpm_wait()
+{
+    if (unlikely(__atomic_load_n(&async_kpm_pending, __ATOMIC_ACQUIRE))) wait_for_completion(&async_kpm_done);
+}
+
 static void before_kernel_init(hook_fargs4_t *args, void *udata)
 {
     log_boot("event: %s\n", EXTRA_EVENT_PRE_KERNEL_INIT);
-    on_each_extra_item(pre_kernel_init, 0);
+    boot_stage(on_each_extra_item(pre_kernel_init, 0));
+
+    // kernel_init waits for kthreadd_done right after here, rest_init spawns kthreadd meanwhile
+    for (int i = 0; i < 100 && !kthreadd_ready(); i++) {
+        kthread_sleep(1);
+    }
+    kp_init_defer();
+
+    if (!async_kpm_num) return;
+    struct task_struct *loader = ERR_PTR(-EAGAIN);
+    int can_wait = kfunc(wait_for_completion) && kfunc(complete_all) &&
+                   (kver >= VERSION(5, 7, 0) ? !!kfunc(__init_swait_queue_head) : !!kfunc(__init_waitqueue_head));
+    if (kthreadd_ready() && can_wait) {
+        init_completion(&async_kpm_done);
+        __atomic_store_n(&async_kpm_pending, 1, __ATOMIC_RELEASE);
+        loader = kthread_run(async_kpm_loader, 0, "kp_kpm_loader");
+    }
+    if (IS_ERR(loader)) {
+        log_boot("start kpm loader error: %d, load synchronously\n", PTR_ERR(loader));
+        async_kpm_loader(0);
+    }
 }
 
 static void after_kernel_init(hook_fargs4_t *args, void *udata)
 {
     log_boot("event: %s\n", EXTRA_EVENT_POST_KERNEL_INIT);
+
+    // boot is over, later logs go to the per-cpu rings and may be overwritten
+    int rc = boot_stage(klog_ring_init());
+    log_boot("klog_ring_init done: %d\n", rc);
 }
 
 int patch()
@@ -143,6 +230,7 @@ int patch()
     if (kernel_init_addr) {
         hook_err_t rc = hook_wrap4((void *)kernel_init_addr, before_kernel_init, after_kernel_init, 0);
         log_boot("hook kernel_init rc: %d\n", rc);
+        kernel_init_hooked = !rc;
         ret |= rc;
     }
 
@@ -8,9 +8,29 @@
 #include <stdlib.h>
 
 #include "kpm.h"
+#include "insn.h"
 
 #define elf_check_arch(x) ((x)->e_machine == EM_AARCH64)
 
+#define R_AARCH64_NONE 0
+#define R_AARCH64_PREL64 260
+#define R_AARCH64_PREL32 261
+#define R_AARCH64_PREL16 262
+#define R_AARCH64_LD_PREL_LO19 273
+#define R_AARCH64_ADR_PREL_LO21 274
+#define R_AARCH64_ADR_PREL_PG_HI21 275
+#define R_AARCH64_ADR_PREL_PG_HI21_NC 276
+#define R_AARCH64_ADD_ABS_LO12_NC 277
+#define R_AARCH64_LDST8_ABS_LO12_NC 278
+#define R_AARCH64_TSTBR14 279
+#define R_AARCH64_CONDBR19 280
+#define R_AARCH64_JUMP26 282
+#define R_AARCH64_CALL26 283
+#define R_AARCH64_LDST16_ABS_LO12_NC 284
+#define R_AARCH64_LDST32_ABS_LO12_NC 285
+#define R_AARCH64_LDST64_ABS_LO12_NC 286
+#define R_AARCH64_LDST128_ABS_LO12_NC 299
+
 static char *next_string(char *string, uint64_t *secsize)
 {
     while (string[0]) {
@@ -72,11 +92,32 @@ static uint64_t get_sh_size(struct load_info *info, const char *secname)
     return infosec->sh_entsize;
 }
 
+static const char *prelink_str(const char *image, int32_t offset)
+{
+    return offset == KPM_PRELINK_NONE ? NULL : image + offset;
+}
+
+bool is_prelinked_kpm(const char *kpm, int len)
+{
+    return len > (int)sizeof(kpm_prelink_header_t) && !memcmp(kpm, KPM_PRELINK_MAGIC, sizeof(KPM_PRELINK_MAGIC));
+}
+
 int get_kpm_info(const char *kpm, int len, kpm_info_t *out_info)
 {
     struct load_info load_info = { .len = len, .hdr = (Elf_Ehdr *)kpm };
     struct load_info *info = &load_info;
 
+    if (is_prelinked_kpm(kpm, len)) {
+        kpm_prelink_header_t *hdr = (kpm_prelink_header_t *)kpm;
+        const char *image = kpm + hdr->image_offset;
+        out_info->name = prelink_str(image, hdr->name);
+        out_info->version = prelink_str(image, hdr->version);
+        out_info->license = prelink_str(image, hdr->license);
+        out_info->author = prelink_str(image, hdr->author);
+        out_info->description = prelink_str(image, hdr->description);
+        return 0;
+    }
+
     // header check
     if (info->len <= sizeof(*(info->hdr))) return -ENOEXEC;
     if (memcmp(info->hdr->e_ident, ELFMAG, SELFMAG) || info->hdr->e_type != ET_REL || !elf_check_arch(info->hdr) ||
@@ -135,3 +176,302 @@ int print_kpm_info_path(const char *kpm_path)
     free(img);
     return rc;
 }
+
+struct prelink_state
+{
+    kpm_prelink_fixup_t *fixups;
+    int fixup_num, fixup_cap;
+    const char **imports;
+    int import_num, import_cap;
+};
+
+static void prelink_add_fixup(struct prelink_state *st, uint32_t offset, uint32_t type, uint16_t import,
+                              int64_t addend)
+{
+    if (st->fixup_num >= st->fixup_cap) {
+        st->fixup_cap = st->fixup_cap ? st->fixup_cap * 2 : 64;
+        st->fixups = (kpm_prelink_fixup_t *)realloc(st->fixups, st->fixup_cap * sizeof(*st->fixups));
+    }
+    kpm_prelink_fixup_t *fixup = &st->fixups[st->fixup_num++];
+    fixup->offset = offset;
+    fixup->type = type;
+    fixup->import = import;
+    fixup->addend = addend;
+}
+
+static uint16_t prelink_import(struct prelink_state *st, const char *name)
+{
+    for (int i = 0; i < st->import_num; i++) {
+        if (!strcmp(st->imports[i], name)) return i;
+    }
+    if (st->import_num >= st->import_cap) {
+        st->import_cap = st->import_cap ? st->import_cap * 2 : 32;
+        st->imports = (const char **)realloc(st->imports, st->import_cap * sizeof(*st->imports));
+    }
+    st->imports[st->import_num] = name;
+    return st->import_num++;
+}
+
+static int prelink_insn_imm(uint32_t *place, int64_t sval, int lsb, int len, enum aarch64_insn_imm_type imm_type,
+                            bool overflow_check)
+{
+    sval >>= lsb;
+    uint64_t imm_mask = ((1ULL << (lsb + len)) - 1) >> lsb;
+    *place = aarch64_insn_encode_immediate(imm_type, *place, sval & imm_mask);
+    sval = (int64_t)(sval & ~(imm_mask >> 1)) >> (len - 1);
+    if (overflow_check && (uint64_t)(sval + 1) >= 2) return -ERANGE;
+    return 0;
+}
+
+// Apply a relocation against a symbol inside the image, image base is 0 and aligned to KPM_PRELINK_ALIGN.
+// Return 1 if applied, 0 if it depends on the load address.
+static int prelink_apply_local(char *image, uint32_t offset, uint32_t type, uint64_t val)
+{
+    void *place = image + offset;
+    int64_t prel = (int64_t)(val - offset);
+    int rc = 0;
+    switch (type) {
+    case R_AARCH64_NONE:
+        break;
+    case R_AARCH64_PREL64:
+        *(int64_t *)place = prel;
+        break;
+    case R_AARCH64_PREL32:
+        *(int32_t *)place = prel;
+        if (prel != (int32_t)prel) rc = -ERANGE;
+        break;
+    case R_AARCH64_PREL16:
+        *(int16_t *)place = prel;
+        if (prel != (int16_t)prel) rc = -ERANGE;
+        break;
+    case R_AARCH64_LD_PREL_LO19:
+    case R_AARCH64_CONDBR19:
+        rc = prelink_insn_imm(place, prel, 2, 19, AARCH64_INSN_IMM_19, true);
+        break;
+    case R_AARCH64_ADR_PREL_LO21:
+        rc = prelink_insn_imm(place, prel, 0, 21, AARCH64_INSN_IMM_ADR, true);
+        break;
+    case R_AARCH64_ADR_PREL_PG_HI21:
+    case R_AARCH64_ADR_PREL_PG_HI21_NC:
+        rc = prelink_insn_imm(place, (int64_t)((val & ~0xfffULL) - (offset & ~0xfffULL)), 12, 21,
+                              AARCH64_INSN_IMM_ADR, type == R_AARCH64_ADR_PREL_PG_HI21);
+        break;
+    case R_AARCH64_ADD_ABS_LO12_NC:
+    case R_AARCH64_LDST8_ABS_LO12_NC:
+        rc = prelink_insn_imm(place, val, 0, 12, AARCH64_INSN_IMM_12, false);
+        break;
+    case R_AARCH64_LDST16_ABS_LO12_NC:
+        rc = prelink_insn_imm(place, val, 1, 11, AARCH64_INSN_IMM_12, false);
+        break;
+    case R_AARCH64_LDST32_ABS_LO12_NC:
+        rc = prelink_insn_imm(place, val, 2, 10, AARCH64_INSN_IMM_12, false);
+        break;
+    case R_AARCH64_LDST64_ABS_LO12_NC:
+        rc = prelink_insn_imm(place, val, 3, 9, AARCH64_INSN_IMM_12, false);
+        break;
+    case R_AARCH64_LDST128_ABS_LO12_NC:
+        rc = prelink_insn_imm(place, val, 4, 8, AARCH64_INSN_IMM_12, false);
+        break;
+    case R_AARCH64_TSTBR14:
+        rc = prelink_insn_imm(place, prel, 2, 14, AARCH64_INSN_IMM_14, true);
+        break;
+    case R_AARCH64_JUMP26:
+    case R_AARCH64_CALL26:
+        rc = prelink_insn_imm(place, prel, 2, 26, AARCH64_INSN_IMM_26, true);
+        break;
+    default:
+        return 0;
+    }
+    return rc < 0 ? rc : 1;
+}
+
+static int32_t prelink_info_offset(const struct load_info *info, const Elf_Shdr *infosec, const char *tag)
+{
+    const char *str = get_modinfo(info, tag);
+    if (!str) return KPM_PRELINK_NONE;
+    return str - ((const char *)info->hdr + infosec->sh_offset) + infosec->sh_entsize;
+}
+
+// Lay out the sections and resolve everything that doesn't depend on the load address,
+// relocations against KernelPatch exports and absolute ones are left as fixups.
+int prelink_kpm(const char *kpm, int len, int page_size, char **out, int *out_len)
+{
+    static uint64_t const masks[][2] = { { SHF_EXECINSTR | SHF_ALLOC, 0 },
+                                         { SHF_ALLOC, SHF_WRITE },
+                                         { SHF_WRITE | SHF_ALLOC, 0 },
+                                         { SHF_ALLOC, 0 } };
+
+    Elf_Ehdr *hdr = (Elf_Ehdr *)kpm;
+    if (len <= (int)sizeof(*hdr) || memcmp(hdr->e_ident, ELFMAG, SELFMAG) || hdr->e_type != ET_REL ||
+        !elf_check_arch(hdr) || hdr->e_shentsize != sizeof(Elf_Shdr) || hdr->e_shoff >= (Elf64_Off)len ||
+        hdr->e_shnum * sizeof(Elf_Shdr) > len - hdr->e_shoff)
+        return -ENOEXEC;
+
+    // work on a copy of section headers, sh_entsize holds the image offset
+    Elf_Shdr *sechdrs = (Elf_Shdr *)malloc(hdr->e_shnum * sizeof(Elf_Shdr));
+    memcpy(sechdrs, kpm + hdr->e_shoff, hdr->e_shnum * sizeof(Elf_Shdr));
+    struct load_info load_info = { .len = len, .hdr = hdr, .sechdrs = sechdrs };
+    struct load_info *info = &load_info;
+    info->secstrings = (char *)kpm + sechdrs[hdr->e_shstrndx].sh_offset;
+
+    struct prelink_state st = { 0 };
+    char *image = NULL;
+    int rc = -ENOEXEC;
+
+    for (int i = 0; i < hdr->e_shnum; i++) {
+        if (sechdrs[i].sh_type != SHT_NOBITS && sechdrs[i].sh_offset + sechdrs[i].sh_size > (Elf64_Off)len) goto out;
+        sechdrs[i].sh_entsize = ~0UL;
+        if (sechdrs[i].sh_type == SHT_SYMTAB) {
+            info->index.sym = i;
+            info->index.str = sechdrs[i].sh_link;
+            info->strtab = (char *)kpm + sechdrs[info->index.str].sh_offset;
+        }
+    }
+    if (!info->index.sym) goto out;
+
+    // text and rodata end on page boundaries, so the kernel can map them read-only without touching data
+    uint64_t mem_size = 0, image_size = 0, text_size = 0, ro_size = 0;
+    for (size_t m = 0; m < sizeof(masks) / sizeof(masks[0]); m++) {
+        for (uint32_t i = 1; i < hdr->e_shnum; i++) {
+            Elf_Shdr *s = &sechdrs[i];
+            if ((s->sh_flags & masks[m][0]) != masks[m][0] || (s->sh_flags & masks[m][1]) || s->sh_entsize != ~0UL)
+                continue;
+            if (i == info->index.sym || i == info->index.str) continue;
+            s->sh_entsize = align_ceil(mem_size, s->sh_addralign ?: 1);
+            mem_size = s->sh_entsize + s->sh_size;
+            if (s->sh_type != SHT_NOBITS) image_size = mem_size;
+        }
+        if (m == 0) text_size = mem_size = align_ceil(mem_size, page_size);
+        if (m == 1) ro_size = mem_size = align_ceil(mem_size, page_size);
+    }
+    mem_size = align_ceil(mem_size, EXTRA_ALIGN);
+    image_size = align_ceil(image_size, 8);
+
+    image = (char *)malloc(mem_size);
+    memset(image, 0, mem_size);
+    int init = KPM_PRELINK_NONE, exit = KPM_PRELINK_NONE, ctl0 = KPM_PRELINK_NONE, ctl1 = KPM_PRELINK_NONE;
+    int handover = KPM_PRELINK_NONE, upgrade = KPM_PRELINK_NONE;
+    int symbol_offset = 0, symbol_size = 0;
+    for (int i = 1; i < hdr->e_shnum; i++) {
+        Elf_Shdr *s = &sechdrs[i];
+        if (s->sh_entsize == ~0UL) continue;
+        if (s->sh_type != SHT_NOBITS) memcpy(image + s->sh_entsize, kpm + s->sh_offset, s->sh_size);
+        const char *sname = info->secstrings + s->sh_name;
+        if (init == KPM_PRELINK_NONE && !strcmp(".kpm.init", sname)) init = s->sh_entsize;
+        if (exit == KPM_PRELINK_NONE && !strcmp(".kpm.exit", sname)) exit = s->sh_entsize;
+        if (!strcmp(".kpm.ctl0", sname)) ctl0 = s->sh_entsize;
+        if (!strcmp(".kpm.ctl1", sname)) ctl1 = s->sh_entsize;
+        if (!strcmp(".kpm.handover", sname)) handover = s->sh_entsize;
+        if (!strcmp(".kpm.upgrade", sname)) upgrade = s->sh_entsize;
+        if (!strcmp(".kpm.info", sname)) info->index.info = i;
+        if (!symbol_size && !strcmp(".kpm.symbol", sname)) {
+            symbol_offset = s->sh_entsize;
+            symbol_size = s->sh_size;
+        }
+    }
+    if (init == KPM_PRELINK_NONE || exit == KPM_PRELINK_NONE || !info->index.info) {
+        tools_loge("no .kpm.init, .kpm.exit or .kpm.info section\n");
+        goto out;
+    }
+
+    Elf_Sym *syms = (Elf_Sym *)(kpm + sechdrs[info->index.sym].sh_offset);
+    uint32_t sym_num = sechdrs[info->index.sym].sh_size / sizeof(Elf_Sym);
+    for (int i = 1; i < hdr->e_shnum; i++) {
+        Elf_Shdr *relsec = &sechdrs[i];
+        if (relsec->sh_type != SHT_RELA || relsec->sh_info >= hdr->e_shnum) continue;
+        Elf_Shdr *target = &sechdrs[relsec->sh_info];
+        if (target->sh_entsize == ~0UL) continue;
+
+        Elf64_Rela *rel = (Elf64_Rela *)(kpm + relsec->sh_offset);
+        for (uint64_t j = 0; j < relsec->sh_size / sizeof(*rel); j++) {
+            uint32_t type = ELF64_R_TYPE(rel[j].r_info);
+            uint32_t symidx = ELF64_R_SYM(rel[j].r_info);
+            uint32_t offset = target->sh_entsize + rel[j].r_offset;
+            if (symidx >= sym_num) goto out;
+            Elf_Sym *sym = &syms[symidx];
+            const char *name = info->strtab + sym->st_name;
+
+            if (sym->st_shndx == SHN_UNDEF && *name) {
+                prelink_add_fixup(&st, offset, type, prelink_import(&st, name), rel[j].r_addend);
+                continue;
+            }
+            if (sym->st_shndx == SHN_COMMON) {
+                tools_loge("please compile with -fno-common\n");
+                goto out;
+            }
+            if (sym->st_shndx == SHN_ABS || sym->st_shndx == SHN_UNDEF) {
+                tools_loge("unsupported absolute symbol: %s\n", name);
+                goto out;
+            }
+            if (sym->st_shndx >= hdr->e_shnum || sechdrs[sym->st_shndx].sh_entsize == ~0UL) goto out;
+
+            uint64_t val = sechdrs[sym->st_shndx].sh_entsize + sym->st_value + rel[j].r_addend;
+            int applied = prelink_apply_local(image, offset, type, val);
+            if (applied < 0) {
+                tools_loge("overflow in relocation type %d at 0x%x\n", type, offset);
+                goto out;
+            }
+            if (!applied) prelink_add_fixup(&st, offset, type, KPM_PRELINK_SELF, val);
+        }
+    }
+
+    Elf_Shdr *infosec = &sechdrs[info->index.info];
+
+    int imports_size = 0;
+    for (int i = 0; i < st.import_num; i++)
+        imports_size += strlen(st.imports[i]) + 1;
+
+    kpm_prelink_header_t phdr = { 0 };
+    memcpy(phdr.magic, KPM_PRELINK_MAGIC, sizeof(KPM_PRELINK_MAGIC));
+    phdr.image_offset = align_ceil(sizeof(phdr), 16);
+    phdr.image_size = image_size;
+    phdr.mem_size = mem_size;
+    phdr.fixup_offset = phdr.image_offset + image_size;
+    phdr.fixup_num = st.fixup_num;
+    phdr.import_offset = phdr.fixup_offset + st.fixup_num * sizeof(kpm_prelink_fixup_t);
+    phdr.import_num = st.import_num;
+    phdr.init = init;
+    phdr.exit = exit;
+    phdr.ctl0 = ctl0;
+    phdr.ctl1 = ctl1;
+    phdr.name = prelink_info_offset(info, infosec, "name");
+    phdr.version = prelink_info_offset(info, infosec, "version");
+    phdr.license = prelink_info_offset(info, infosec, "license");
+    phdr.author = prelink_info_offset(info, infosec, "author");
+    phdr.description = prelink_info_offset(info, infosec, "description");
+    phdr.symbol_offset = symbol_offset;
+    phdr.symbol_size = symbol_size;
+    phdr.handover = handover;
+    phdr.upgrade = upgrade;
+    phdr.text_size = text_size;
+    phdr.ro_size = ro_size;
+    if (phdr.name == KPM_PRELINK_NONE || phdr.version == KPM_PRELINK_NONE) {
+        tools_loge("no module name or version\n");
+        goto out;
+    }
+
+    int total = align_ceil(phdr.import_offset + imports_size, EXTRA_ALIGN);
+    char *buf = (char *)malloc(total);
+    memset(buf, 0, total);
+    memcpy(buf, &phdr, sizeof(phdr));
+    memcpy(buf + phdr.image_offset, image, image_size);
+    memcpy(buf + phdr.fixup_offset, st.fixups, st.fixup_num * sizeof(kpm_prelink_fixup_t));
+    char *pos = buf + phdr.import_offset;
+    for (int i = 0; i < st.import_num; i++) {
+        strcpy(pos, st.imports[i]);
+        pos += strlen(st.imports[i]) + 1;
+    }
+
+    tools_logi("prelinked kpm: image: 0x%x, memory: 0x%x, text: 0x%x, ro: 0x%x, fixups: %d, imports: %d\n",
+               phdr.image_size, phdr.mem_size, phdr.text_size, phdr.ro_size, phdr.fixup_num, phdr.import_num);
+    *out = buf;
+    *out_len = total;
+    rc = 0;
+
+out:
+    free(image);
+    free(st.fixups);
+    free(st.imports);
+    free(sechdrs);
+    return rc;
+}
@@ -6,8 +6,11 @@
 #ifndef _KP_TOOL_KPM_H_
 #define _KP_TOOL_KPM_H_
 
+#include <stdbool.h>
+
 #include "elf/elf.h"
 #include "common.h"
+#include "preset.h"
 
 #define Elf_Shdr Elf64_Shdr
 #define Elf_Phdr Elf64_Phdr
@@ -52,6 +55,9 @@ typedef struct
 
 int get_kpm_info(const char *kpm, int len, kpm_info_t *info);
 
+bool is_prelinked_kpm(const char *kpm, int len);
+int prelink_kpm(const char *kpm, int len, int page_size, char **out, int *out_len);
+
 void print_kpm_info(kpm_info_t *info);
 int print_kpm_info_path(const char *kpm_path);
 
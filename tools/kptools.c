@@ -65,6 +65,7 @@ void print_usage(char **argv)
         "  -V, --extra-event EVENT          Set trigger event of previous extra item.\n"
         "  -A, --extra-args ARGS            Set arguments of previous extra item.\n"
         "  -D, --extra-detach               Detach previous extra item from patches.\n"
+        "  -P, --prelink                    Pre-link embedded KPMs so they load without ELF relocation at boot.\n"
         "\n";
     fprintf(stdout, c, version, program_name);
 }
@@ -98,8 +99,9 @@ int main(int argc, char *argv[])
                                  { "extra-name", required_argument, NULL, 'N' },
                                  { "extra-event", required_argument, NULL, 'V' },
                                  { "extra-args", required_argument, NULL, 'A' },
+                                 { "prelink", no_argument, NULL, 'P' },
                                  { 0, 0, 0, 0 } };
-    char *optstr = "hvpurdli:s:S:k:o:a:K:M:E:T:N:V:A:";
+    char *optstr = "hvpurdli:s:S:k:o:a:K:M:E:T:N:V:A:P";
 
     char *kimg_path = NULL;
     char *kpimg_path = NULL;
@@ -107,6 +109,7 @@ int main(int argc, char *argv[])
     char *superkey = NULL;
     char *kpatch_path = NULL;
     bool root_skey = false;
+    bool prelink = false;
 
     int additional_num = 0;
     const char *additional[16] = { 0 };
@@ -176,6 +179,9 @@ int main(int argc, char *argv[])
         case 'A':
             config->set_args = optarg;
             break;
+        case 'P':
+            prelink = true;
+            break;
         default:
             break;
         }
@@ -191,7 +197,7 @@ int main(int argc, char *argv[])
             fprintf(stdout, "%x\n", version);
     } else if (cmd == 'p') {
         ret = patch_update_img(kimg_path, kpimg_path, out_path, superkey, root_skey, additional, kpatch_path,
-                               extra_configs, extra_config_num);
+                               extra_configs, extra_config_num, prelink);
     } else if (cmd == 'd') {
         ret = dump_kallsym(kimg_path);
     } else if (cmd == 'u') {
@@ -100,6 +100,8 @@ int extra_str_type(const char *extra_str)
         extra_type = EXTRA_TYPE_RAW;
     } else if (!strcmp(extra_str, EXTRA_TYPE_ANDROID_RC_STR)) {
         extra_type = EXTRA_TYPE_ANDROID_RC;
+    } else if (!strcmp(extra_str, EXTRA_TYPE_KSYM_STR)) {
+        extra_type = EXTRA_TYPE_KSYM;
     } else {
     }
     return extra_type;
@@ -118,6 +120,8 @@ const char *extra_type_str(extra_item_type extra_type)
         return EXTRA_TYPE_RAW_STR;
     case EXTRA_TYPE_ANDROID_RC:
         return EXTRA_TYPE_ANDROID_RC_STR;
+    case EXTRA_TYPE_KSYM:
+        return EXTRA_TYPE_KSYM_STR;
     default:
         return EXTRA_TYPE_NONE_STR;
     }
@@ -338,7 +342,7 @@ static void extra_append(char *kimg, const void *data, int len, int *offset)
 
 int patch_update_img(const char *kimg_path, const char *kpimg_path, const char *out_path, const char *superkey,
                      bool root_key, const char **additional, const char *kpatch_path, extra_config_t *extra_configs,
-                     int extra_config_num)
+                     int extra_config_num, bool prelink)
 {
     set_log_enable(true);
 
@@ -450,6 +454,49 @@ int patch_update_img(const char *kimg_path, const char *kpimg_path, const char *
         if (config->set_name) strcpy(item->name, config->set_name);
         if (config->set_event) strcpy(item->event, config->set_event);
         if (config->priority) item->priority = config->priority;
+
+        if (prelink && item->type == EXTRA_TYPE_KPM && !is_prelinked_kpm(config->data, item->con_size)) {
+            if (kinfo->is_be) {
+                tools_logw("can't prelink kpm for big endian kernel: %s\n", item->name);
+                continue;
+            }
+            char *linked;
+            int linked_len = 0;
+            if (prelink_kpm(config->data, item->con_size, 1 << kinfo->page_shift, &linked, &linked_len))
+                tools_loge_exit("prelink kpm error: %s\n", item->name);
+            // read from the path above, embedded items point into the old image
+            if (config->is_path) free((void *)config->data);
+            config->data = linked;
+            config->data_prelinked = true;
+            item->con_size = linked_len;
+        }
+    }
+
+    // kernel offsets of the symbol names kpimg resolves at boot
+    patch_extra_item_t ksym_item = { 0 };
+    char *ksym_cache = NULL;
+    setup_header_t *kpimg_header = (setup_header_t *)kpimg;
+    int64_t ksym_names_offset = kpimg_header->ksym_names_offset;
+    int64_t ksym_names_size = kpimg_header->ksym_names_size;
+    if (is_be() ^ kinfo->is_be) {
+        ksym_names_offset = i64swp(ksym_names_offset);
+        ksym_names_size = i64swp(ksym_names_size);
+    }
+    if (ksym_names_size > 0 && ksym_names_offset + ksym_names_size <= kpimg_len &&
+        extra_config_num < EXTRA_ITEM_MAX_NUM) {
+        int ksym_cache_len = 0;
+        ksym_cache = build_ksym_cache(&kallsym, kallsym_kimg, kpimg + ksym_names_offset, ksym_names_size,
+                                      kinfo->is_be, &ksym_cache_len);
+        if (ksym_cache) {
+            extra_config_t *config = extra_configs + extra_config_num++;
+            config->extra_type = EXTRA_TYPE_KSYM;
+            config->data = ksym_cache;
+            config->item = &ksym_item;
+            strcpy(ksym_item.magic, EXTRA_HDR_MAGIC);
+            strcpy(ksym_item.name, EXTRA_TYPE_KSYM_STR);
+            ksym_item.type = EXTRA_TYPE_KSYM;
+            ksym_item.con_size = ksym_cache_len;
+        }
     }
 
     qsort(extra_configs, extra_config_num, sizeof(extra_config_t), extra_compare);
@@ -611,6 +658,11 @@ int patch_update_img(const char *kimg_path, const char *kpimg_path, const char *
         extra_append(out_kernel_file.kimg, (void *)item, sizeof(*item), &current_offset);
         if (args_len > 0) extra_append(out_kernel_file.kimg, (void *)config->set_args, args_len, &current_offset);
         extra_append(out_kernel_file.kimg, (void *)config->data, con_len, &current_offset);
+        if (config->data_prelinked) {
+            free((void *)config->data);
+            config->data = NULL;
+            config->data_prelinked = false;
+        }
     }
 
     // guard extra
@@ -620,6 +672,7 @@ int patch_update_img(const char *kimg_path, const char *kpimg_path, const char *
     write_kernel_file(&out_kernel_file, out_path);
 
     // free
+    free(ksym_cache);
     free(kallsym_kimg);
     free(kpimg);
     free_kernel_file(&out_kernel_file);
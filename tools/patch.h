@@ -47,6 +47,7 @@ typedef struct
     const char *set_event;
     int32_t priority;
     const char *data;
+    bool data_prelinked; // data was allocated by prelink_kpm, freed once embedded
     patch_extra_item_t *item;
 } extra_config_t;
 
@@ -70,7 +71,7 @@ int extra_str_type(const char *extra_str);
 const char *extra_type_str(extra_item_type extra_type);
 int patch_update_img(const char *kimg_path, const char *kpimg_path, const char *out_path, const char *superkey,
                      bool root_skey, const char **additional, const char *kpatch_path, extra_config_t *extra_configs,
-                     int extra_config_num);
+                     int extra_config_num, bool prelink);
 int unpatch_img(const char *kimg_path, const char *out_path);
 int reset_key(const char *kimg_path, const char *out_path, const char *key);
 int dump_kallsym(const char *kimg_path);
@@ -3,6 +3,10 @@
  * Copyright (C) 2024 bmax121. All Rights Reserved.
  */
 
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+
 #include "symbol.h"
 #include "common.h"
 
@@ -156,3 +160,145 @@ int fillin_patch_symbol(kallsym_t *kallsym, char *img_buf, int imglen, patch_sym
     }
     return 0;
 }
+
+// same FNV-1a 32 as the kernel side resolver
+static uint32_t ksym_hash(const char *data, int len)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+#define KSYM_RANK_CLONE 1
+#define KSYM_RANK_NAME 2
+
+struct ksym_cache_want
+{
+    const char *name;
+    uint32_t hash;
+    int32_t offset;
+    int32_t rank;
+};
+
+struct ksym_cache_struct
+{
+    struct ksym_cache_want *wants;
+    int num;
+};
+
+static int ksym_want_compare(const void *a, const void *b)
+{
+    uint32_t ha = ((struct ksym_cache_want *)a)->hash;
+    uint32_t hb = ((struct ksym_cache_want *)b)->hash;
+    return ha < hb ? -1 : ha > hb;
+}
+
+// same clone suffixes the kernel side pass accepts
+static const char *const ksym_clone_suffixes[] = { ".llvm.", ".isra.", ".constprop." };
+
+static void ksym_cache_match(struct ksym_cache_struct *data, const char *symbol, int len, int32_t offset, int32_t rank)
+{
+    struct ksym_cache_want key = { .hash = ksym_hash(symbol, len) };
+    struct ksym_cache_want *want = bsearch(&key, data->wants, data->num, sizeof(key), ksym_want_compare);
+    if (!want || strncmp(want->name, symbol, len) || want->name[len]) return;
+    // first match wins, like kallsyms_lookup_name, a clone only stands in when there is no exact name
+    if (rank <= want->rank) return;
+    want->offset = offset;
+    want->rank = rank;
+}
+
+static int32_t on_each_symbol_ksym_cache(int32_t index, char type, const char *symbol, int32_t offset, void *userdata)
+{
+    struct ksym_cache_struct *data = (struct ksym_cache_struct *)userdata;
+    ksym_cache_match(data, symbol, strlen(symbol), offset, KSYM_RANK_NAME);
+
+    int len = strcspn(symbol, ".");
+    if (!symbol[len]) return 0;
+    for (size_t i = 0; i < sizeof(ksym_clone_suffixes) / sizeof(ksym_clone_suffixes[0]); i++) {
+        const char *suffix = ksym_clone_suffixes[i];
+        if (!strncmp(symbol + len, suffix, strlen(suffix))) {
+            ksym_cache_match(data, symbol, len, offset, KSYM_RANK_CLONE);
+            break;
+        }
+    }
+    return 0;
+}
+
+char *build_ksym_cache(kallsym_t *kallsym, char *img_buf, const char *names, int names_len, int32_t target_is_be,
+                       int *cache_len)
+{
+    int num = 0;
+    for (int i = 0; i < names_len; i++) {
+        if (names[i] && (i == 0 || !names[i - 1])) num++;
+    }
+    if (!num) return NULL;
+
+    struct ksym_cache_want *wants = (struct ksym_cache_want *)malloc(num * sizeof(*wants));
+    num = 0;
+    for (int i = 0; i < names_len;) {
+        int len = strnlen(names + i, names_len - i);
+        if (len) {
+            wants[num].name = names + i;
+            wants[num].hash = ksym_hash(names + i, len);
+            wants[num].offset = 0;
+            wants[num].rank = 0;
+            num++;
+        }
+        i += len + 1;
+    }
+    qsort(wants, num, sizeof(*wants), ksym_want_compare);
+
+    // the same name may be listed more than once, distinct names must not collide
+    int uniq = 0;
+    for (int i = 0; i < num; i++) {
+        if (uniq && wants[uniq - 1].hash == wants[i].hash) {
+            if (strcmp(wants[uniq - 1].name, wants[i].name)) {
+                tools_logw("ksym cache hash collision: %s, %s\n", wants[uniq - 1].name, wants[i].name);
+                free(wants);
+                return NULL;
+            }
+            continue;
+        }
+        wants[uniq++] = wants[i];
+    }
+
+    struct ksym_cache_struct udata = { wants, uniq };
+    on_each_symbol(kallsym, img_buf, &udata, on_each_symbol_ksym_cache);
+
+    int found = 0;
+    for (int i = 0; i < uniq; i++) {
+        if (wants[i].rank) found++;
+    }
+
+    int len = align_ceil(sizeof(ksym_cache_header_t) + uniq * sizeof(ksym_cache_entry_t), EXTRA_ALIGN);
+    char *cache = (char *)malloc(len);
+    memset(cache, 0, len);
+    ksym_cache_header_t *header = (ksym_cache_header_t *)cache;
+    ksym_cache_entry_t *entries = (ksym_cache_entry_t *)(header + 1);
+    strcpy(header->magic, KSYM_CACHE_MAGIC);
+    header->names_hash = ksym_hash(names, names_len);
+    header->num = uniq;
+    for (int i = 0; i < uniq; i++) {
+        entries[i].hash = wants[i].hash;
+        entries[i].offset = wants[i].offset;
+        if (!wants[i].rank) entries[i].flags = KSYM_CACHE_MISSING;
+        if (wants[i].rank == KSYM_RANK_CLONE) entries[i].flags = KSYM_CACHE_CLONE;
+    }
+    tools_logi("ksym cache: %d of %d names resolved\n", found, uniq);
+
+    if (is_be() ^ target_is_be) {
+        header->names_hash = u32swp(header->names_hash);
+        header->num = i32swp(header->num);
+        for (int i = 0; i < uniq; i++) {
+            entries[i].hash = u32swp(entries[i].hash);
+            entries[i].offset = i32swp(entries[i].offset);
+            entries[i].flags = u32swp(entries[i].flags);
+        }
+    }
+
+    free(wants);
+    *cache_len = len;
+    return cache;
+}
@@ -21,5 +21,7 @@ void select_map_area(kallsym_t *kallsym, char *image_buf, int32_t *map_start, in
 int fillin_map_symbol(kallsym_t *kallsym, char *img_buf, map_symbol_t *symbol, int32_t target_is_be);
 int fillin_patch_symbol(kallsym_t *kallsym, char *img_buf, int imglen, patch_symbol_t *symbol, int32_t target_is_be,
                         bool is_android);
+char *build_ksym_cache(kallsym_t *kallsym, char *img_buf, const char *names, int names_len, int32_t target_is_be,
+                       int *cache_len);
 
 #endif
\ No newline at end of file
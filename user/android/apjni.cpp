@@ -6,6 +6,9 @@
 #include <jni.h>
 #include <android/log.h>
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
 
 #include "../supercall.h"
 
@@ -95,6 +98,37 @@ extern "C" JNIEXPORT jlong JNICALL Java_me_bmax_apatch_Natives_nativeThreadSu(JN
     return rc;
 }
 
+extern "C" JNIEXPORT jlong JNICALL Java_me_bmax_apatch_Natives_nativeThreadGroupSu(JNIEnv *env, jclass clz,
+                                                                                   jstring superKey, jint pid,
+                                                                                   jint to_uid, jstring scontext)
+{
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    DIR *dir = opendir(path);
+    if (!dir) return -ESRCH;
+    pid_t tids[SUPERCALL_SU_THREADS_MAX];
+    int num = 0;
+    struct dirent *de;
+    while (num < SUPERCALL_SU_THREADS_MAX && (de = readdir(dir))) {
+        if (de->d_name[0] < '0' || de->d_name[0] > '9') continue;
+        tids[num++] = atoi(de->d_name);
+    }
+    closedir(dir);
+    if (!num) return -ESRCH;
+
+    const char *skey = env->GetStringUTFChars(superKey, NULL);
+    const char *sctx = 0;
+    if (scontext) sctx = env->GetStringUTFChars(scontext, NULL);
+    struct su_profile profile = { 0 };
+    profile.uid = getuid();
+    profile.to_uid = (uid_t)to_uid;
+    if (sctx) strncpy(profile.scontext, sctx, sizeof(profile.scontext) - 1);
+    long rc = sc_su_threads(skey, tids, num, &profile);
+    env->ReleaseStringUTFChars(superKey, skey);
+    if (sctx) env->ReleaseStringUTFChars(scontext, sctx);
+    return rc;
+}
+
 extern "C" JNIEXPORT jint JNICALL Java_me_bmax_apatch_Natives_nativeSuNums(JNIEnv *env, jclass clz, jstring superKey)
 {
     const char *skey = env->GetStringUTFChars(superKey, NULL);
@@ -45,9 +45,90 @@ void kv(const char *key)
     fprintf(stdout, "%x\n", kv);
 }
 
+static void print_heap_stat(const char *name, struct kp_heap_stat *heap)
+{
+    fprintf(stdout, "%s: total %llu, used %llu, free %llu, largest free %llu, cached %llu\n", name,
+            (unsigned long long)heap->total, (unsigned long long)heap->used, (unsigned long long)heap->free,
+            (unsigned long long)heap->largest_free, (unsigned long long)heap->cached);
+    fprintf(stdout, "    pools %u, used blocks %u, free blocks %u\n", heap->pools, heap->used_blocks, heap->free_blocks);
+    fprintf(stdout, "    free blocks by size:");
+    for (int i = 0; i < KP_HEAP_HIST_NUM; i++) {
+        if (!heap->free_hist[i]) continue;
+        fprintf(stdout, " %u%s:%u", 16u << i, i == KP_HEAP_HIST_NUM - 1 ? "+" : "", heap->free_hist[i]);
+    }
+    fprintf(stdout, "\n");
+}
+
+int memstat(const char *key)
+{
+    struct kp_mem_stat stat;
+    long rc = sc_mem_stat(key, &stat);
+    if (rc) return rc;
+    print_heap_stat("rw", &stat.rw);
+    print_heap_stat("exec", &stat.exec);
+    fprintf(stdout, "hook: slots %u, used %u (inline %u, inline chain %u, fp chain %u), slot size %u\n",
+            stat.hook.total, stat.hook.used, stat.hook.inline_hooks, stat.hook.inline_chains, stat.hook.fp_chains,
+            stat.hook.slot_size);
+    int num = stat.mod_num < KP_MEM_STAT_MOD_MAX ? stat.mod_num : KP_MEM_STAT_MOD_MAX;
+    for (int i = 0; i < num; i++) {
+        struct kp_mod_mem_stat *mod = &stat.mods[i];
+        fprintf(stdout, "kpm %s: exec %llu, ro %llu, rw %llu\n", mod->name, (unsigned long long)mod->exec_size,
+                (unsigned long long)mod->ro_size, (unsigned long long)mod->rw_size);
+    }
+    if (stat.mod_num > num) fprintf(stdout, "... %d more kpms\n", stat.mod_num - num);
+    return 0;
+}
+
+int bootprof(const char *key)
+{
+    struct kp_boot_prof prof;
+    long rc = sc_boot_prof(key, &prof);
+    if (rc) return rc;
+    if (!prof.freq) return -EINVAL;
+    int num = prof.num < KP_BOOT_STAGE_MAX ? prof.num : KP_BOOT_STAGE_MAX;
+    fprintf(stdout, "%10s %10s %5s  %s\n", "at(ms)", "took(us)", "rc", "stage");
+    for (int i = 0; i < num; i++) {
+        struct kp_boot_stage *stage = &prof.stages[i];
+        unsigned long long at = stage->start * 1000 / prof.freq;
+        fprintf(stdout, "%10llu ", at);
+        if (stage->end) {
+            fprintf(stdout, "%10llu ", (unsigned long long)((stage->end - stage->start) * 1000000 / prof.freq));
+        } else {
+            fprintf(stdout, "%10s ", "-");
+        }
+        fprintf(stdout, "%5d  %*s%s\n", stage->rc, stage->depth * 2, "", stage->name);
+    }
+    if (prof.num > num) fprintf(stdout, "... %d more stages\n", prof.num - num);
+    return 0;
+}
+
+static int print_klog(const char *key, int which)
+{
+    char *buf = malloc(SUPERCALL_KLOG_READ_MAX);
+    if (!buf) return -ENOMEM;
+    uint64_t pos = 0, last;
+    long rc;
+    // the boot log may not fit in one read, stop when nothing is left or the kernel doesn't move pos
+    do {
+        last = pos;
+        rc = sc_klog_read(key, which, buf, SUPERCALL_KLOG_READ_MAX, &pos);
+        if (rc >= 0) fwrite(buf, 1, rc, stdout);
+    } while (which == SUPERCALL_KLOG_BOOT && rc > 0 && pos != last);
+    free(buf);
+    return rc < 0 ? rc : 0;
+}
+
 void bootlog(const char *key)
 {
-    sc_bootlog(key);
+    // older kernels only print it to the kernel log
+    if (print_klog(key, SUPERCALL_KLOG_BOOT)) sc_bootlog(key);
+}
+
+int klog(const char *key)
+{
+    int rc = print_klog(key, SUPERCALL_KLOG_RUNTIME);
+    if (rc) fprintf(stderr, "klog read error: %d\n", rc);
+    return rc;
 }
 
 void panic(const char *key)
@@ -23,7 +23,10 @@ extern "C"
 
     int skey_main(int argc, char **argv);
 
+    int memstat(const char *key);
+    int bootprof(const char *key);
     void bootlog(const char *key);
+    int klog(const char *key);
     void panic(const char *key);
     int __test(const char *key);
 
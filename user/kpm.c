@@ -32,6 +32,12 @@ int kpm_unload(const char *key, const char *name)
     return rc;
 }
 
+int kpm_upgrade(const char *key, const char *path, const char *args)
+{
+    int rc = sc_kpm_upgrade(key, path, args, 0);
+    return rc;
+}
+
 int kpm_nums(const char *key)
 {
     int nums = sc_kpm_nums(key);
@@ -77,6 +83,7 @@ static void usage(int status)
                         "load <KPM_PATH> [KPM_ARGS]     Load KernelPatch Module with KPM_PATH and KPM_ARGS.\n"
                         "ctl0 <KPM_NAME> <CTL_ARGS>     Control KernelPatch Module named KPM_PATH with CTL_ARGS.\n"
                         "unload <KPM_NAME>              Unload KernelPatch Module named KPM_NAME.\n"
+                        "upgrade <KPM_PATH> [KPM_ARGS]  Replace the loaded module of the same name without unhooking.\n"
                         "num                            Get the number of modules that have been loaded.\n"
                         "list                           List names of all loaded modules.\n"
                         "info <KPM_NAME>                Get detailed information about module named KPM_NAME.\n"
@@ -100,6 +107,7 @@ int kpm_main(int argc, char **argv)
         { "load", SUPERCALL_KPM_LOAD },
         { "ctl0", SUPERCALL_KPM_CONTROL },
         { "unload", SUPERCALL_KPM_UNLOAD },
+        { "upgrade", SUPERCALL_KPM_UPGRADE },
         { "num", SUPERCALL_KPM_NUMS },
         { "list", SUPERCALL_KPM_LIST },
         { "info", SUPERCALL_KPM_INFO },
@@ -135,6 +143,11 @@ int kpm_main(int argc, char **argv)
         if (argc < 3) error(-EINVAL, 0, "module name does not exist");
         name = argv[2];
         return kpm_unload(key, name);
+    case SUPERCALL_KPM_UPGRADE:
+        if (argc < 3) error(-EINVAL, 0, "module path does not exist");
+        path = argv[2];
+        mod_args = argc < 4 ? NULL : argv[3];
+        return kpm_upgrade(key, path, mod_args);
     case SUPERCALL_KPM_NUMS:
         return kpm_nums(key);
     case SUPERCALL_KPM_LIST:
@@ -15,6 +15,7 @@ extern "C"
 
     int kpm_load(const char *key, const char *path, const char *args);
     int kpm_unload(const char *key, const char *name);
+    int kpm_upgrade(const char *key, const char *path, const char *args);
     int kpm_nums(const char *key);
     int kpm_list(const char *key);
     int kpm_info(const char *key, const char *name);
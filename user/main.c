@@ -50,6 +50,10 @@ static void usage(int status)
                 "key         Manager the superkey.\n"
                 "su          KernelPatch Substitute User.\n"
                 "kpm         KernelPatch Module manager.\n"
+                "memstat     Print KernelPatch heap, hook memory and per module usage.\n"
+                "bootlog     Print KernelPatch boot log.\n"
+                "bootprof    Print how long each KernelPatch init stage took.\n"
+                "klog        Print recent KernelPatch runtime log.\n"
 #ifdef ANDROID
                 "sumgr       SU permission manager for Android.\n"
 #endif
@@ -98,8 +102,11 @@ int main(int argc, char **argv)
         { "key", 'K' },
         { "su", 's' },
         { "kpm", 'k' },
+        { "memstat", 'M' },
 
         { "bootlog", 'l' },
+        { "klog", 'g' },
+        { "bootprof", 'B' },
         { "panic", '.' },
         { "test", 't' },
 
@@ -140,9 +147,15 @@ int main(int argc, char **argv)
     case 'k':
         strcat(program_name, " kpm");
         return kpm_main(argc - 2, argv + 2);
+    case 'M':
+        return memstat(key);
     case 'l':
         bootlog(key);
         break;
+    case 'g':
+        return klog(key);
+    case 'B':
+        return bootprof(key);
     case '.':
         panic(key);
         break;
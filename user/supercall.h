@@ -59,6 +59,25 @@ static inline long sc_klog(const char *key, const char *msg)
     return ret;
 }
 
+/**
+ * @brief Read KernelPatch log records formatted as text
+ *
+ * @param key : superkey
+ * @param which : SUPERCALL_KLOG_BOOT or SUPERCALL_KLOG_RUNTIME
+ * @param buf
+ * @param len
+ * @param pos : boot record to start from, advanced past what was read, may be NULL to start from the first,
+ *              unused for SUPERCALL_KLOG_RUNTIME
+ * @return long : length of the text in buf, which is NUL-terminated, or a negative error
+ */
+static inline long sc_klog_read(const char *key, int which, char *buf, int len, uint64_t *pos)
+{
+    if (!key || !key[0]) return -EINVAL;
+    if (!buf || len <= 0) return -EINVAL;
+    long ret = syscall(__NR_supercall, key, compact_cmd(key, SUPERCALL_KLOG_READ), which, buf, len, pos);
+    return ret;
+}
+
 static inline uint32_t sc_kp_ver(const char *key)
 {
     if (!key || !key[0]) return -EINVAL;
@@ -111,6 +130,14 @@ static inline long sc_su_task(const char *key, pid_t tid, struct su_profile *pro
     return ret;
 }
 
+static inline long sc_su_threads(const char *key, pid_t *tids, int num, struct su_profile *profile)
+{
+    if (!key || !key[0]) return -EINVAL;
+    if (!tids || num <= 0 || num > SUPERCALL_SU_THREADS_MAX) return -EINVAL;
+    long ret = syscall(__NR_supercall, key, compact_cmd(key, SUPERCALL_SU_THREADS), tids, num, profile);
+    return ret;
+}
+
 static inline long sc_kpm_load(const char *key, const char *path, const char *args, void *reserved)
 {
     if (!key || !key[0]) return -EINVAL;
@@ -136,6 +163,14 @@ static inline long sc_kpm_unload(const char *key, const char *name, void *reserv
     return ret;
 }
 
+static inline long sc_kpm_upgrade(const char *key, const char *path, const char *args, void *reserved)
+{
+    if (!key || !key[0]) return -EINVAL;
+    if (!path || strlen(path) <= 0) return -EINVAL;
+    long ret = syscall(__NR_supercall, key, compact_cmd(key, SUPERCALL_KPM_UPGRADE), path, args, reserved);
+    return ret;
+}
+
 static inline long sc_kpm_nums(const char *key)
 {
     if (!key || !key[0]) return -EINVAL;
@@ -166,6 +201,87 @@ static inline long sc_pid_virt_to_phys(const char *key, pid_t pid, unsigned long
     return ret;
 }
 
+// returns the number of extents written, range->next is where to continue when the extents ran out
+static inline long sc_pid_virt_to_phys_range(const char *key, pid_t pid, struct pmem_range *range,
+                                             struct pmem_extent *extents, int max)
+{
+    if (!key || !key[0]) return -EINVAL;
+    if (!range || !extents || max <= 0) return -EINVAL;
+    long ret = syscall(__NR_supercall, key, compact_cmd(key, SUPERCALL_MEM_PHYS_RANGE), pid, range, extents, max);
+    return ret;
+}
+
+static inline long sc_pid_mem_read(const char *key, pid_t pid, struct pmem_iovec *local, int local_cnt,
+                                   struct pmem_iovec *remote, int remote_cnt)
+{
+    if (!key || !key[0]) return -EINVAL;
+    struct pmem_rw rw = { (uintptr_t)local, (uintptr_t)remote, (uint32_t)local_cnt, (uint32_t)remote_cnt };
+    long ret = syscall(__NR_supercall, key, compact_cmd(key, SUPERCALL_MEM_READ), pid, &rw);
+    return ret;
+}
+
+static inline long sc_pid_mem_write(const char *key, pid_t pid, struct pmem_iovec *local, int local_cnt,
+                                    struct pmem_iovec *remote, int remote_cnt)
+{
+    if (!key || !key[0]) return -EINVAL;
+    struct pmem_rw rw = { (uintptr_t)local, (uintptr_t)remote, (uint32_t)local_cnt, (uint32_t)remote_cnt };
+    long ret = syscall(__NR_supercall, key, compact_cmd(key, SUPERCALL_MEM_WRITE), pid, &rw);
+    return ret;
+}
+
+static inline long sc_selinux_grant(const char *key, struct selinux_grant *grant)
+{
+    if (!key || !key[0]) return -EINVAL;
+    if (!grant) return -EINVAL;
+    long ret = syscall(__NR_supercall, key, compact_cmd(key, SUPERCALL_SELINUX_GRANT), grant);
+    return ret;
+}
+
+static inline long sc_selinux_revoke(const char *key, struct selinux_grant *grant)
+{
+    if (!key || !key[0]) return -EINVAL;
+    if (!grant) return -EINVAL;
+    long ret = syscall(__NR_supercall, key, compact_cmd(key, SUPERCALL_SELINUX_REVOKE), grant);
+    return ret;
+}
+
+static inline long sc_selinux_grant_clear(const char *key)
+{
+    if (!key || !key[0]) return -EINVAL;
+    long ret = syscall(__NR_supercall, key, compact_cmd(key, SUPERCALL_SELINUX_GRANT_CLEAR));
+    return ret;
+}
+
+/**
+ * @brief Usage of the KernelPatch rw and exec heaps, the hook region and per module memory
+ *
+ * @param key : superkey
+ * @param stat : filled in on success
+ * @return long : 0 if succeed
+ */
+static inline long sc_mem_stat(const char *key, struct kp_mem_stat *stat)
+{
+    if (!key || !key[0]) return -EINVAL;
+    if (!stat) return -EINVAL;
+    long ret = syscall(__NR_supercall, key, compact_cmd(key, SUPERCALL_MEM_STAT), stat);
+    return ret;
+}
+
+/**
+ * @brief Start and end time of each KernelPatch init stage
+ *
+ * @param key : superkey
+ * @param prof : filled in on success
+ * @return long : 0 if succeed
+ */
+static inline long sc_boot_prof(const char *key, struct kp_boot_prof *prof)
+{
+    if (!key || !key[0]) return -EINVAL;
+    if (!prof) return -EINVAL;
+    long ret = syscall(__NR_supercall, key, compact_cmd(key, SUPERCALL_BOOT_PROF), prof);
+    return ret;
+}
+
 static inline long sc_bootlog(const char *key)
 {
     long ret = syscall(__NR_supercall, key, compact_cmd(key, SUPERCALL_BOOTLOG));